@@ -0,0 +1,194 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Machine.h"
+#include "Core/Debugger.h"
+
+namespace Nutshell {
+namespace Core {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+Debugger::Debugger()
+:   m_CommandCount(0),
+    m_Length(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Debugger::~Debugger()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Adds a command to the debugger. Commands are added while the kernel starts,
+// and run from the serial port interrupt, so they must not sleep.
+//
+// Parameters:
+//  p_pName     - The name of the command, as typed on the serial port.
+//  p_pHandler  - The function that runs the command.
+//  p_pContext  - The value passed to the function.
+//******************************************************************************
+void Debugger::AddCommand(const char* p_pName, void (* p_pHandler)(void*, Debugger&), void* p_pContext)
+{
+    assert(this != 0);
+    assert(p_pName != 0);
+    assert(p_pHandler != 0);
+    VERIFY(m_CommandCount < MAX_COMMANDS);
+
+    Command& command = m_Commands[m_CommandCount++];
+    command.m_pName     = p_pName;
+    command.m_pHandler  = p_pHandler;
+    command.m_pContext  = p_pContext;
+}
+
+//******************************************************************************
+// Handles a character received on the serial port. The command line is run
+// once it is complete.
+//
+// Parameters:
+//  p_Character - The character that was received.
+//******************************************************************************
+void Debugger::Receive(char p_Character)
+{
+    assert(this != 0);
+
+    // Check if the command line is complete
+    if (p_Character == '\r' || p_Character == '\n') {
+        *this << "\r\n";
+        if (m_Length > 0) Run();
+        *this << "> ";
+        return;
+    }
+
+    // Check if it's a backspace
+    if (p_Character == '\b' || p_Character == 0x7F) {
+        if (m_Length > 0) {
+            --m_Length;
+            *this << "\b \b";
+        }
+        return;
+    }
+
+    // Echo the character back, unless the line is full.
+    if (m_Length < MAX_LINE) {
+        m_Line[m_Length++] = p_Character;
+        *this << p_Character;
+    }
+}
+
+//******************************************************************************
+// char stream operator.
+//******************************************************************************
+Debugger& Debugger::operator<<(char p_Character)
+{
+    assert(this != 0);
+
+    Machine::WriteSerial(p_Character);
+
+    return *this;
+}
+
+//******************************************************************************
+// char* stream operator.
+//******************************************************************************
+Debugger& Debugger::operator<<(const char* p_pString)
+{
+    assert(this != 0);
+
+    // Write all the characters in the string, turning line feeds into proper
+    // line breaks for the terminal.
+    while (*p_pString != 0) {
+        if (*p_pString == '\n') *this << '\r';
+        *this << *p_pString++;
+    }
+
+    return *this;
+}
+
+//******************************************************************************
+// unsigned stream operator.
+//******************************************************************************
+Debugger& Debugger::operator<<(unsigned p_Value)
+{
+    assert(this != 0);
+
+    // Use the unsigned long long operator
+    return operator<<(static_cast<unsigned long long>(p_Value));
+}
+
+//******************************************************************************
+// unsigned long long stream operator.
+//******************************************************************************
+Debugger& Debugger::operator<<(unsigned long long p_Value)
+{
+    assert(this != 0);
+
+    // Extract the digits, starting with the least significant one
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = static_cast<char>(p_Value % 10 + '0');
+        p_Value /= 10;
+    } while (p_Value != 0);
+
+    // Write them in the proper order
+    while (count > 0) *this << digits[--count];
+
+    return *this;
+}
+
+//******************************************************************************
+// void* stream operator.
+//******************************************************************************
+Debugger& Debugger::operator<<(void* p_pValue)
+{
+    assert(this != 0);
+
+    // Write the hexadecimal prefix
+    *this << "0x";
+
+    // Write all digits, starting with the most significant one
+    size_t value = reinterpret_cast<size_t>(p_pValue);
+    for (int i = 28; i >= 0; i -= 4) {
+        int digit = (value >> i) & 0xF;
+        *this << static_cast<char>(digit < 10 ? digit + '0' : digit - 10 + 'A');
+    }
+
+    return *this;
+}
+
+//******************************************************************************
+// Runs the command on the command line.
+//******************************************************************************
+void Debugger::Run()
+{
+    assert(this != 0);
+
+    // Terminate the command line
+    m_Line[m_Length] = 0;
+    m_Length = 0;
+
+    // Find the matching command and run it
+    for (size_t i = 0; i < m_CommandCount; ++i) {
+        if (strcmp(m_Commands[i].m_pName, m_Line) == 0) {
+            m_Commands[i].m_pHandler(m_Commands[i].m_pContext, *this);
+            return;
+        }
+    }
+
+    // Let the user know which commands are available
+    *this << "Unknown command. Available commands:";
+    for (size_t i = 0; i < m_CommandCount; ++i) *this << ' ' << m_Commands[i].m_pName;
+    *this << "\n";
+}
+
+} // namespace Core
+} // namespace Nutshell
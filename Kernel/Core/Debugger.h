@@ -0,0 +1,62 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef CORE_DEBUGGER_H
+#define CORE_DEBUGGER_H
+
+namespace Nutshell {
+namespace Core {
+
+//******************************************************************************
+// This class encapsulates the kernel debugger. It reads command lines from the
+// debugging serial port, and runs the matching commands, which write their
+// output back to the port.
+//******************************************************************************
+class Debugger : boost::noncopyable {
+private:
+
+    // The maximum number of commands, and the maximum length of a line
+    static const size_t MAX_COMMANDS    = 16;
+    static const size_t MAX_LINE        = 80;
+
+    //**************************************************************************
+    // This holds information about a command.
+    struct Command {
+        const char* m_pName;                            // The name of the command.
+        void        (* m_pHandler)(void*, Debugger&);   // The function that runs the command.
+        void*       m_pContext;                         // The value passed to the function.
+    };
+
+    Command     m_Commands[MAX_COMMANDS];   // The known commands.
+    size_t      m_CommandCount;             // The number of known commands.
+    char        m_Line[MAX_LINE + 1];       // The command line being received.
+    size_t      m_Length;                   // The length of the command line.
+
+public:
+
+    // Construction / destruction
+    Debugger();
+    ~Debugger();
+
+    // Commands management
+    void AddCommand(const char* p_pName, void (* p_pHandler)(void*, Debugger&), void* p_pContext = 0);
+    void Receive(char p_Character);
+
+    // Stream operators
+    Debugger& operator<<(char p_Character);
+    Debugger& operator<<(const char* p_pString);
+    Debugger& operator<<(unsigned p_Value);
+    Debugger& operator<<(unsigned long long p_Value);
+    Debugger& operator<<(void* p_pValue);
+
+private:
+
+    // Command line handling
+    void Run();
+};
+
+} // namespace Core
+} // namespace Nutshell
+
+#endif // !CORE_DEBUGGER_H
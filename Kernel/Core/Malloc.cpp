@@ -15,7 +15,7 @@ namespace Core {
 namespace {
 
     // Use a spinlock to protect kernel memory allocations.
-    Nutshell::Threading::SpinLock g_MallocLock;
+    Nutshell::Threading::SpinLock g_MallocLock("Malloc");
 
 } // anonymous namespace
 
@@ -23,6 +23,9 @@ void Panic(const char* p_pMessage, const char* p_pFile, int p_Line)
     Machine::Panic(p_pMessage, p_pFile, p_Line);
 }
 
+// The simulator runs on the host, which provides these functions
+#ifndef _SIMULATOR_
+
 //******************************************************************************
 // Forward uses of the assert function to Panic.
 //
@@ -52,5 +55,7 @@ extern "C" int write(int p_File, const void* p_pBuffer, unsigned int count)
     Panic("Use of the write() function. Probably a pure virtual call.", __FILE__, __LINE__);
 }
 
+#endif // !_SIMULATOR_
+
 } // namespace Core
 } // namespace Nutshell
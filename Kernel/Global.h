@@ -20,6 +20,20 @@ namespace Nutshell {
 #   define DEBUGCODE(x)
 #endif // _DEBUG
 
+// Macro useful to insert code that collects lock statistics
+#ifdef _LOCKSTAT
+#   define LOCKSTATCODE(x) x
+#else
+#   define LOCKSTATCODE(x)
+#endif // _LOCKSTAT
+
+// Macro useful to insert code that runs the micro-benchmarks at boot
+#ifdef _BENCHMARKS
+#   define BENCHMARKSCODE(x) x
+#else
+#   define BENCHMARKSCODE(x)
+#endif // _BENCHMARKS
+
 // Some global constants about the kernel
 #define KERNEL_LOAD_ADDRESS     0x00100000
 #define KERNEL_SPACE_BOUNDARY   0xC0000000
@@ -35,6 +49,8 @@ extern "C" char     _END_OF_BSS;
 // Fundamental objects and their forward definitions
 namespace Core { class Console; }
 extern Core::Console* g_pConsole;
+namespace Core { class Debugger; }
+extern Core::Debugger* g_pDebugger;
 namespace Paging { class Pager; }
 extern Paging::Pager* g_pPager;
 namespace Threading { class Scheduler; }
@@ -71,6 +87,7 @@ extern "C" void     free(void* p_pBlock);
 // Include the basic headers
 #include "Core/Panic.h"
 #include "Core/Console.h"
+#include "Core/Debugger.h"
 #include "Utilities/Utilities.h"
 
 #endif // !GLOBAL_H
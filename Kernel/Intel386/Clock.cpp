@@ -0,0 +1,122 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Intel386/Clock.h"
+#include "Intel386/Intel386.h"
+
+namespace Nutshell {
+namespace Intel386 {
+
+namespace {
+
+// The number of timer input cycles that fit in the 16 bits counter
+const unsigned MAXIMUM_COUNT = 0xFFFF;
+
+unsigned long long  g_BootTimestamp = 0;    // The timestamp counter when the clock was initialized.
+unsigned long long  g_CyclesPerTick = 1;    // The number of processor cycles per clock tick.
+
+} // namespace
+
+//******************************************************************************
+// Initializes the clock. The  timestamp counter of the processor is  used  to
+// keep time, so we measure its frequency against the interval timer.
+//
+// This must be called while interrupts are disabled.
+//******************************************************************************
+void InitializeClock()
+{
+    // Start a countdown of the whole counter range on channel 0 (mode 0)
+    OutPort(PIT_BASE_PORT + 3,  0x30);
+    OutPort(PIT_BASE_PORT,      MAXIMUM_COUNT & 0xFF);
+    OutPort(PIT_BASE_PORT,      MAXIMUM_COUNT >> 8);
+    unsigned long long start = ReadTimestampCounter();
+
+    // Wait for  the output of the channel to go high, using the  read-back
+    // command to latch its status.
+    do {
+        OutPort(PIT_BASE_PORT + 3, 0xE2);
+    } while ((InPort(PIT_BASE_PORT) & 0x80) == 0);
+    unsigned long long cycles = ReadTimestampCounter() - start;
+
+    // Compute the number of processor cycles in a clock tick
+    g_CyclesPerTick = cycles * PIT_FREQUENCY / (MAXIMUM_COUNT * CLOCK_FREQUENCY);
+    if (g_CyclesPerTick == 0) g_CyclesPerTick = 1;
+
+    // Time starts now
+    g_BootTimestamp = ReadTimestampCounter();
+
+    // Leave the timer stopped until the scheduler needs it
+    DisarmClock();
+}
+
+//******************************************************************************
+// Arranges for a single clock interrupt to be raised after a delay. Any delay
+// previously armed is cancelled.
+//
+// Parameters:
+//  p_Ticks - The number of clock ticks to wait before raising the interrupt.
+//
+// Returns:
+//  The delay that was really armed, in clock ticks.  The timer counter  is
+//  only 16 bits wide, so long delays are cut short and the interrupt handler
+//  is expected to arm the clock again if it still has nothing to do.
+//******************************************************************************
+unsigned ArmClock(unsigned p_Ticks)
+{
+    assert(p_Ticks > 0);
+
+    // Cut the delay to what the counter holds
+    const unsigned cyclesPerTick = PIT_FREQUENCY / CLOCK_FREQUENCY;
+    if (p_Ticks > MAXIMUM_COUNT / cyclesPerTick) p_Ticks = MAXIMUM_COUNT / cyclesPerTick;
+    unsigned count = p_Ticks * cyclesPerTick;
+
+    // Program channel 0 to raise its output once when it reaches 0 (mode 0),
+    // and load the count, low byte first.
+    OutPort(PIT_BASE_PORT + 3,  0x30);
+    OutPort(PIT_BASE_PORT,      count & 0xFF);
+    OutPort(PIT_BASE_PORT,      count >> 8);
+
+    return p_Ticks;
+}
+
+//******************************************************************************
+// Cancels the clock interrupt previously armed, if any.
+//******************************************************************************
+void DisarmClock()
+{
+    // Writing the control word alone stops channel 0 until a new count is
+    // loaded, and keeps its output low so that no interrupt gets raised.
+    OutPort(PIT_BASE_PORT + 3,  0x30);
+}
+
+//******************************************************************************
+// Returns the number of clock ticks elapsed since the clock was initialized.
+//******************************************************************************
+unsigned long long GetClockTicks()
+{
+    return (ReadTimestampCounter() - g_BootTimestamp) / g_CyclesPerTick;
+}
+
+//******************************************************************************
+// Returns the number of processor cycles in a clock tick.
+//******************************************************************************
+unsigned long long GetCyclesPerClockTick()
+{
+    return g_CyclesPerTick;
+}
+
+//******************************************************************************
+// Returns the number of processor cycles elapsed since the processor reset.
+//******************************************************************************
+unsigned long long ReadTimestampCounter()
+{
+    unsigned long long value;
+    asm volatile("rdtsc" : "=A" (value));
+
+    return value;
+}
+
+} // namespace Intel386
+} // namespace Nutshell
@@ -0,0 +1,32 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef INTEL386_CLOCK_H
+#define INTEL386_CLOCK_H
+
+namespace Nutshell {
+namespace Intel386 {
+
+//******************************************************************************
+// Clock related constants.
+//******************************************************************************
+
+// The number of clock ticks per second
+const unsigned CLOCK_FREQUENCY              = 256;
+
+//******************************************************************************
+// Clock management functions.
+//******************************************************************************
+
+void                InitializeClock();
+unsigned            ArmClock(unsigned p_Ticks);
+void                DisarmClock();
+unsigned long long  GetClockTicks();
+unsigned long long  GetCyclesPerClockTick();
+unsigned long long  ReadTimestampCounter();
+
+} // namespace Intel386
+} // namespace Nutshell
+
+#endif // !INTEL386_CLOCK_H
@@ -6,6 +6,8 @@
 #include "Intel386/Handlers.h"
 #include "Intel386/Intel386.h"
 #include "Intel386/Interrupts.h"
+#include "Intel386/Serial.h"
+#include "Intel386/Tasking.h"
 #include "Paging/Pager.h"
 #include "Threading/Scheduler.h"
 
@@ -86,7 +88,8 @@ void InvalidOpcodeInterruptHandler(void* p_pEIP, void*)
 //******************************************************************************
 void DeviceNotAvailableInterruptHandler(void* p_pEIP, void*)
 {
-    PANIC("Device not available interrupt!");
+    // The current task uses the FPU after a switch, give it its state.
+    SwitchFloatingPoint();
 }
 
 //******************************************************************************
@@ -231,18 +234,38 @@ void StreamingSIMDInterruptHandler(void* p_pEIP, void*)
 void ClockInterruptHandler(void* p_pEIP, void*)
 {
     // Send the End Of Interrupt to the PIC
-    SendEndOfInterrupt(RTC_INTERRUPT);
+    SendEndOfInterrupt(PIT_INTERRUPT);
 
-    // Read the  C status  register  from the clock to  know why the interrupt
-    // has been generated. This also does the acknowledge.
-    OutPort(RTC_BASE_PORT, 0xC);
-    int status = InPort(RTC_BASE_PORT + 1);
-
-    // Check if the interrupt is the periodic one
-    if (status & (1 << 6)) {
-        // Call the clock handler on the scheduler
+    // Call the clock handler on the scheduler, if it's running yet. The time
+    // spent handling the interrupt is accounted on its own.
+    if (g_pScheduler != 0) {
+        g_pScheduler->EnterInterrupt(p_pEIP);
         g_pScheduler->Clock();
+        g_pScheduler->LeaveInterrupt();
+    }
+}
+
+//******************************************************************************
+// Internal handler for the interrupt of the kernel debugging serial port.
+//
+// Parameters:
+//  p_pEIP - The address of the faulty instruction.
+//******************************************************************************
+void DebuggingInterruptHandler(void* p_pEIP, void*)
+{
+    // Send the End Of Interrupt to the PIC
+    SendEndOfInterrupt(DEBUGGING_INTERRUPT);
+
+    // Account the time spent handling the interrupt on its own
+    if (g_pScheduler != 0) g_pScheduler->EnterInterrupt(p_pEIP);
+
+    // Pass the received characters to the debugger, if it's running yet.
+    char character;
+    while (ReadSerial(character)) {
+        if (g_pDebugger != 0) g_pDebugger->Receive(character);
     }
+
+    if (g_pScheduler != 0) g_pScheduler->LeaveInterrupt();
 }
 
 } // namespace Intel386
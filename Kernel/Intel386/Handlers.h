@@ -31,6 +31,7 @@ void AlignmentCheckInterruptHandler(void* p_pEIP, void* p_pParam);
 void MachineCheckInterruptHandler(void* p_pEIP, void*);
 void StreamingSIMDInterruptHandler(void* p_pEIP, void*);
 void ClockInterruptHandler(void* p_pEIP, void*);
+void DebuggingInterruptHandler(void* p_pEIP, void*);
 
 } // namespace Intel386
 } // namespace Nutshell
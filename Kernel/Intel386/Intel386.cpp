@@ -4,9 +4,12 @@
 
 #include "Global.h"
 #include "Intel386/Intel386.h"
+#include "Intel386/Clock.h"
 #include "Intel386/Interrupts.h"
 #include "Intel386/Handlers.h"
 #include "Intel386/Paging.h"
+#include "Intel386/Serial.h"
+#include "Intel386/Tasking.h"
 
 namespace Nutshell {
 namespace Intel386 {
@@ -186,7 +189,6 @@ extern "C" void MachineStartup()
     InstallInterruptHandler(4, &OverflowInterruptHandler, false);
     InstallInterruptHandler(5, &BoundRangeExceededInterruptHandler, false);
     InstallInterruptHandler(6, &InvalidOpcodeInterruptHandler, false);
-    InstallInterruptHandler(7, &DeviceNotAvailableInterruptHandler, false);
     InstallInterruptHandler(8, &DoubleFaultInterruptHandler, true);
     InstallInterruptHandler(9, &CoprocessorSegmentOverrunInterruptHandler, false);
     InstallInterruptHandler(10, &InvalidTSSInterruptHandler, true);
@@ -199,7 +201,9 @@ extern "C" void MachineStartup()
     InstallInterruptHandler(18, &MachineCheckInterruptHandler, false);
     InstallInterruptHandler(19, &StreamingSIMDInterruptHandler, false);
 */
-    InstallHardwareInterruptHandler(RTC_INTERRUPT, &ClockInterruptHandler);
+    InstallInterruptHandler(7, &DeviceNotAvailableInterruptHandler, false);
+    InstallHardwareInterruptHandler(PIT_INTERRUPT, &ClockInterruptHandler);
+    if (kernelDebugging) InstallHardwareInterruptHandler(DEBUGGING_INTERRUPT, &DebuggingInterruptHandler);
 
     //--------------------------------------------------------------------------
     // Initialize the Programmable Interrupt Controller.
@@ -228,46 +232,38 @@ extern "C" void MachineStartup()
     // Initialize the serial port used for kernel debugging.
     //--------------------------------------------------------------------------
 
-    // Initialize only if kernel debugging is enabled
+    // Initialize only if kernel debugging is enabled. Commands typed on the
+    // port are handled by the kernel debugger.
     if (kernelDebugging) {
-        // Set the port's speed (9600 bauds)
-        OutPort(DEBUGGING_BASE_PORT + 3, 0x80);
-        OutPort(DEBUGGING_BASE_PORT + 0, 0x0C);
-        OutPort(DEBUGGING_BASE_PORT + 1, 0x00);
-
-        // Set 8 bits, no parity, 1 stop bit mode
-        OutPort(DEBUGGING_BASE_PORT + 3, 0x03);
-
-        // Initialize the FIFO control register
-        OutPort(DEBUGGING_BASE_PORT + 2, 0x07);
-
-        // Initialize the modem control register
-        OutPort(DEBUGGING_BASE_PORT + 4, 0x03);
+        InitializeSerial();
+        SetInterruptMask(GetInterruptMask() & ~(1 << DEBUGGING_INTERRUPT));
     }
 
     //--------------------------------------------------------------------------
-    // Initialize the Real Time Clock.
+    // Initialize the Programmable Interval Timer.
     //
-    // This interrupt is called at regular  intervals and  is used to implement
-    // preemptive multitasking.
+    // This interrupt is used to implement preemptive multitasking. It isn't
+    // periodic: the scheduler arms it only when it has something to do at a
+    // later time (see /ArmClock/).
     //
     // The  interrupt  won't be raised until we  re-enable interrupts  with the
     // processor (this is done when the basic kernel is done initializing).
     //--------------------------------------------------------------------------
 
-    // Unmask the clock interrupt
-    SetInterruptMask(GetInterruptMask() & ~(1 << RTC_INTERRUPT));
+    // Calibrate the clock, which leaves the timer stopped, and unmask the
+    // clock interrupt.
+    InitializeClock();
+    SetInterruptMask(GetInterruptMask() & ~(1 << PIT_INTERRUPT));
 
-    // Setup periodic interrupt frequency (256 ints per second)
-    // TODO: Integrate with CLOCKS_PER_SECOND ...
-    OutPort(RTC_BASE_PORT,        0xA);
-    OutPort(RTC_BASE_PORT + 1,    (1 << 5) | 2);
+    //--------------------------------------------------------------------------
+    // Initialize the floating point unit.
+    //
+    // Its state is switched lazily between tasks: a task only gets its state
+    // loaded when it uses the FPU, which raises the device not available
+    // interrupt (see /SwitchFloatingPoint/).
+    //--------------------------------------------------------------------------
 
-    // Tell the RTC that we want periodic interrupts
-    OutPort(RTC_BASE_PORT,        0xB);
-    char status = InPort(RTC_BASE_PORT + 1);
-    OutPort(RTC_BASE_PORT,        0xB);
-    OutPort(RTC_BASE_PORT + 1,    status | (1 << 6));
+    InitializeFloatingPoint();
 
     //--------------------------------------------------------------------------
     // Initialize the first page directory.
@@ -326,13 +322,17 @@ extern "C" void MachineStartup()
     asm("movl %0, %%cr3" : : "r" (GetPhysicalAddress(g_pPD)));
 
     //--------------------------------------------------------------------------
-    // Initialize the first task selector.
+    // Initialize the task state segment.
+    //
+    // Tasks are switched  in software, so the processor only  uses the  TSS to
+    // know which stack to load when entering the kernel from user mode. There
+    // is only one of them, and the task switching code updates its ESP0 field
+    // on every switch.
     //--------------------------------------------------------------------------
 
-    // The first task selector is  the  one we'll depart  from when we'll make
-    // the first task switch,  and  it needs to  be initialized,  so  we do it
-    // now. First we must allocate a task state segment.
+    // Allocate the task state segment and initialize the kernel stack segment
     g_pTSS = new TaskStateSegment();
+    g_pTSS->SS0(KERNEL_DATA_SEGMENT << 3);
 
     // Make the first TSS descriptor point to the memory we allocated
     (*g_pGDT)[FIRST_TSS_SEGMENT].Base(reinterpret_cast<unsigned>(g_pTSS));
@@ -31,9 +31,10 @@ const size_t MASTER_PIC_BASE_VECTOR         = 32;
 const size_t SLAVE_PIC_BASE_VECTOR          = 40;
 const size_t MASTER_SLAVE_IRQ               = 2;
 
-// RTC related constants
-const size_t RTC_BASE_PORT                  = 0x70;
-const size_t RTC_INTERRUPT                  = 8;
+// PIT related constants
+const size_t PIT_BASE_PORT                  = 0x40;
+const size_t PIT_INTERRUPT                  = 0;
+const size_t PIT_FREQUENCY                  = 1193182;
 
 // Kernel debugging related constants
 const size_t DEBUGGING_BASE_PORT            = 0x3F8;
@@ -41,7 +42,7 @@ const size_t DEBUGGING_BASE_PORT            = 0x3F8;
 extern GlobalDescriptorTable*               g_pGDT;                 // The global descriptor table.
 extern InterruptDescriptorTable*            g_pIDT;                 // The interrupt descriptor table.
 extern PageDirectory*                       g_pPD;                  // The initial page directory.
-extern TaskStateSegment*                    g_pTSS;                 // The initial task state segment.
+extern TaskStateSegment*                    g_pTSS;                 // The task state segment of the processor.
 extern unsigned                             g_MemorySize;           // The size of the memory, in bytes.
 extern char                                 g_EmergencyStack[4096]; // The stack used for booting and emergencies.
 
@@ -18,8 +18,8 @@ asm (
     // This is the entry point of the wrapper
     "_intel386_interrupt_wrapper: ;"
 
-    // TODO:  The interrupt  handler should also  maybe  preserve floating
-    // point registers, but I'm not sure yet...
+    // Floating point registers aren't preserved: they're switched lazily
+    // between tasks, and interrupt handlers must not use them.
 
     // Preserve registers that aren't restored by iret
     "pushl  %eax ;"
@@ -195,6 +195,28 @@ bool DisableInterrupts()
     return Utilities::BitTest(eflags, 9);
 }
 
+//******************************************************************************
+// Returns whether interrupts are currently enabled.
+//******************************************************************************
+bool InterruptsEnabled()
+{
+    // Retrieve the content of the /eflags/ register
+    unsigned eflags;
+    asm volatile("pushfl ; popl %0" : "=r" (eflags));
+
+    return Utilities::BitTest(eflags, 9);
+}
+
+//******************************************************************************
+// Enables interrupts and halts the processor until one is generated.  Since
+// /sti/ only takes effect after the following instruction, an interrupt can't
+// slip in between the two and leave the processor halted with nothing to do.
+//******************************************************************************
+void WaitForInterrupt()
+{
+    asm volatile("sti ; hlt");
+}
+
 //******************************************************************************
 // Retrieves the the interrupt mask.
 //
@@ -19,6 +19,8 @@ void            InstallHardwareInterruptHandler(int p_Interrupt, void (*p_pFunct
 void            UninstallHardwareInterruptHandler(int p_Interrupt);
 void            EnableInterrupts();
 bool            DisableInterrupts();
+bool            InterruptsEnabled();
+void            WaitForInterrupt();
 unsigned short  GetInterruptMask();
 void            SetInterruptMask(unsigned short p_Mask);
 void            SendEndOfInterrupt(int p_IRQ);
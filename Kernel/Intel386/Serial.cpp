@@ -0,0 +1,73 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Intel386/Serial.h"
+#include "Intel386/Intel386.h"
+
+namespace Nutshell {
+namespace Intel386 {
+
+//******************************************************************************
+// Initializes the serial port used for kernel debugging. It raises  an
+// interrupt whenever a character is received.
+//******************************************************************************
+void InitializeSerial()
+{
+    // Set the port's speed (9600 bauds)
+    OutPort(DEBUGGING_BASE_PORT + 3, 0x80);
+    OutPort(DEBUGGING_BASE_PORT + 0, 0x0C);
+    OutPort(DEBUGGING_BASE_PORT + 1, 0x00);
+
+    // Set 8 bits, no parity, 1 stop bit mode
+    OutPort(DEBUGGING_BASE_PORT + 3, 0x03);
+
+    // Initialize the FIFO control register
+    OutPort(DEBUGGING_BASE_PORT + 2, 0x07);
+
+    // Initialize the modem control register. The OUT2 line must be raised
+    // for the interrupt to reach the PIC.
+    OutPort(DEBUGGING_BASE_PORT + 4, 0x0B);
+
+    // Only interrupt when a character is received
+    OutPort(DEBUGGING_BASE_PORT + 1, 0x01);
+}
+
+//******************************************************************************
+// Writes a character to the serial port, waiting for the transmitter to be
+// ready if needed.
+//
+// Parameters:
+//  p_Character - The character to write.
+//******************************************************************************
+void WriteSerial(char p_Character)
+{
+    // Wait until the transmitter holding register is empty
+    while (!Utilities::BitTest(InPort(DEBUGGING_BASE_PORT + 5), 5)) {
+    }
+
+    OutPort(DEBUGGING_BASE_PORT, p_Character);
+}
+
+//******************************************************************************
+// Reads a character from the serial port, if one was received.
+//
+// Parameters:
+//  p_rCharacter - Receives the character that was read.
+//
+// Returns:
+//  Whether a character was read.
+//******************************************************************************
+bool ReadSerial(char& p_rCharacter)
+{
+    // Check if there's received data waiting
+    if (!Utilities::BitTest(InPort(DEBUGGING_BASE_PORT + 5), 0)) return false;
+
+    p_rCharacter = InPort(DEBUGGING_BASE_PORT);
+
+    return true;
+}
+
+} // namespace Intel386
+} // namespace Nutshell
@@ -0,0 +1,29 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef INTEL386_SERIAL_H
+#define INTEL386_SERIAL_H
+
+namespace Nutshell {
+namespace Intel386 {
+
+//******************************************************************************
+// Serial port related constants.
+//******************************************************************************
+
+// The interrupt raised by the serial port used for kernel debugging
+const size_t DEBUGGING_INTERRUPT            = 4;
+
+//******************************************************************************
+// Functions for the serial port used for kernel debugging.
+//******************************************************************************
+
+void    InitializeSerial();
+void    WriteSerial(char p_Character);
+bool    ReadSerial(char& p_rCharacter);
+
+} // namespace Intel386
+} // namespace Nutshell
+
+#endif // !INTEL386_SERIAL_H
@@ -5,11 +5,226 @@
 #include "Global.h"
 #include "Intel386/Tasking.h"
 #include "Intel386/Intel386.h"
+#include "Intel386/Interrupts.h"
 #include "Intel386/Paging.h"
 
 namespace Nutshell {
 namespace Intel386 {
 
+//******************************************************************************
+// This is the code that switches the processor from one task to another.  It
+// only preserves the callee-saved registers on the stack of the current task,
+// since the  compiler  already  assumes the others are  clobbered by the call.
+//
+// Arguments are:
+//  - the address where to save the stack pointer of the current task.
+//  - the saved stack pointer of the task to switch to.
+//  - the physical address of the page directory to load, or 0 to keep the
+//    current one.
+//******************************************************************************
+asm (
+    "_intel386_switch_stack: ;"
+
+    // Load the arguments while we still are on the current stack
+    "movl   4(%esp), %eax ;"
+    "movl   8(%esp), %edx ;"
+    "movl   12(%esp), %ecx ;"
+
+    // Preserve the callee-saved registers and save the stack pointer
+    "pushl  %ebp ;"
+    "pushl  %ebx ;"
+    "pushl  %esi ;"
+    "pushl  %edi ;"
+    "movl   %esp, (%eax) ;"
+
+    // Load the new page directory if needed.  The stack isn't  touched until
+    // the new stack pointer  is loaded, since  the current one might not  be
+    // mapped in the new address space.
+    "testl  %ecx, %ecx ;"
+    "jz     0f ;"
+    "movl   %ecx, %cr3 ;"
+    "0: ;"
+    "movl   %edx, %esp ;"
+
+    // Restore the callee-saved registers of the new task and resume it
+    "popl   %edi ;"
+    "popl   %esi ;"
+    "popl   %ebx ;"
+    "popl   %ebp ;"
+    "ret ;"
+);
+
+//******************************************************************************
+// This is the code that switches the processor to a task that never ran. It
+// saves the current task just like /intel386_switch_stack/, and then calls the
+// entry point of the new task on its empty stack, with interrupts enabled.
+//
+// Arguments are:
+//  - the address where to save the stack pointer of the current task.
+//  - the top of the stack of the task to start.
+//  - the physical address of the page directory to load, or 0 to keep the
+//    current one.
+//  - the entry point of the task.
+//  - the argument to pass to the entry point.
+//******************************************************************************
+asm (
+    "_intel386_start_stack: ;"
+
+    // Preserve the callee-saved registers and save the stack pointer
+    "pushl  %ebp ;"
+    "pushl  %ebx ;"
+    "pushl  %esi ;"
+    "pushl  %edi ;"
+    "movl   20(%esp), %eax ;"
+    "movl   %esp, (%eax) ;"
+
+    // Load the remaining arguments while we still are on the current stack
+    "movl   24(%esp), %edx ;"
+    "movl   28(%esp), %ecx ;"
+    "movl   32(%esp), %ebx ;"
+    "movl   36(%esp), %esi ;"
+
+    // Load the new page directory if needed, then the new stack
+    "testl  %ecx, %ecx ;"
+    "jz     0f ;"
+    "movl   %ecx, %cr3 ;"
+    "0: ;"
+    "movl   %edx, %esp ;"
+
+    // Call the entry point of the task with interrupts enabled
+    "sti ;"
+    "pushl  %esi ;"
+    "call   *%ebx ;"
+
+    // The entry point of a task must never return
+    "call   _intel386_task_returned ;"
+);
+
+extern "C" {
+    void intel386_switch_stack(size_t* p_pSave, size_t p_Stack, size_t p_Directory);
+    void intel386_start_stack(size_t* p_pSave, size_t p_Stack, size_t p_Directory, void (* p_pEntry)(void*), void* p_pArgument);
+}
+
+namespace {
+
+    // The task descriptor used for the code that runs before the first switch.
+    // Descriptor 0 is never used, so that it can mean 'no task'.
+    const int   BOOT_TASK_DESCRIPTOR = 1;
+
+    // The type of the entry point of a task.
+    typedef void (* TaskEntry)(void*);
+
+    // The size and alignment of the area used by FXSAVE and FXRSTOR, which is
+    // also large enough for FNSAVE and FRSTOR.
+    const size_t FLOATING_POINT_STATE_SIZE      = 512;
+    const size_t FLOATING_POINT_STATE_ALIGNMENT = 16;
+
+    // The offsets of the control word and of MXCSR in the FXSAVE area, and
+    // the values they hold after a reset.
+    const size_t            FXSAVE_CONTROL_WORD     = 0;
+    const size_t            FXSAVE_MXCSR            = 24;
+    const unsigned short    DEFAULT_CONTROL_WORD    = 0x037f;
+    const unsigned          DEFAULT_MXCSR           = 0x1f80;
+
+    // The feature flags reported by CPUID in EDX
+    const unsigned  FEATURE_FXSR    = 1 << 24;
+    const unsigned  FEATURE_SSE     = 1 << 25;
+
+    // The task table grows by chunks that never move once allocated, since
+    // the switching code saves stack pointers right into it.
+    const int   TASKS_PER_CHUNK = 64;
+    const int   MAXIMUM_CHUNKS  = 256;
+
+    //**************************************************************************
+    // This holds the state of a task that isn't running.
+    struct Task {
+        size_t      m_Stack;        // The saved stack pointer, or 0 if the task never ran.
+        size_t      m_KernelStack;  // The top of the kernel stack of the task.
+        size_t      m_Directory;    // The physical address of the page directory of the task.
+        TaskEntry   m_pEntry;       // The entry point of the task.
+        void*       m_pArgument;    // The argument to pass to the entry point.
+        void*       m_pFPUState;    // The area that holds the floating point state of the task.
+        bool        m_FPUSaved;     // Whether the area holds a state to restore.
+        bool        m_Available;    // Whether the descriptor was released.
+        int         m_Next;         // The next released descriptor, or 0.
+    };
+
+    Task*   g_pTaskChunks[MAXIMUM_CHUNKS];          // The chunks of the task table, indexed by descriptor.
+    int     g_TaskCount = 0;                        // The number of descriptors created so far.
+    int     g_AvailableTask = 0;                    // The last released descriptor, or 0.
+    int     g_CurrentTask = BOOT_TASK_DESCRIPTOR;   // The task running on the processor.
+    int     g_FloatingPointOwner = 0;               // The task whose floating point state is loaded, if any.
+    bool    g_ExtendedFloatingPoint = false;        // Whether FXSAVE and FXRSTOR are used to switch the FPU.
+
+    // The state FXRSTOR loads for a task that never used the FPU. FNINIT
+    // leaves the SSE registers and MXCSR alone, so they would otherwise still
+    // hold those of the previous owner.
+    char    g_DefaultFPUState[FLOATING_POINT_STATE_SIZE] __attribute__((aligned(FLOATING_POINT_STATE_ALIGNMENT)));
+
+    //**************************************************************************
+    // Returns the task that matches a descriptor.
+    //**************************************************************************
+    Task& GetTask(int p_Task)
+    {
+        assert(p_Task > 0 && p_Task < g_TaskCount);
+
+        return g_pTaskChunks[p_Task / TASKS_PER_CHUNK][p_Task % TASKS_PER_CHUNK];
+    }
+
+    //**************************************************************************
+    // Creates a new descriptor at the end of the task table, allocating a new
+    // chunk when the last one is full.
+    //**************************************************************************
+    int CreateTask()
+    {
+        VERIFY(g_TaskCount < TASKS_PER_CHUNK * MAXIMUM_CHUNKS);
+
+        if (g_TaskCount % TASKS_PER_CHUNK == 0) {
+            g_pTaskChunks[g_TaskCount / TASKS_PER_CHUNK] = new Task[TASKS_PER_CHUNK]();
+        }
+
+        return g_TaskCount++;
+    }
+
+    //**************************************************************************
+    // Returns the feature flags that CPUID reports in EDX, or 0 if the
+    // processor is too old to have the instruction.
+    //**************************************************************************
+    unsigned GetFeatures()
+    {
+        // CPUID is available if the ID flag of EFLAGS can be toggled
+        size_t before, after;
+        asm volatile(
+            "pushfl ;"
+            "popl   %0 ;"
+            "movl   %0, %1 ;"
+            "xorl   $0x200000, %1 ;"
+            "pushl  %1 ;"
+            "popfl ;"
+            "pushfl ;"
+            "popl   %1 ;"
+            "pushl  %0 ;"
+            "popfl ;"
+            : "=&r" (before), "=&r" (after));
+        if (((before ^ after) & 0x200000) == 0) return 0;
+
+        // Read the standard feature flags
+        unsigned eax = 1, ebx, ecx, edx;
+        asm volatile("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+
+        return edx;
+    }
+
+    //**************************************************************************
+    // Called when the entry point of a task returns.
+    //**************************************************************************
+    extern "C" void intel386_task_returned()
+    {
+        PANIC("The entry point of a task returned!");
+    }
+
+} // anonymous namespace
+
 //******************************************************************************
 // Allocates a new task descriptor.
 //
@@ -17,52 +232,56 @@ namespace Intel386 {
 //  p_Directory - The descriptor of the page directory.
 //  p_Stack     - The address of the top of the stack.
 //  p_pEntry    - The entry point of the task.
+//  p_pArgument - The argument to pass to the entry point.
 //
 // Returns:
 //  The task descriptor.
 //******************************************************************************
-int AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*))
+int AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*), void* p_pArgument)
 {
     assert(p_Directory != 0);
     assert(p_pEntry != 0);
 
-    // Look for an available descriptor in the GDT
-    int index = 0;
-    for (int i = 0; i < 8192; ++i) {
-        // Check if the current descriptor is available
-        if (!(*g_pGDT)[FIRST_TSS_SEGMENT + i].P()) {
-            index = FIRST_TSS_SEGMENT + i;
-            break;
-        }
+    // The clock interrupt switches tasks, so keep it away while the table
+    // and the released descriptors are updated.
+    bool enabled = DisableInterrupts();
+
+    // Make room for the boot task the first time we're called
+    if (g_TaskCount == 0) {
+        while (g_TaskCount <= BOOT_TASK_DESCRIPTOR) CreateTask();
+        GetTask(BOOT_TASK_DESCRIPTOR).m_pFPUState = memalign(FLOATING_POINT_STATE_ALIGNMENT, FLOATING_POINT_STATE_SIZE);
     }
 
-    // If we found no descriptor we're in trouble !
-    if (index == 0) {
-        PANIC("Out of task descriptors!");
+    // Reuse a released descriptor if possible, and otherwise create a new one
+    int task;
+    if (g_AvailableTask != 0) {
+        task = g_AvailableTask;
+        g_AvailableTask = GetTask(task).m_Next;
+    } else {
+        task = CreateTask();
     }
 
-    // Allocate a new task state segment
-    TaskStateSegment* pTSS = new TaskStateSegment();
-
-    // Make the descriptor point to our the allocated TSS
-    (*g_pGDT)[index].Base(reinterpret_cast<unsigned>(pTSS));
-    (*g_pGDT)[index].Limit(sizeof(TaskStateSegment) - 1);
-    (*g_pGDT)[index].G(true);
-    (*g_pGDT)[index].P(true);
-    (*g_pGDT)[index].Type(SegmentDescriptor::TSS32BitAvailable);
-
-    // Initialize the TSS for the task
-    pTSS->ESP(p_Stack);
-    pTSS->SS(KERNEL_DATA_SEGMENT << 3);
-    pTSS->CS(KERNEL_CODE_SEGMENT << 3);
-    pTSS->DS(KERNEL_DATA_SEGMENT << 3);
-    pTSS->ES(KERNEL_DATA_SEGMENT << 3);
-    pTSS->FS(KERNEL_DATA_SEGMENT << 3);
-    pTSS->GS(KERNEL_DATA_SEGMENT << 3);
-    pTSS->EIP(reinterpret_cast<unsigned>(p_pEntry));
-    pTSS->CR3(GetPhysicalAddress(reinterpret_cast<PageDirectory*>(p_Directory)));
-
-    return index;
+    // Initialize the task so that it starts at its entry point
+    Task& rTask = GetTask(task);
+    rTask.m_Stack           = 0;
+    rTask.m_KernelStack     = p_Stack;
+    rTask.m_Directory       = GetPhysicalAddress(reinterpret_cast<PageDirectory*>(p_Directory));
+    rTask.m_pEntry          = p_pEntry;
+    rTask.m_pArgument       = p_pArgument;
+    rTask.m_Available       = false;
+    rTask.m_Next            = 0;
+
+    // The floating point area stays with the descriptor when it is released,
+    // so that it only gets allocated once. The task has no state to restore
+    // until it uses the FPU.
+    if (rTask.m_pFPUState == 0) {
+        rTask.m_pFPUState = memalign(FLOATING_POINT_STATE_ALIGNMENT, FLOATING_POINT_STATE_SIZE);
+    }
+    rTask.m_FPUSaved = false;
+
+    if (enabled) EnableInterrupts();
+
+    return task;
 }
 
 //******************************************************************************
@@ -73,14 +292,22 @@ int AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)
 //******************************************************************************
 void ReleaseTaskDescriptor(int p_Task)
 {
-    assert(p_Task >= FIRST_TSS_SEGMENT && p_Task < 8192);
-    assert((*g_pGDT)[p_Task].P());
+    assert(p_Task > BOOT_TASK_DESCRIPTOR && p_Task < g_TaskCount);
+    assert(p_Task != g_CurrentTask);
+    assert(!GetTask(p_Task).m_Available);
+
+    bool enabled = DisableInterrupts();
 
-    // Release the TSS for the task descriptor
-    delete reinterpret_cast<TaskStateSegment*>((*g_pGDT)[p_Task].Base());
+    // The floating point state of the task is of no use anymore
+    if (g_FloatingPointOwner == p_Task) g_FloatingPointOwner = 0;
 
-    // Reset the entry in the GDT
-    (*g_pGDT)[p_Task].Reset();
+    // Make the descriptor available for future tasks
+    Task& rTask = GetTask(p_Task);
+    rTask.m_Available   = true;
+    rTask.m_Next        = g_AvailableTask;
+    g_AvailableTask     = p_Task;
+
+    if (enabled) EnableInterrupts();
 }
 
 //******************************************************************************
@@ -88,15 +315,7 @@ void ReleaseTaskDescriptor(int p_Task)
 //******************************************************************************
 int GetCurrentTaskDescriptor()
 {
-    // NOTE: The /str/ instruction  used  here  does  NOT  clear the upper
-    // 16-bits  when the operand is a memory location, and that is  why we
-    // force the use of a register instead.
-
-    // Retrieve the value of the task register
-    unsigned short descriptor;
-    asm("str %0" : "=r" (descriptor));
-
-    return descriptor >> 3;
+    return g_CurrentTask;
 }
 
 //******************************************************************************
@@ -104,31 +323,126 @@ int GetCurrentTaskDescriptor()
 //
 // Parameters:
 //  p_Task - The task descriptor.
+//
+// Notes:  Interrupts must be  disabled. Only the stack pointer and page
+// directory are switched, along with the kernel stack used by the processor
+// when entering the kernel. The floating point state is switched lazily: the
+// task switched flag is raised unless the new task owns the FPU, so that it
+// faults the first time it uses it (see /SwitchFloatingPoint/).
 //******************************************************************************
 void SwitchToTaskDescriptor(int p_Task)
 {
-    assert(p_Task >= FIRST_TSS_SEGMENT && p_Task < 8192);
-    assert((*g_pGDT)[p_Task].P());
-
-    // If we're currently  tracing the  kernel, we  must raise  the instruction
-    // trap flag in the soon-to-be-switched-to task descriptor.
-//    if (g_TracingKernel) {
-//        TaskStateSegment* pTSS = reinterpret_cast<TaskStateSegment*>((*g_pGDT)[p_Task].Base());
-//        pTSS->EFLAGS(pTSS->EFLAGS() | 0x100);
-//    }
-
-    // Declare a structure that will be used to call LJMP
-    struct {
-        unsigned        g_Offset   __attribute__((packed));
-        unsigned short  g_Selector __attribute__((packed));
-    } ljmpParams;
-
-    // Fill the structure with  the appropriate values (the  g_Offset part
-    // is ignored by the processor and thus we need not to fill it)
-    ljmpParams.g_Selector = p_Task << 3;
-
-    // Perform a jump to the task
-    asm("ljmp *%0" : : "m" (ljmpParams));
+    assert(p_Task > BOOT_TASK_DESCRIPTOR && p_Task < g_TaskCount);
+    assert(p_Task != g_CurrentTask);
+    assert(!GetTask(p_Task).m_Available);
+
+    // Retrieve the tasks we're switching from and to
+    Task* pCurrent = &GetTask(g_CurrentTask);
+    Task* pNext = &GetTask(p_Task);
+
+    // Have the processor use the kernel stack of the new task
+    g_pTSS->ESP0(pNext->m_KernelStack);
+
+    // Let the new task use the FPU right away only if its state is loaded
+    if (p_Task == g_FloatingPointOwner) {
+        asm volatile("clts");
+    } else {
+        size_t cr0;
+        asm volatile("movl %%cr0, %0" : "=r" (cr0));
+        asm volatile("movl %0, %%cr0" : : "r" (cr0 | (1 << 3)));
+    }
+
+    // Only reload the page directory (and flush the TLB) if it changes
+    size_t directory = pNext->m_Directory != pCurrent->m_Directory ? pNext->m_Directory : 0;
+
+    // Switch to the new task, starting it if it never ran
+    g_CurrentTask = p_Task;
+    if (pNext->m_Stack != 0) {
+        intel386_switch_stack(&pCurrent->m_Stack, pNext->m_Stack, directory);
+    } else {
+        intel386_start_stack(&pCurrent->m_Stack, pNext->m_KernelStack, directory, pNext->m_pEntry, pNext->m_pArgument);
+    }
+}
+
+//******************************************************************************
+// Initializes the floating point unit. Errors are reported through exceptions,
+// FXSAVE and FXRSTOR are enabled along with SSE when the processor has them,
+// and the task switched flag is raised so that the first task to use the FPU
+// faults. Older processors have their state switched with FNSAVE and FRSTOR.
+//******************************************************************************
+void InitializeFloatingPoint()
+{
+    unsigned features = GetFeatures();
+
+    // Clear EM, and raise MP and NE within CR0
+    size_t cr0;
+    asm volatile("movl %%cr0, %0" : "=r" (cr0));
+    cr0 = (cr0 & ~(1 << 2)) | (1 << 1) | (1 << 5);
+    asm volatile("movl %0, %%cr0" : : "r" (cr0));
+
+    // Raise OSFXSR within CR4 if FXSAVE is available, and OSXMMEXCPT along
+    // with it if SSE is. CR4 is left alone otherwise, since processors that
+    // lack CPUID might not have it at all.
+    if ((features & FEATURE_FXSR) != 0) {
+        size_t cr4;
+        asm volatile("movl %%cr4, %0" : "=r" (cr4));
+        cr4 |= 1 << 9;
+        if ((features & FEATURE_SSE) != 0) cr4 |= 1 << 10;
+        asm volatile("movl %0, %%cr4" : : "r" (cr4));
+        g_ExtendedFloatingPoint = true;
+
+        // Build the default state: that of FNINIT, with the SSE registers
+        // cleared and the SSE exceptions masked. The rest of the area is
+        // already cleared.
+        *reinterpret_cast<unsigned short*>(g_DefaultFPUState + FXSAVE_CONTROL_WORD) = DEFAULT_CONTROL_WORD;
+        *reinterpret_cast<unsigned*>(g_DefaultFPUState + FXSAVE_MXCSR) = DEFAULT_MXCSR;
+    }
+
+    // Reset the FPU, and have the first task that uses it fault
+    asm volatile("fninit");
+    asm volatile("movl %0, %%cr0" : : "r" (cr0 | (1 << 3)));
+}
+
+//******************************************************************************
+// Gives the FPU to the current task. Called by the device not available
+// handler, when a task uses the FPU while the task switched flag is raised:
+// the state of the previous owner is saved, and the state of the current task
+// is restored, or reset if it never used the FPU.
+//
+// Notes: Interrupts must be disabled. Interrupt handlers must not use the FPU,
+// since the state loaded belongs to the interrupted task.
+//******************************************************************************
+void SwitchFloatingPoint()
+{
+    assert(g_CurrentTask < g_TaskCount);
+
+    // Let the current task use the FPU without faulting again
+    asm volatile("clts");
+    if (g_FloatingPointOwner == g_CurrentTask) return;
+
+    // Save the state of the previous owner, if any.
+    if (g_FloatingPointOwner != 0) {
+        Task* pOwner = &GetTask(g_FloatingPointOwner);
+        if (g_ExtendedFloatingPoint) {
+            asm volatile("fxsave (%0)" : : "r" (pOwner->m_pFPUState) : "memory");
+        } else {
+            asm volatile("fnsave (%0)" : : "r" (pOwner->m_pFPUState) : "memory");
+        }
+        pOwner->m_FPUSaved = true;
+    }
+
+    // Load the state of the current task, or the default one if it has none
+    // yet.
+    Task* pCurrent = &GetTask(g_CurrentTask);
+    if (g_ExtendedFloatingPoint) {
+        void* pState = pCurrent->m_FPUSaved ? pCurrent->m_pFPUState : g_DefaultFPUState;
+        asm volatile("fxrstor (%0)" : : "r" (pState) : "memory");
+    } else if (pCurrent->m_FPUSaved) {
+        asm volatile("frstor (%0)" : : "r" (pCurrent->m_pFPUState) : "memory");
+    } else {
+        asm volatile("fninit");
+    }
+    g_FloatingPointOwner = g_CurrentTask;
 }
 
 } // namespace Intel386
@@ -12,10 +12,12 @@ namespace Intel386 {
 // Task management functions.
 //******************************************************************************
 
-int     AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*));
+int     AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*), void* p_pArgument);
 void    ReleaseTaskDescriptor(int p_Task);
 int     GetCurrentTaskDescriptor();
 void    SwitchToTaskDescriptor(int p_Task);
+void    InitializeFloatingPoint();
+void    SwitchFloatingPoint();
 
 } // namespace Intel386
 } // namespace Nutshell
@@ -12,12 +12,14 @@ asm(".text ; jmp _MachineStartup");
 #include "Threading/Scheduler.h"
 #include "Threading/Process.h"
 #include "Threading/Thread.h"
+#include "Threading/LockClass.h"
 #include "Intel386/Intel386.h"
 
 namespace Nutshell {
 
 // From "Global.h"
 Core::Console*          g_pConsole = 0;
+Core::Debugger*         g_pDebugger = 0;
 Paging::Pager*          g_pPager = 0;
 Threading::Scheduler*   g_pScheduler = 0;
 
@@ -43,6 +45,8 @@ extern "C" void start()
     }
 
     g_pConsole = new Core::Console();
+    g_pDebugger = new Core::Debugger();
+    LOCKSTATCODE(g_pDebugger->AddCommand("lockstat", &Threading::LockClass::Command));
 
     PANIC("Stop here");
 
@@ -58,6 +62,12 @@ extern "C" void start()
     Threading::ProcessSP spProcess(new Threading::Process());
     g_pPager->AddPageable(spProcess);
 
+    // Start the thread that cleans up after terminated threads.
+    g_pScheduler->StartReaper(spProcess);
+
+    // Create the thread that runs when nothing else is ready.
+    g_pScheduler->StartIdle(spProcess);
+
     // Create the first thread in the process.
     Threading::ThreadSP  spThread(new Threading::Thread(spProcess, (void (*)(void*)) &Main));
     g_pScheduler->AddThread(spThread);
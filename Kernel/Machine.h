@@ -10,10 +10,14 @@
 
 #ifdef _INTEL386_
     #include "Intel386/Intel386.h"
+    #include "Intel386/Clock.h"
     #include "Intel386/Panic.h"
     #include "Intel386/Paging.h"
     #include "Intel386/Tasking.h"
     #include "Intel386/Interrupts.h"
+    #include "Intel386/Serial.h"
+#elif defined(_SIMULATOR_)
+    #include "Simulator/Machine.h"
 #else
     #error "Include the proper machine header here..."
 #endif
@@ -24,6 +28,8 @@ namespace Machine {
 // Import the machine API within this namespace
 #ifdef _INTEL386_
 using namespace Intel386;
+#elif defined(_SIMULATOR_)
+using namespace Simulator;
 #else
     #error "Import the proper namespace here..."
 #endif
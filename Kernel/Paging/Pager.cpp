@@ -6,7 +6,7 @@
 #include "Machine.h"
 #include "Paging/Pager.h"
 #include "Threading/Scheduler.h"
-#include "Threading/InterruptLock.h"
+#include "Threading/PreemptLock.h"
 
 namespace Nutshell {
 namespace Paging {
@@ -19,7 +19,9 @@ namespace Paging {
 // Constructor.
 //******************************************************************************
 Pager::Pager()
-:   m_KernelSize(0)
+:   m_SpinLock("Pager"),
+    m_KernelSize(0),
+    m_KernelSpinLock("PagerKernel")
 {
     assert(this != 0);
 
@@ -90,13 +92,18 @@ void Pager::AddPageable(PageableSP p_spPageable)
 {
     assert(this != 0);
     assert(p_spPageable != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spPageable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock1(m_SpinLock);
+    Threading::RWSpinLockWriteLocker lock2(p_spPageable->m_SpinLock);
     assert(!Utilities::SequenceContains(m_Pageables, p_spPageable));
 
-    // Add the pageable to the vector
-    m_Pageables.push_back(p_spPageable);
+    // Add the pageable to the vector. Growing the vector may resize the kernel
+    // memory, which reads the vector, so it's done before the vector is locked.
+    m_Pageables.reserve(m_Pageables.size() + 1);
+    {
+        Threading::RWSpinLockWriteLocker pageablesLock(m_PageablesLock);
+        m_Pageables.push_back(p_spPageable);
+    }
 
     // Map  the  kernel  page  tables  within  the  pageable.  They  have been
     // prepared  by  the  constructor and  the  /KernelSize/  method  and they
@@ -116,9 +123,9 @@ void Pager::RemovePageable(PageableSP p_spPageable)
 {
     assert(this != 0);
     assert(p_spPageable != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spPageable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock1(m_SpinLock);
+    Threading::RWSpinLockWriteLocker lock2(p_spPageable->m_SpinLock);
     assert(Utilities::SequenceContains(m_Pageables, p_spPageable));
 
     // Unmap the kernel page tables from the pageable
@@ -127,6 +134,7 @@ void Pager::RemovePageable(PageableSP p_spPageable)
     }
 
     // Remove the pageable from the vector
+    Threading::RWSpinLockWriteLocker pageablesLock(m_PageablesLock);
     m_Pageables.erase(std::find(m_Pageables.begin(), m_Pageables.end(), p_spPageable));
 }
 
@@ -142,9 +150,9 @@ void Pager::LockMapable(MapableSP p_spMapable, size_t p_Address)
     assert(this != 0);
     assert(p_spMapable != 0);
     assert(p_Address % OS_PAGE_SIZE == 0 || p_Address == 0xFFFFFFFF);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spMapable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
     assert(!p_spMapable->m_Locked);
 
     // Go through all the pages of the mapable and ensure they are in memory
@@ -208,9 +216,9 @@ void Pager::UnlockMapable(MapableSP p_spMapable)
 {
     assert(this != 0);
     assert(p_spMapable != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spMapable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
     assert(p_spMapable->m_Locked);
 
     // Go  through all  the  pages of the mapable and  make the frame they use
@@ -233,8 +241,7 @@ void Pager::UnlockMapable(MapableSP p_spMapable)
 void Pager::PageFault(size_t p_Address)
 {
     assert(this != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock(m_SpinLock);
+    Threading::PreemptLock prelock;
 
     PANIC("PAGE FAULT!");
 
@@ -244,32 +251,48 @@ void Pager::PageFault(size_t p_Address)
     // Compute the address of the beginning of the faulting page
     size_t address = p_Address - p_Address % OS_PAGE_SIZE;
 
-    // Attempt to retrieve an iterator to the mapable that should  contain the
-    // faulting page (if such a mapable exists).
-    Pageable::MapableMap::iterator mapable = pPageable->m_Mapables.upper_bound(address);
+    // Look for the mapable that should contain the faulting page. This only
+    // reads the mapables of the pageable, so faults within the same pageable
+    // look them up in parallel. We keep a reference to the mapable in case it
+    // gets unmapped meanwhile.
+    MapableSP spMapable;
+    size_t index;
+    {
+        Threading::RWSpinLockReadLocker lock(pPageable->m_SpinLock);
+
+        // Attempt to retrieve an iterator to the mapable that should  contain
+        // the faulting page (if such a mapable exists).
+        Pageable::MapableMap::iterator mapable = pPageable->m_Mapables.upper_bound(address);
+
+        // Ensure the page fault is 'valid' (within a mapable we know about...)
+        if (mapable == pPageable->m_Mapables.end() || address < mapable->first - mapable->second->Size()) {
+            // TODO: Handle faulty page faults !
+            PANIC("Page fault outside any valid mapable!");
+        }
 
-    // Ensure the page fault is 'valid' (within a mapable we know about...)
-    if (mapable == pPageable->m_Mapables.end() || address < mapable->first - mapable->second->Size()) {
-        // TODO: Handle faulty page faults !
-        PANIC("Page fault outside any valid mapable!");
+        // Compute the index of the page within the mapable
+        index = (address - mapable->first + mapable->second->Size()) / OS_PAGE_SIZE;
+        spMapable = mapable->second;
     }
 
-    // Compute the index  of the page within the mapable, and the index of the
-    // page table and the page within the same mapable.
-    size_t index = (address - mapable->first + mapable->second->Size()) / OS_PAGE_SIZE;
+    // Compute the index of the page table and the page within the mapable
     size_t table = index / PAGE_TABLE_CAPACITY;
     size_t page  = index % PAGE_TABLE_CAPACITY;
 
+    // Only the frames need the pager lock
+    Threading::RecursiveSpinLockLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(spMapable->m_SpinLock);
+
     // Retrieve an available frame, and  put  it back in the recently accessed
     // queue so that it will be a candidate for future replacement.
     size_t frame = GetAvailableFrame();
     m_Recent.push_back(frame);
 
     // Map the page to the frame we got
-    Machine::MapPageToFrame(mapable->second->m_Tables[table], page, frame);
+    Machine::MapPageToFrame(spMapable->m_Tables[table], page, frame);
 
     // Retrieve a pointer on the page structure of the page we just mapped
-    Mapable::Page* pPage = &mapable->second->m_Pages[index];
+    Mapable::Page* pPage = &spMapable->m_Pages[index];
 
     // Check if the page has already been initialized
     if (pPage->m_Initialized) {
@@ -281,7 +304,7 @@ void Pager::PageFault(size_t p_Address)
     }
 
     // Update frame information
-    m_Frames[frame].m_pOwner = mapable->second.get();
+    m_Frames[frame].m_pOwner = spMapable.get();
     m_Frames[frame].m_Index  = index;
 
     // Update page information
@@ -295,8 +318,8 @@ void Pager::PageFault(size_t p_Address)
 size_t Pager::KernelSize() const
 {
     assert(this != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock(m_KernelSpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock(m_KernelSpinLock);
 
     return m_KernelSize;
 }
@@ -312,8 +335,8 @@ void Pager::KernelSize(size_t p_Size)
     assert(this != 0);
     assert(p_Size >= &_END_OF_BSS - &_BEGINNING_OF_TEXT);
     assert(p_Size % OS_PAGE_SIZE == 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock(m_KernelSpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock(m_KernelSpinLock);
 
     // Convert the specified size to page units instead of bytes
     p_Size /= OS_PAGE_SIZE;
@@ -349,6 +372,7 @@ void Pager::KernelSize(size_t p_Size)
             }
 
             // Go through all pageables and map the current page table
+            Threading::RWSpinLockReadLocker pageablesLock(m_PageablesLock);
             for (PageableVector::iterator it = m_Pageables.begin(); it != m_Pageables.end(); ++it) {
                 // Map the page table within the current pageable
                 Machine::MapPageTableToDirectory((*it)->m_Directory, table, KERNEL_SPACE_BOUNDARY / PAGE_TABLE_SIZE + i / PAGE_TABLE_CAPACITY);
@@ -373,9 +397,9 @@ void Pager::KernelSize(size_t p_Size)
 void Pager::PrepareNextKernelSize()
 {
     assert(this != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock(m_SpinLock);
-    Threading::SpinLockLocker kernelLock(m_KernelSpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RecursiveSpinLockLocker lock(m_SpinLock);
+    Threading::RecursiveSpinLockLocker kernelLock(m_KernelSpinLock);
 
     // If  we  already  had  the  spinlock  it  means  that we're being called
     // following a memory allocation within the pager, so just bail out.
@@ -391,7 +415,7 @@ void Pager::PrepareNextKernelSize()
             // Retrieve  an available frame.  We  must  unlock the kernel lock
             // while doing so in order for memory allocations to be safe.
             {
-                Threading::SpinLockUnlocker kernelUnlock(m_KernelSpinLock);
+                Threading::RecursiveSpinLockUnlocker kernelUnlock(m_KernelSpinLock);
                 frame = GetAvailableFrame();
             }
 
@@ -409,7 +433,7 @@ void Pager::PrepareNextKernelSize()
 
             // Add it to the deque of not recently used frames
             {
-                Threading::SpinLockUnlocker kernelUnlock(m_KernelSpinLock);
+                Threading::RecursiveSpinLockUnlocker kernelUnlock(m_KernelSpinLock);
                 m_NotRecent.push_front(frame);
             }
         }
@@ -498,7 +522,8 @@ void Pager::MakeFrameAvailable(size_t p_Frame)
 Mapable::Mapable(size_t p_Size)
 :   m_Tables(),
     m_Pages(),
-    m_Locked(false)
+    m_Locked(false),
+    m_SpinLock("Mapable")
 {
     assert(this != 0);
     assert(p_Size != 0);
@@ -587,9 +612,9 @@ size_t Pageable::Map(MapableSP p_spMapable, size_t p_Address)
     assert(this != 0);
     assert(p_spMapable != 0);
     assert(p_Address % PAGE_TABLE_SIZE == 0 || p_Address == 0xFFFFFFFF);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spMapable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RWSpinLockWriteLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
 
     // Allocate space for the mapable within the address space if needed
     if (p_Address == 0xFFFFFFFF) {
@@ -621,12 +646,31 @@ void Pageable::Unmap(MapableSP p_spMapable)
 {
     assert(this != 0);
     assert(p_spMapable != 0);
-    Threading::InterruptLock intlock;
-    Threading::SpinLockLocker lock1(m_SpinLock);
-    Threading::SpinLockLocker lock2(p_spMapable->m_SpinLock);
+    Threading::PreemptLock prelock;
+    Threading::RWSpinLockWriteLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
+
+    // Look for the mapable within the pageable
+    MapableMap::iterator it = m_Mapables.begin();
+    while (it != m_Mapables.end() && it->second != p_spMapable) ++it;
+    assert(it != m_Mapables.end());
+    size_t address = it->first - p_spMapable->Size();
+
+    // Unmap all the page tables of the mapable from our directory
+    for (Mapable::TableVector::iterator table = p_spMapable->m_Tables.begin(); table != p_spMapable->m_Tables.end(); ++table) {
+        // Unmap the current page table from the pageable's page directory
+        Machine::UnmapPageTableFromDirectory(m_Directory, address / PAGE_TABLE_SIZE + (table - p_spMapable->m_Tables.begin()));
+    }
 
-    // TODO: Implement!
-    assert(false);
+    // Flush the pages of the mapable from the TLB, in case our directory is
+    // the current one.
+    for (size_t page = 0; page < p_spMapable->m_Pages.size(); ++page) {
+        Machine::InvalidateTLBEntry(address / PAGE_TABLE_SIZE + page / PAGE_TABLE_CAPACITY, page % PAGE_TABLE_CAPACITY);
+    }
+
+    // Give back the address space used by the mapable
+    m_Blocks.Deallocate(address, Utilities::RoundUp(p_spMapable->Size(), PAGE_TABLE_SIZE));
+    m_Mapables.erase(it);
 }
 
 } // namespace Paging
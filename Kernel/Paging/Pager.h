@@ -6,7 +6,8 @@
 #define PAGING_PAGER_H
 
 #include "Utilities/Blocks.h"
-#include "Threading/SpinLock.h"
+#include "Threading/RecursiveSpinLock.h"
+#include "Threading/RWSpinLock.h"
 
 namespace Nutshell {
 namespace Paging {
@@ -32,7 +33,7 @@ class Mapable
     TableVector                 m_Tables;       // Vector containing the page tables for the mapable.
     PageVector                  m_Pages;        // Vector containing the pages structures for the mapable.
     bool                        m_Locked;       // Whether the mapable is locked in memory.
-    mutable Threading::SpinLock m_SpinLock;     // The lock that protects the mapable.
+    mutable Threading::RecursiveSpinLock m_SpinLock; // The lock that protects the mapable.
 
     friend class Pager;
     friend class Pageable;
@@ -60,7 +61,7 @@ class Pageable
     size_t                      m_Directory;    // The page directory for the pageable.
     Utilities::Blocks           m_Blocks;       // The object used to manage the address space.
     MapableMap                  m_Mapables;     // The mapables mapped within the pageable.
-    mutable Threading::SpinLock m_SpinLock;     // The lock that protects the pageable.
+    mutable Threading::RWSpinLock m_SpinLock;   // The lock that protects the pageable, read by page faults.
 
     friend class Pager;
 
@@ -103,19 +104,20 @@ class Pager : boost::noncopyable
     typedef std::vector<size_t>     TableVector;
 
     PageableVector              m_Pageables;        // Vector that contains all the pageables.          
+    mutable Threading::RWSpinLock m_PageablesLock;  // Spin lock that protects the pageables vector, mostly read.
     MapableVector               m_Globals;          // Vector that contains the global mapables.
 
     FrameVector                 m_Frames;           // Vector that contains the frames.
     FrameIndexDeque             m_Recent;           // Deque of recently accessed frames.
     FrameIndexDeque             m_NotRecent;        // Deque of less recently accessed frames.
 
-    mutable Threading::SpinLock m_SpinLock;         // The spin lock that protects the pager.
+    mutable Threading::RecursiveSpinLock m_SpinLock; // The spin lock that protects the pager.
 
     size_t                      m_KernelSize;       // The total size of the kernel memory, in pages.
     TableVector                 m_KernelTables;     // Vector that contains the kernel page tables.
     FrameIndexVector            m_KernelFrames;     // Vector that contains the frames reserved for kernel use.
 
-    mutable Threading::SpinLock m_KernelSpinLock;   // Spin lock to protect the kernel members only.
+    mutable Threading::RecursiveSpinLock m_KernelSpinLock; // Spin lock to protect the kernel members only.
 
 public:
 
@@ -0,0 +1,484 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Machine.h"
+#include "Threading/Scheduler.h"
+#include <ucontext.h>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+namespace Nutshell {
+namespace Simulator {
+
+namespace {
+
+    //**************************************************************************
+    // Simulated machine state.
+    //**************************************************************************
+
+    // The task descriptor of the code that runs before the first switch, and
+    // to which the simulation returns when it stops. Descriptor 0 is never
+    // handed out.
+    const int           BOOT_TASK           = 1;
+
+    // The size of the host stack of a task (in bytes)
+    const size_t        STACK_SIZE          = 64 * 1024;
+
+    // The timestamp of an event that never happens
+    const unsigned long long NEVER          = ~0ULL;
+
+    // The addresses reported to the scheduler for the code interrupted by the
+    // clock: threads run user code, while the idle thread waits in the kernel.
+    void* const         USER_EIP            = 0;
+    void* const         KERNEL_EIP          = reinterpret_cast<void*>(KERNEL_SPACE_BOUNDARY);
+
+    //**************************************************************************
+    // This holds the state of a simulated task.
+    struct Task {
+        ucontext_t      m_Context;              // The host context of the task while it isn't running.
+        void*           m_pStack;               // The host stack of the task.
+        bool            m_Started;              // Whether the task has run yet.
+        bool            m_Available;            // Whether the descriptor is free.
+        unsigned        m_Interrupts;           // The number of interrupt handlers the task is in.
+        void            (* m_pEntry)(void*);    // The entry point of the task.
+        void*           m_pArgument;            // The argument passed to the entry point.
+    };
+
+    typedef std::vector<Task*> TaskVector;
+
+    TaskVector          g_Tasks;                        // The tasks, indexed by descriptor.
+    std::vector<int>    g_AvailableTasks;               // The descriptors that may be reused.
+    int                 g_CurrentTask       = BOOT_TASK;// The running task.
+    bool                g_InterruptsEnabled = false;    // The interrupt flag.
+    unsigned            g_Interrupts        = 0;        // The number of interrupt handlers the running task is in.
+    unsigned long long  g_Timestamp         = 0;        // The simulated timestamp counter.
+    unsigned long long  g_ClockDeadline     = NEVER;    // The timestamp at which the clock interrupt is raised.
+    unsigned long long  g_StopTime          = NEVER;    // The timestamp at which the simulation stops.
+    unsigned long long  g_Switches          = 0;        // The number of task switches.
+    unsigned long long  g_InterruptSwitches = 0;        // The number of those switches made by interrupt handlers.
+    unsigned long long  g_ClockInterrupts   = 0;        // The number of clock interrupts delivered.
+    double              g_HostSwitchTime    = 0;        // The host time spent switching between tasks, in seconds.
+    double              g_HostSwitchStart   = 0;        // The host time at which the last switch started.
+
+    //**************************************************************************
+    // Host entry point of the tasks.
+    //**************************************************************************
+    void TaskEntry()
+    {
+        // New tasks start with interrupts enabled, just like on the real
+        // machine.
+        Task* pTask = g_Tasks[g_CurrentTask];
+        g_HostSwitchTime += ReadHostTime() - g_HostSwitchStart;
+        g_InterruptsEnabled = true;
+        pTask->m_pEntry(pTask->m_pArgument);
+
+        PANIC("Task returned from its entry point!");
+    }
+
+    //**************************************************************************
+    // Switches the host to another task.
+    //
+    // Parameters:
+    //  p_Task - The descriptor of the task to run.
+    //**************************************************************************
+    void Resume(int p_Task)
+    {
+        Task* pCurrent  = g_Tasks[g_CurrentTask];
+        Task* pNext     = g_Tasks[p_Task];
+
+        // Give the task a host stack the first time it runs
+        if (!pNext->m_Started) {
+            if (pNext->m_pStack == 0) pNext->m_pStack = ::malloc(STACK_SIZE);
+            VERIFY(pNext->m_pStack != 0);
+            ::getcontext(&pNext->m_Context);
+            pNext->m_Context.uc_stack.ss_sp     = pNext->m_pStack;
+            pNext->m_Context.uc_stack.ss_size   = STACK_SIZE;
+            pNext->m_Context.uc_link            = 0;
+            ::makecontext(&pNext->m_Context, &TaskEntry, 0);
+            pNext->m_Started = true;
+        }
+
+        // The interrupt nesting belongs to the task, like its kernel stack
+        pCurrent->m_Interrupts = g_Interrupts;
+        g_Interrupts = pNext->m_Interrupts;
+        g_CurrentTask = p_Task;
+        g_HostSwitchStart = ReadHostTime();
+        ::swapcontext(&pCurrent->m_Context, &pNext->m_Context);
+        g_HostSwitchTime += ReadHostTime() - g_HostSwitchStart;
+    }
+
+    //**************************************************************************
+    // Returns to the boot task once the simulation is over. The current task
+    // carries on from here if the simulation is resumed.
+    //**************************************************************************
+    void Stop()
+    {
+        bool enabled = g_InterruptsEnabled;
+        g_InterruptsEnabled = false;
+        Resume(BOOT_TASK);
+        g_InterruptsEnabled = enabled;
+    }
+
+    //**************************************************************************
+    // Delivers the clock interrupt, the way the interrupt stubs of the real
+    // machine do.
+    //
+    // Parameters:
+    //  p_pEIP - The address of the interrupted code.
+    //**************************************************************************
+    void DeliverClock(void* p_pEIP)
+    {
+        assert(g_InterruptsEnabled);
+
+        // The clock interrupt is one-shot
+        g_ClockDeadline = NEVER;
+        ++g_ClockInterrupts;
+
+        g_InterruptsEnabled = false;
+        ++g_Interrupts;
+        if (g_pScheduler != 0) {
+            g_pScheduler->EnterInterrupt(p_pEIP);
+            g_pScheduler->Clock();
+            g_pScheduler->LeaveInterrupt();
+        }
+        --g_Interrupts;
+        g_InterruptsEnabled = true;
+    }
+
+} // namespace
+
+//******************************************************************************
+// Requests a clock interrupt after a number of ticks.
+//
+// Parameters:
+//  p_Ticks - The number of ticks before the interrupt.
+//
+// Returns:
+//  The number of ticks before the interrupt, which is never cut short here.
+//******************************************************************************
+unsigned ArmClock(unsigned p_Ticks)
+{
+    assert(p_Ticks > 0);
+
+    g_ClockDeadline = (GetClockTicks() + p_Ticks) * CYCLES_PER_TICK;
+
+    return p_Ticks;
+}
+
+//******************************************************************************
+// Cancels the clock interrupt previously armed, if any.
+//******************************************************************************
+void DisarmClock()
+{
+    g_ClockDeadline = NEVER;
+}
+
+//******************************************************************************
+// Returns the number of clock ticks elapsed since the simulation was reset.
+//******************************************************************************
+unsigned long long GetClockTicks()
+{
+    return g_Timestamp / CYCLES_PER_TICK;
+}
+
+//******************************************************************************
+// Returns the number of processor cycles per clock tick.
+//******************************************************************************
+unsigned long long GetCyclesPerClockTick()
+{
+    return CYCLES_PER_TICK;
+}
+
+//******************************************************************************
+// Returns the simulated timestamp counter. It only moves forward when tasks
+// execute or wait for interrupts.
+//******************************************************************************
+unsigned long long ReadTimestampCounter()
+{
+    return g_Timestamp;
+}
+
+//******************************************************************************
+// Enables interrupts.
+//******************************************************************************
+void EnableInterrupts()
+{
+    g_InterruptsEnabled = true;
+}
+
+//******************************************************************************
+// Disables interrupts.
+//
+// Returns:
+//  Whether interrupts were enabled.
+//******************************************************************************
+bool DisableInterrupts()
+{
+    bool enabled = g_InterruptsEnabled;
+    g_InterruptsEnabled = false;
+
+    return enabled;
+}
+
+//******************************************************************************
+// Returns whether interrupts are enabled.
+//******************************************************************************
+bool InterruptsEnabled()
+{
+    return g_InterruptsEnabled;
+}
+
+//******************************************************************************
+// Enables interrupts and halts until the next one. Nothing else happens on
+// the simulated machine meanwhile, so time jumps to the clock interrupt.
+//******************************************************************************
+void WaitForInterrupt()
+{
+    assert(!g_InterruptsEnabled);
+
+    g_InterruptsEnabled = true;
+    if (g_ClockDeadline >= g_StopTime) {
+        if (g_StopTime == NEVER) PANIC("Simulated machine halted forever!");
+        g_Timestamp = std::max(g_Timestamp, g_StopTime);
+        Stop();
+    } else {
+        g_Timestamp = std::max(g_Timestamp, g_ClockDeadline);
+        DeliverClock(KERNEL_EIP);
+    }
+}
+
+//******************************************************************************
+// Allocates a task descriptor.
+//
+// Parameters:
+//  p_Directory - The page directory of the task, which is ignored.
+//  p_Stack     - The top of the kernel stack of the task, which is ignored
+//                since tasks run on host stacks.
+//  p_pEntry    - The entry point of the task.
+//  p_pArgument - The argument passed to the entry point.
+//
+// Returns:
+//  The task descriptor.
+//******************************************************************************
+int AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*), void* p_pArgument)
+{
+    assert(p_pEntry != 0);
+    bool enabled = DisableInterrupts();
+
+    // Reuse a released descriptor if possible
+    int task;
+    if (!g_AvailableTasks.empty()) {
+        task = g_AvailableTasks.back();
+        g_AvailableTasks.pop_back();
+    } else {
+        task = g_Tasks.size();
+        g_Tasks.push_back(new Task());
+    }
+
+    Task* pTask = g_Tasks[task];
+    pTask->m_Started    = false;
+    pTask->m_Available  = false;
+    pTask->m_Interrupts = 0;
+    pTask->m_pEntry     = p_pEntry;
+    pTask->m_pArgument  = p_pArgument;
+
+    if (enabled) EnableInterrupts();
+
+    return task;
+}
+
+//******************************************************************************
+// Releases a task descriptor. Its host stack is kept for the next task that
+// gets the descriptor.
+//
+// Parameters:
+//  p_Task - The task descriptor to release.
+//******************************************************************************
+void ReleaseTaskDescriptor(int p_Task)
+{
+    assert(p_Task > BOOT_TASK && p_Task < static_cast<int>(g_Tasks.size()));
+    assert(p_Task != g_CurrentTask);
+    assert(!g_Tasks[p_Task]->m_Available);
+    bool enabled = DisableInterrupts();
+
+    g_Tasks[p_Task]->m_Available = true;
+    g_AvailableTasks.push_back(p_Task);
+
+    if (enabled) EnableInterrupts();
+}
+
+//******************************************************************************
+// Returns the descriptor of the running task.
+//******************************************************************************
+int GetCurrentTaskDescriptor()
+{
+    return g_CurrentTask;
+}
+
+//******************************************************************************
+// Switches to another task. Interrupts must be disabled.
+//
+// Parameters:
+//  p_Task - The descriptor of the task to switch to.
+//******************************************************************************
+void SwitchToTaskDescriptor(int p_Task)
+{
+    assert(!g_InterruptsEnabled);
+    assert(p_Task > BOOT_TASK && p_Task < static_cast<int>(g_Tasks.size()));
+    assert(p_Task != g_CurrentTask);
+    assert(!g_Tasks[p_Task]->m_Available);
+
+    ++g_Switches;
+    if (g_Interrupts > 0) ++g_InterruptSwitches;
+
+    Resume(p_Task);
+}
+
+//******************************************************************************
+// Halts the simulation after an unrecoverable error.
+//
+// Parameters:
+//  p_pMessage  - The error message.
+//  p_pFile     - The file in which the error happened.
+//  p_Line      - The line at which the error happened.
+//******************************************************************************
+void Panic(const char* p_pMessage, const char* p_pFile, int p_Line)
+{
+    std::fprintf(stderr, "Panic: %s (%s:%d)\n", p_pMessage, p_pFile, p_Line);
+    std::abort();
+}
+
+//******************************************************************************
+// Writes a character to the standard output, which stands for the serial port.
+//
+// Parameters:
+//  p_Character - The character to write.
+//******************************************************************************
+void WriteSerial(char p_Character)
+{
+    std::putchar(p_Character);
+}
+
+//******************************************************************************
+// Puts the simulated machine back in its initial state, before the scheduler
+// is created. The tasks of a previous simulation are thrown away along with
+// their stacks. Must be called from the boot task.
+//******************************************************************************
+void Reset()
+{
+    assert(g_CurrentTask == BOOT_TASK);
+
+    for (TaskVector::iterator it = g_Tasks.begin(); it != g_Tasks.end(); ++it) {
+        if (*it == 0) continue;
+        ::free((*it)->m_pStack);
+        delete *it;
+    }
+    g_Tasks.assign(BOOT_TASK + 1, 0);
+    g_Tasks[BOOT_TASK] = new Task();
+    g_Tasks[BOOT_TASK]->m_Started = true;
+    g_AvailableTasks.clear();
+
+    g_InterruptsEnabled = false;
+    g_Interrupts        = 0;
+    g_Timestamp         = 0;
+    g_ClockDeadline     = NEVER;
+    g_StopTime          = NEVER;
+    g_Switches          = 0;
+    g_InterruptSwitches = 0;
+    g_ClockInterrupts   = 0;
+    g_HostSwitchTime    = 0;
+}
+
+//******************************************************************************
+// Runs the scheduler for some simulated time, then returns to the boot task.
+// It may be called again to carry on from where the simulation stopped.
+//
+// Parameters:
+//  p_Ticks - The number of clock ticks to simulate.
+//******************************************************************************
+void Simulate(unsigned long long p_Ticks)
+{
+    assert(g_CurrentTask == BOOT_TASK);
+    assert(g_pScheduler != 0);
+
+    g_StopTime = g_Timestamp + p_Ticks * CYCLES_PER_TICK;
+    g_pScheduler->Switch();
+}
+
+//******************************************************************************
+// Simulates the current task running code for some time, during which the
+// clock interrupt may preempt it. Interrupts must be enabled.
+//
+// Parameters:
+//  p_Cycles - The number of processor cycles the code takes.
+//******************************************************************************
+void Execute(unsigned long long p_Cycles)
+{
+    assert(g_InterruptsEnabled);
+
+    while (p_Cycles > 0) {
+        // Run until the next event, or until the code is done
+        unsigned long long event = std::min(g_ClockDeadline, g_StopTime);
+        unsigned long long cycles = event > g_Timestamp ? std::min(p_Cycles, event - g_Timestamp) : 0;
+        g_Timestamp += cycles;
+        p_Cycles -= cycles;
+
+        if (g_Timestamp >= g_StopTime) {
+            Stop();
+        } else if (g_Timestamp >= g_ClockDeadline) {
+            DeliverClock(USER_EIP);
+        }
+    }
+}
+
+//******************************************************************************
+// Returns the number of task switches since the last reset.
+//******************************************************************************
+unsigned long long GetSwitchCount()
+{
+    return g_Switches;
+}
+
+//******************************************************************************
+// Returns the number of task switches made by interrupt handlers since the
+// last reset.
+//******************************************************************************
+unsigned long long GetInterruptSwitchCount()
+{
+    return g_InterruptSwitches;
+}
+
+//******************************************************************************
+// Returns the number of clock interrupts delivered since the last reset.
+//******************************************************************************
+unsigned long long GetClockInterruptCount()
+{
+    return g_ClockInterrupts;
+}
+
+//******************************************************************************
+// Returns the time elapsed on the host, in seconds.
+//******************************************************************************
+double ReadHostTime()
+{
+    timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+//******************************************************************************
+// Returns the host time spent switching between tasks since the last reset,
+// in seconds. It has nothing to do with the kernel, and grows with the number
+// of tasks since their host stacks fall out of the caches.
+//******************************************************************************
+double GetHostSwitchTime()
+{
+    return g_HostSwitchTime;
+}
+
+} // namespace Simulator
+} // namespace Nutshell
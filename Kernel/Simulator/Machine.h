@@ -0,0 +1,72 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef SIMULATOR_MACHINE_H
+#define SIMULATOR_MACHINE_H
+
+namespace Nutshell {
+namespace Simulator {
+
+//******************************************************************************
+// Simulated machine constants.
+//******************************************************************************
+
+// The number of clock ticks per second
+const unsigned              CLOCK_FREQUENCY     = 256;
+
+// The number of processor cycles per clock tick
+const unsigned long long    CYCLES_PER_TICK     = 1000000;
+
+//******************************************************************************
+// Clock management functions.
+//******************************************************************************
+
+unsigned            ArmClock(unsigned p_Ticks);
+void                DisarmClock();
+unsigned long long  GetClockTicks();
+unsigned long long  GetCyclesPerClockTick();
+unsigned long long  ReadTimestampCounter();
+
+//******************************************************************************
+// Interrupt management functions.
+//******************************************************************************
+
+void    EnableInterrupts();
+bool    DisableInterrupts();
+bool    InterruptsEnabled();
+void    WaitForInterrupt();
+
+//******************************************************************************
+// Task management functions.
+//******************************************************************************
+
+int     AllocateTaskDescriptor(size_t p_Directory, size_t p_Stack, void (* p_pEntry)(void*), void* p_pArgument);
+void    ReleaseTaskDescriptor(int p_Task);
+int     GetCurrentTaskDescriptor();
+void    SwitchToTaskDescriptor(int p_Task);
+
+//******************************************************************************
+// Output functions.
+//******************************************************************************
+
+void    Panic(const char* p_pMessage, const char* p_pFile, int p_Line);
+void    WriteSerial(char p_Character);
+
+//******************************************************************************
+// Simulation control functions.
+//******************************************************************************
+
+void                Reset();
+void                Simulate(unsigned long long p_Ticks);
+void                Execute(unsigned long long p_Cycles);
+unsigned long long  GetSwitchCount();
+unsigned long long  GetInterruptSwitchCount();
+unsigned long long  GetClockInterruptCount();
+double              ReadHostTime();
+double              GetHostSwitchTime();
+
+} // namespace Simulator
+} // namespace Nutshell
+
+#endif // !SIMULATOR_MACHINE_H
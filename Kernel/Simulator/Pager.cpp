@@ -0,0 +1,205 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+// This file stands in for Paging/Pager.cpp in the simulator. The simulated
+// machine has no memory management unit, so mapables only get a place in
+// the address space of their pageables, and locking them does nothing.
+
+#include "Global.h"
+#include "Machine.h"
+#include "Paging/Pager.h"
+#include "Threading/PreemptLock.h"
+
+namespace Nutshell {
+namespace Paging {
+
+namespace {
+
+    // The size of a page
+    const size_t    PAGE_SIZE       = 4096;
+
+    // The next page directory handed out to a pageable
+    size_t          g_NextDirectory = 1;
+
+} // namespace
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Pager class.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+Pager::Pager()
+:   m_SpinLock("Pager"),
+    m_KernelSize(0),
+    m_KernelSpinLock("PagerKernel")
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Pager::~Pager()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Locks a mapable into memory.
+//
+// Parameters:
+//  p_spMapable - The mapable to lock into memory.
+//  p_Address   - Unused.
+//******************************************************************************
+void Pager::LockMapable(MapableSP p_spMapable, size_t p_Address)
+{
+    assert(this != 0);
+    assert(p_spMapable != 0);
+    assert(!p_spMapable->m_Locked);
+
+    p_spMapable->m_Locked = true;
+}
+
+//******************************************************************************
+// Unlocks a mapable from memory.
+//
+// Parameters:
+//  p_spMapable - The mapable to unlock from memory.
+//******************************************************************************
+void Pager::UnlockMapable(MapableSP p_spMapable)
+{
+    assert(this != 0);
+    assert(p_spMapable != 0);
+    assert(p_spMapable->m_Locked);
+
+    p_spMapable->m_Locked = false;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Pager::Mapable class.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_Size   - The size of the mapable, in bytes.
+//******************************************************************************
+Mapable::Mapable(size_t p_Size)
+:   m_Tables(),
+    m_Pages(),
+    m_Locked(false),
+    m_SpinLock("Mapable")
+{
+    assert(this != 0);
+    assert(p_Size != 0);
+    assert(p_Size % PAGE_SIZE == 0);
+
+    m_Pages.resize(p_Size / PAGE_SIZE);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Mapable::~Mapable()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Returns the size of the mapable, in bytes.
+//******************************************************************************
+size_t Mapable::Size() const
+{
+    assert(this != 0);
+
+    return m_Pages.size() * PAGE_SIZE;
+}
+
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Pager::Pageable class.
+//=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+Pageable::Pageable()
+:   m_Directory(g_NextDirectory++),
+    m_Blocks(),
+    m_Mapables()
+{
+    assert(this != 0);
+
+    // Initialize the free blocks to all the user address space
+    m_Blocks.Deallocate(0, KERNEL_SPACE_BOUNDARY);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Pageable::~Pageable()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Maps a mapable within the pageable. Mapables are only aligned on pages, so
+// that the address space holds as many kernel stacks as possible.
+//
+// Parameters:
+//  p_spMapable - The mapable to map within the pageable.
+//  p_Address   - The virtual address at which to map the mapable.
+//
+// Returns:
+//  The address at which the mapable was mapped.
+//******************************************************************************
+size_t Pageable::Map(MapableSP p_spMapable, size_t p_Address)
+{
+    assert(this != 0);
+    assert(p_spMapable != 0);
+    Threading::PreemptLock prelock;
+    Threading::RWSpinLockWriteLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
+
+    // Allocate space for the mapable within the address space if needed
+    if (p_Address == 0xFFFFFFFF) {
+        p_Address = m_Blocks.Allocate(p_spMapable->Size());
+    } else {
+        m_Blocks.ForceAllocate(p_Address, p_spMapable->Size());
+    }
+
+    // Add the mapable to the map
+    m_Mapables.insert(std::make_pair(p_Address + p_spMapable->Size(), p_spMapable));
+
+    return p_Address;
+}
+
+//******************************************************************************
+// Unmaps a mapable from the pageable.
+//
+// Parameters:
+//  p_spMapable - The mapable to unmap from the pageable.
+//******************************************************************************
+void Pageable::Unmap(MapableSP p_spMapable)
+{
+    assert(this != 0);
+    assert(p_spMapable != 0);
+    Threading::PreemptLock prelock;
+    Threading::RWSpinLockWriteLocker lock1(m_SpinLock);
+    Threading::RecursiveSpinLockLocker lock2(p_spMapable->m_SpinLock);
+
+    // Look for the mapable within the pageable
+    MapableMap::iterator it = m_Mapables.begin();
+    while (it != m_Mapables.end() && it->second != p_spMapable) ++it;
+    assert(it != m_Mapables.end());
+
+    // Give back the address space used by the mapable
+    m_Blocks.Deallocate(it->first - p_spMapable->Size(), p_spMapable->Size());
+    m_Mapables.erase(it);
+}
+
+} // namespace Paging
+} // namespace Nutshell
@@ -0,0 +1,65 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+// The simulator runs the scheduler on the host, over a simulated machine, so
+// that its decisions can be measured on workloads without booting the kernel.
+
+#include "Global.h"
+#include "Simulator/Workloads.h"
+#include <cstdio>
+#include <cstring>
+
+namespace Nutshell {
+
+// From "Global.h"
+Core::Console*          g_pConsole = 0;
+Core::Debugger*         g_pDebugger = 0;
+Paging::Pager*          g_pPager = 0;
+Threading::Scheduler*   g_pScheduler = 0;
+
+} // namespace Nutshell
+
+using namespace Nutshell::Simulator;
+
+//******************************************************************************
+// Runs the workloads named on the command line, or all of them.
+//
+// Returns:
+//  0 if the results of all the workloads are sane, 1 otherwise.
+//******************************************************************************
+int main(int p_Argc, char* p_ppArgv[])
+{
+    bool sane = true;
+    int ran = 0;
+
+    // Keep the results that came before an assertion failure
+    std::setvbuf(stdout, 0, _IOLBF, 0);
+
+    for (const Workload* pWorkload = g_Workloads; pWorkload->m_pName != 0; ++pWorkload) {
+        // Check if the workload was requested
+        bool requested = p_Argc == 1;
+        for (int i = 1; i < p_Argc && !requested; ++i) {
+            requested = std::strcmp(p_ppArgv[i], pWorkload->m_pName) == 0;
+        }
+        if (!requested) continue;
+
+        std::printf("%s: %s\n", pWorkload->m_pName, pWorkload->m_pDescription);
+        if (!pWorkload->m_pRun()) {
+            std::printf("  FAILED\n");
+            sane = false;
+        }
+        ++ran;
+    }
+
+    // Let unknown workload names fail rather than silently run nothing
+    if (ran == 0) {
+        std::printf("Usage: %s [workload...]\n", p_ppArgv[0]);
+        for (const Workload* pWorkload = g_Workloads; pWorkload->m_pName != 0; ++pWorkload) {
+            std::printf("  %-12s %s\n", pWorkload->m_pName, pWorkload->m_pDescription);
+        }
+        return 1;
+    }
+
+    return sane ? 0 : 1;
+}
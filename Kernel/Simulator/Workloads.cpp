@@ -0,0 +1,1264 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Machine.h"
+#include "Paging/Pager.h"
+#include "Threading/Scheduler.h"
+#include "Threading/Process.h"
+#include "Threading/Thread.h"
+#include "Threading/Mutex.h"
+#include "Threading/ConditionVariable.h"
+#include "Threading/RunQueue.h"
+#include "Simulator/Workloads.h"
+#include <cstdio>
+#include <cmath>
+
+namespace Nutshell {
+namespace Simulator {
+
+using Threading::Process;
+using Threading::ProcessSP;
+using Threading::Thread;
+using Threading::ThreadSP;
+using Threading::Mutex;
+using Threading::ConditionVariable;
+using Threading::Schedulable;
+using Threading::LatencyTracer;
+
+namespace {
+
+    //**************************************************************************
+    // Workload settings.
+    //**************************************************************************
+
+    // The simulated time each workload runs for, in clock ticks
+    const unsigned long long    RUN_TICKS           = 10 * CLOCK_FREQUENCY;
+
+    // The clock ticks during which threads that haven't run yet are owed as
+    // much as those that wake up, so latencies aren't measured.
+    const unsigned long long    WARMUP_TICKS        = CLOCK_FREQUENCY / 8;
+
+    // The number of threads of each kind
+    const unsigned              HOG_COUNT           = 8;
+    const unsigned              SWEEP_COUNTS[]      = {10, 100, 1000, 10000};
+    const unsigned              SLEEPER_COUNT       = 4;
+
+    // The periods at which the sleepers wake up, in clock ticks
+    const unsigned              SLEEPER_PERIODS[SLEEPER_COUNT] = {2, 3, 5, 7};
+
+    // The priorities of the sleepers of the latencies workload, so that each
+    // class but the real-time one gets latencies.
+    const Thread::Priorities    SLEEPER_PRIORITIES[SLEEPER_COUNT] = {
+        Thread::PRIORITY_HIGH,
+        Thread::PRIORITY_NORMAL,
+        Thread::PRIORITY_LOW,
+        Thread::PRIORITY_VERY_LOW
+    };
+    const unsigned              CONVOY_COUNTS[]     = {2, 4, 8, 16};
+
+    // The processor cycles a hog runs between two looks at the clock
+    const unsigned long long    HOG_CYCLES          = 100000;
+
+    // The processor cycles a sleeper runs each time it wakes up
+    const unsigned long long    SLEEPER_CYCLES      = 50000;
+
+    // The processor cycles a convoy thread holds the mutex, and runs between
+    // two acquisitions.
+    const unsigned long long    HOLD_CYCLES         = 20000;
+    const unsigned long long    THINK_CYCLES        = 5000;
+
+    // The number of acquisitions after which a convoy thread waits for the
+    // next clock tick while holding the mutex, as if it waited for a device.
+    const unsigned              IO_INTERVAL         = 16;
+
+    // The processor cycles the low priority thread of the inversion workload
+    // holds the mutex, in chunks of HOG_CYCLES, and the period at which the
+    // realtime thread wants it, in clock ticks.
+    const unsigned long long    INVERSION_HOLD_CYCLES = 4 * CYCLES_PER_TICK;
+    const unsigned              INVERSION_PERIOD    = 8;
+
+    // The number of consumers of the mailbox workload, the period at which its
+    // producer posts a burst of messages, in clock ticks, and the number of
+    // messages of a burst, fewer than the consumers so that each signal finds
+    // a waiter. Consumers stop waiting after a timeout a little longer than
+    // the period: the one left without a message times out between two
+    // bursts, and waits again in time for the next one.
+    const unsigned              MAILBOX_CONSUMERS   = 4;
+    const unsigned              MAILBOX_PERIOD      = 3;
+    const unsigned              MAILBOX_BURST       = 3;
+    const unsigned              MAILBOX_TIMEOUT     = MAILBOX_PERIOD + 1;
+    const unsigned              MAILBOX_CAPACITY    = 64;
+
+    // The number of threads waiting for broadcasts, and the period at which
+    // the broadcaster sleeps between two broadcasts, in clock ticks. It holds
+    // the mutex until the next tick after each broadcast.
+    const unsigned              BROADCAST_WAITERS   = 8;
+    const unsigned              BROADCAST_PERIOD    = 2;
+
+    // The number of timers of the timers workload, how long it runs, in clock
+    // ticks, and the largest number of bits of their delays. Delays of up to
+    // 2^21 ticks reach the top level of the timer wheel, and the run is long
+    // enough for timers to cascade down from there.
+    const unsigned              ALARM_COUNT         = 64;
+    const unsigned long long    ALARM_TICKS         = 1 << 23;
+    const unsigned              ALARM_DELAY_BITS    = 21;
+
+    // The number of expiries after which the timers workload stops a timer
+    // and starts it again.
+    const unsigned              ALARM_MOVE_INTERVAL = 4;
+
+    // The reservation of the real-time hog of the reservations workload, in
+    // clock ticks, which it drops halfway through the run.
+    const unsigned              RESERVED_BUDGET     = 2;
+    const unsigned              RESERVED_PERIOD     = 8;
+
+    // How many run queue comparisons a decision may take per level of the
+    // heap of ready threads. The ready queues are heaps, so a decision costs
+    // a few comparisons per level: it grows with the logarithm of the number
+    // of ready threads. This catches costs that grow any faster. Comparisons
+    // are counted rather than host time, so the check doesn't depend on the
+    // host.
+    const double                MAXIMUM_SWEEP_COMPARISONS = 4.0;
+
+    // How far the processor share of a hog may be from what its weight
+    // entitles it to, relatively.
+    const double                MAXIMUM_SHARE_ERROR = 0.02;
+
+    // The smallest fairness index of threads that should get the same share
+    const double                MINIMUM_FAIRNESS    = 0.99;
+
+    // The largest wake latency of a sleeper, in clock ticks
+    const double                MAXIMUM_LATENCY     = 1.0;
+
+    // How long the realtime thread of the inversion workload may wait for the
+    // mutex, relative to how long the low priority thread holds it: no longer
+    // than it takes to run the whole hold through.
+    const double                MAXIMUM_INVERSION   = 1.0;
+
+    //**************************************************************************
+    // This holds what a sleeper measured.
+    struct Sleeper {
+        unsigned            m_Period;           // The period at which the sleeper wakes up, in clock ticks.
+        unsigned long long  m_Wakeups;          // The number of times it woke up.
+        unsigned long long  m_TotalLatency;     // The sum of its wake latencies, in processor cycles.
+        unsigned long long  m_MaxLatency;       // The largest of its wake latencies, in processor cycles.
+    };
+
+    //**************************************************************************
+    // This holds a sleeper of the latencies workload, which records its wake
+    // latencies the way the scheduler should.
+    struct TracedSleeper {
+        unsigned            m_Period;           // The period at which the sleeper wakes up, in clock ticks.
+        LatencyTracer*      m_pTracer;          // The tracer that receives the latencies of all the sleepers.
+    };
+
+    //**************************************************************************
+    // This holds the state shared by the threads of a mutex convoy.
+    struct Convoy {
+        Mutex               m_Mutex;            // The mutex the threads fight for.
+        unsigned long long  m_Acquisitions;     // The number of times the mutex was acquired.
+
+        Convoy(Mutex::Modes p_Mode) : m_Mutex(p_Mode, "Convoy"), m_Acquisitions(0) {}
+    };
+
+    //**************************************************************************
+    // This holds the messages of the mailbox workload, and what its threads
+    // measured.
+    struct Mailbox {
+        Mutex               m_Mutex;            // The mutex that protects the messages.
+        ConditionVariable   m_Condition;        // The condition variable signaled for each message.
+        unsigned long long  m_Messages[MAILBOX_CAPACITY]; // The timestamps at which the messages were posted.
+        unsigned            m_First;            // The index of the oldest message.
+        unsigned            m_Count;            // The number of messages.
+        unsigned long long  m_Posted;           // The number of messages posted.
+        unsigned long long  m_Overflows;        // The number of messages dropped because the mailbox was full.
+        unsigned long long  m_Received;         // The number of messages received.
+        unsigned long long  m_Signaled;         // The number of waits that ended with a signal.
+        unsigned long long  m_Timeouts;         // The number of waits that ended with a timeout.
+        unsigned long long  m_MaxDelay;         // The largest delay of a message, in processor cycles.
+
+        Mailbox(Mutex::Modes p_Mode)
+        :   m_Mutex(p_Mode, "Mailbox"), m_First(0), m_Count(0), m_Posted(0), m_Overflows(0),
+            m_Received(0), m_Signaled(0), m_Timeouts(0), m_MaxDelay(0) {}
+    };
+
+    //**************************************************************************
+    // This holds the state shared by the threads of the broadcast workload.
+    struct Broadcast {
+        Mutex               m_Mutex;            // The mutex that protects the generation.
+        ConditionVariable   m_Condition;        // The condition variable broadcast for each generation.
+        unsigned long long  m_Generation;       // The number of broadcasts so far.
+        unsigned long long  m_Seen;             // The number of generations seen by all the waiters.
+        unsigned long long  m_Missed;           // The number of generations missed by all the waiters.
+        unsigned long long  m_Herded;           // The number of waiters waked up while the broadcaster held the mutex.
+
+        Broadcast(Mutex::Modes p_Mode) : m_Mutex(p_Mode, "Broadcast"), m_Generation(0), m_Seen(0), m_Missed(0), m_Herded(0) {}
+    };
+
+    //**************************************************************************
+    // This holds the state shared by the threads of the inversion workload.
+    struct Inversion {
+        Mutex               m_Mutex;            // The mutex the threads share.
+        unsigned long long  m_Acquisitions;     // The number of times the realtime thread got the mutex.
+        unsigned long long  m_TotalWait;        // The sum of its waits for the mutex, in processor cycles.
+        unsigned long long  m_MaxWait;          // The largest of its waits for the mutex, in processor cycles.
+
+        Inversion() : m_Mutex(Mutex::MODE_HANDOFF, "Inversion"), m_Acquisitions(0), m_TotalWait(0), m_MaxWait(0) {}
+    };
+
+    //**************************************************************************
+    // This holds what the real-time hog of the reservations workload measured.
+    struct Reservation {
+        unsigned long long  m_DropTime;         // The timestamp at which it dropped its reservation, if it did.
+        unsigned long long  m_ReservedCycles;   // The processor cycles it got until then.
+    };
+
+    struct Alarm;
+
+    //**************************************************************************
+    // This holds the state shared by the timers of the timers workload.
+    struct Alarms {
+        Alarm*              m_pAlarms;          // The ALARM_COUNT timers.
+        unsigned            m_Seed;             // The seed of the delays of the timers.
+        unsigned long long  m_Expiries;         // The number of times a timer expired.
+        unsigned long long  m_Moves;            // The number of times a timer was stopped and started again.
+        unsigned long long  m_Late;             // The number of expiries after the deadline.
+        unsigned long long  m_Disorders;        // The number of expiries before one of an earlier deadline.
+        unsigned long long  m_Missed;           // The number of timers found still started after their deadline.
+        unsigned long long  m_LastDeadline;     // The deadline of the last timer that expired.
+        unsigned long long  m_LongestDelay;     // The longest delay after which a timer expired, in clock ticks.
+    };
+
+    //**************************************************************************
+    // This holds a timer of the timers workload.
+    struct Alarm {
+        Threading::Timer    m_Timer;            // The timer.
+        Alarms*             m_pAlarms;          // The state shared by all the timers.
+        unsigned long long  m_Start;            // The tick at which the timer was started.
+        unsigned long long  m_Deadline;         // The tick at which the timer should expire.
+        unsigned            m_Index;            // The index of the timer among the others.
+    };
+
+    typedef std::vector<Thread*> ThreadVector;
+
+    //**************************************************************************
+    // Creates a process. Threads don't keep their process alive, and those of
+    // a workload are never destroyed, so the process is left behind as well.
+    //
+    // Parameters:
+    //  p_Share - The share of the processor the process gets.
+    //**************************************************************************
+    ProcessSP CreateProcess(unsigned p_Share = Process::DEFAULT_SHARE)
+    {
+        ProcessSP* pspProcess = new ProcessSP(new Process(p_Share));
+
+        return *pspProcess;
+    }
+
+    //**************************************************************************
+    // Resets the machine and creates a scheduler, along with a system process
+    // holding the reaper and idle threads. The scheduler of the previous
+    // workload is left behind, since a scheduler is never destroyed.
+    //
+    // Returns:
+    //  The system process.
+    //**************************************************************************
+    ProcessSP Boot()
+    {
+        Reset();
+        if (g_pPager == 0) g_pPager = new Paging::Pager();
+        g_pScheduler = new Threading::Scheduler();
+
+        ProcessSP spProcess = CreateProcess();
+        g_pScheduler->StartReaper(spProcess);
+        g_pScheduler->StartIdle(spProcess);
+
+        return spProcess;
+    }
+
+    //**************************************************************************
+    // Creates a thread and makes it ready.
+    //
+    // Parameters:
+    //  p_spProcess - The process in which the thread runs.
+    //  p_pEntry    - The entry point of the thread.
+    //  p_pArgument - The argument passed to the entry point.
+    //  p_Priority  - The priority of the thread.
+    //
+    // Returns:
+    //  The thread, which is owned by the scheduler.
+    //**************************************************************************
+    Thread* Spawn(ProcessSP p_spProcess, void (* p_pEntry)(void*), void* p_pArgument = 0, Thread::Priorities p_Priority = Thread::PRIORITY_NORMAL)
+    {
+        ThreadSP spThread(new Thread(p_spProcess, p_pEntry, p_pArgument));
+        spThread->Priority(p_Priority);
+        g_pScheduler->AddThread(spThread);
+
+        return spThread.get();
+    }
+
+    //**************************************************************************
+    // Returns the processor cycles a thread got, in all modes.
+    //
+    // Parameters:
+    //  p_pThread - The thread whose cycles are requested.
+    //**************************************************************************
+    unsigned long long Cycles(const Thread* p_pThread)
+    {
+        unsigned long long cycles = 0;
+        for (int mode = 0; mode < Schedulable::MODE_COUNT; ++mode) {
+            cycles += p_pThread->Cycles(static_cast<Schedulable::Modes>(mode));
+        }
+
+        return cycles;
+    }
+
+    //**************************************************************************
+    // Returns the Jain fairness index of the processor cycles of threads that
+    // should all get the same share: 1 when they do, down to 1 / N when one
+    // of them gets everything.
+    //
+    // Parameters:
+    //  p_rThreads - The threads.
+    //**************************************************************************
+    double Fairness(const ThreadVector& p_rThreads)
+    {
+        double sum = 0, squares = 0;
+        for (ThreadVector::const_iterator it = p_rThreads.begin(); it != p_rThreads.end(); ++it) {
+            double cycles = Cycles(*it);
+            sum += cycles;
+            squares += cycles * cycles;
+        }
+
+        return squares == 0 ? 0 : sum * sum / (p_rThreads.size() * squares);
+    }
+
+    //**************************************************************************
+    // Returns the weight of a priority, the way Thread::Weight gives it, in
+    // normal weights.
+    //
+    // Parameters:
+    //  p_Priority - The priority, which isn't the real-time one.
+    //**************************************************************************
+    double Weight(Thread::Priorities p_Priority)
+    {
+        switch (p_Priority) {
+            case Thread::PRIORITY_HIGH:     return 2;
+            case Thread::PRIORITY_NORMAL:   return 1;
+            case Thread::PRIORITY_LOW:      return 0.5;
+            case Thread::PRIORITY_VERY_LOW: return 0.25;
+            default:                        assert(false); return 0;
+        }
+    }
+
+    //**************************************************************************
+    // Returns the class of a priority, the way Thread::PriorityClass gives it,
+    // from 0 for realtime to 4 for very low.
+    //
+    // Parameters:
+    //  p_Priority - The priority.
+    //**************************************************************************
+    size_t PriorityClass(Thread::Priorities p_Priority)
+    {
+        switch (p_Priority) {
+            case Thread::PRIORITY_REALTIME: return 0;
+            case Thread::PRIORITY_HIGH:     return 1;
+            case Thread::PRIORITY_NORMAL:   return 2;
+            case Thread::PRIORITY_LOW:      return 3;
+            case Thread::PRIORITY_VERY_LOW: return 4;
+            default:                        assert(false); return 0;
+        }
+    }
+
+    //**************************************************************************
+    // Returns the name of a mutex mode.
+    //
+    // Parameters:
+    //  p_Mode - The mode.
+    //**************************************************************************
+    const char* ModeName(Mutex::Modes p_Mode)
+    {
+        static const char* const s_pModes[] = {"compete", "handoff", "adaptive"};
+
+        return s_pModes[p_Mode];
+    }
+
+    //**************************************************************************
+    // Returns the number of scheduling decisions made so far: every clock
+    // interrupt decides whether to preempt, and every switch outside of one
+    // is a decision of its own.
+    //**************************************************************************
+    unsigned long long Decisions()
+    {
+        return GetClockInterruptCount() + GetSwitchCount() - GetInterruptSwitchCount();
+    }
+
+    //**************************************************************************
+    // Runs the simulation and writes how fast the scheduler made decisions.
+    //
+    // Returns:
+    //  The host time spent per decision outside of host context switches, in
+    //  nanoseconds.
+    //**************************************************************************
+    double Run()
+    {
+        unsigned long long decisions = Decisions();
+        double switching = GetHostSwitchTime();
+        double start = ReadHostTime();
+        Simulate(RUN_TICKS);
+        double elapsed = ReadHostTime() - start;
+        decisions = Decisions() - decisions;
+        switching = GetHostSwitchTime() - switching;
+
+        std::printf("  %llu decisions in %.3f s, %.0f decisions/s\n", decisions, elapsed, decisions / elapsed);
+
+        return (elapsed - switching) * 1e9 / decisions;
+    }
+
+    //**************************************************************************
+    // Starts a timer of the timers workload with a pseudo-random delay. The
+    // number of bits of the delay is spread evenly, so that every level of
+    // the timer wheel gets timers.
+    //
+    // Parameters:
+    //  p_rAlarm - The timer.
+    //  p_Now    - The current clock tick.
+    //**************************************************************************
+    void StartAlarm(Alarm& p_rAlarm, unsigned long long p_Now)
+    {
+        Alarms* pAlarms = p_rAlarm.m_pAlarms;
+        pAlarms->m_Seed = pAlarms->m_Seed * 1103515245 + 12345;
+        unsigned bits = 1 + (pAlarms->m_Seed >> 16) % ALARM_DELAY_BITS;
+        pAlarms->m_Seed = pAlarms->m_Seed * 1103515245 + 12345;
+        unsigned delay = 1 + (pAlarms->m_Seed >> 8) % (1U << bits);
+
+        p_rAlarm.m_Start = p_Now;
+        p_rAlarm.m_Deadline = p_Now + delay;
+        g_pScheduler->StartTimer(&p_rAlarm.m_Timer, p_rAlarm.m_Deadline);
+    }
+
+    //**************************************************************************
+    // Handler of a timer of the timers workload. It checks that the timer
+    // expired on its deadline, and in order, then starts it again. It also
+    // stops the next timer and starts it with another deadline, so that
+    // timers get removed from every level of the wheel.
+    //
+    // Parameters:
+    //  p_pAlarm - The timer that expired.
+    //**************************************************************************
+    void AlarmHandler(void* p_pAlarm)
+    {
+        Alarm* pAlarm = static_cast<Alarm*>(p_pAlarm);
+        Alarms* pAlarms = pAlarm->m_pAlarms;
+
+        unsigned long long now = GetClockTicks();
+        ++pAlarms->m_Expiries;
+        if (now != pAlarm->m_Deadline) ++pAlarms->m_Late;
+        if (pAlarm->m_Deadline < pAlarms->m_LastDeadline) ++pAlarms->m_Disorders;
+        pAlarms->m_LastDeadline = pAlarm->m_Deadline;
+        pAlarms->m_LongestDelay = std::max(pAlarms->m_LongestDelay, now - pAlarm->m_Start);
+        StartAlarm(*pAlarm, now);
+
+        Alarm& rNext = pAlarms->m_pAlarms[(pAlarm->m_Index + 1) % ALARM_COUNT];
+        if (pAlarms->m_Expiries % ALARM_MOVE_INTERVAL == 0 && g_pScheduler->StopTimer(&rNext.m_Timer)) {
+            if (rNext.m_Deadline < now) ++pAlarms->m_Missed;
+            ++pAlarms->m_Moves;
+            StartAlarm(rNext, now);
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that never stops computing.
+    //**************************************************************************
+    void HogEntry(void*)
+    {
+        for (;;) {
+            Execute(HOG_CYCLES);
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that wakes up periodically to compute a little,
+    // and measures how late it wakes up.
+    //
+    // Parameters:
+    //  p_pSleeper - The sleeper, which receives the measures.
+    //**************************************************************************
+    void SleeperEntry(void* p_pSleeper)
+    {
+        Sleeper* pSleeper = static_cast<Sleeper*>(p_pSleeper);
+
+        unsigned long long deadline = GetClockTicks();
+        for (;;) {
+            deadline += pSleeper->m_Period;
+            g_pScheduler->SleepUntil(deadline);
+
+            if (deadline >= WARMUP_TICKS) {
+                unsigned long long latency = ReadTimestampCounter() - deadline * CYCLES_PER_TICK;
+                ++pSleeper->m_Wakeups;
+                pSleeper->m_TotalLatency += latency;
+                pSleeper->m_MaxLatency = std::max(pSleeper->m_MaxLatency, latency);
+            }
+
+            Execute(SLEEPER_CYCLES);
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that wakes up periodically to compute a little,
+    // and records each of its wake latencies.
+    //
+    // Parameters:
+    //  p_pSleeper - The sleeper, whose tracer receives the latencies.
+    //**************************************************************************
+    void TracedSleeperEntry(void* p_pSleeper)
+    {
+        TracedSleeper* pSleeper = static_cast<TracedSleeper*>(p_pSleeper);
+        Thread* pThread = g_pScheduler->Current();
+
+        // A sleeper is woken up by the clock interrupt on its deadline, so it
+        // waited from the start of that tick until now. A deadline that went
+        // by while it ran is pushed back to the next tick, since it would be
+        // woken up on that tick instead.
+        unsigned long long deadline = GetClockTicks();
+        for (;;) {
+            deadline = std::max(deadline + pSleeper->m_Period, GetClockTicks() + 1);
+            g_pScheduler->SleepUntil(deadline);
+
+            unsigned long long now = ReadTimestampCounter();
+            pSleeper->m_pTracer->Record(PriorityClass(pThread->Priority()), now - deadline * CYCLES_PER_TICK, now, pThread, 0);
+            Execute(SLEEPER_CYCLES);
+        }
+    }
+
+    //**************************************************************************
+    // Records known latencies in a tracer, and returns whether it counted them
+    // in the right buckets and kept the worst one.
+    //**************************************************************************
+    bool CheckTracer()
+    {
+        // The bounds of a few buckets, each counted in a class of its own
+        struct Bound {
+            unsigned long long  m_Latency;  // The latency, in processor cycles.
+            size_t              m_Bucket;   // The bucket that should count it.
+        };
+        const Bound bounds[] = {
+            {0,                 0},
+            {1,                 0},
+            {2,                 1},
+            {3,                 1},
+            {(1ULL << 32) - 1,  31},
+            {1ULL << 32,        32},
+            {~0ULL,             63}
+        };
+        const size_t count = sizeof(bounds) / sizeof(bounds[0]);
+
+        LatencyTracer tracer;
+        for (size_t i = 0; i < count; ++i) {
+            tracer.Record(i % LatencyTracer::CLASSES, bounds[i].m_Latency, i, 0, 0);
+        }
+        unsigned long long expected[LatencyTracer::CLASSES][LatencyTracer::BUCKETS] = {};
+        for (size_t i = 0; i < count; ++i) {
+            ++expected[i % LatencyTracer::CLASSES][bounds[i].m_Bucket];
+        }
+        bool counted = true;
+        for (size_t i = 0; i < LatencyTracer::CLASSES; ++i) {
+            for (size_t j = 0; j < LatencyTracer::BUCKETS; ++j) {
+                counted = counted && tracer.Count(i, j) == expected[i][j];
+            }
+        }
+        bool worst = tracer.Worst() == ~0ULL;
+
+        // Many more latencies than the worst ones kept, the largest of which
+        // comes first, then ones that all replace a smaller one.
+        LatencyTracer replaced;
+        replaced.Record(0, 1000000, 0, 0, 0);
+        for (unsigned long long i = 1; i <= 1000; ++i) {
+            replaced.Record(0, i, i, 0, 0);
+            worst = worst && replaced.Worst() == 1000000;
+        }
+        replaced.Record(0, 1000001, 1001, 0, 0);
+        worst = worst && replaced.Worst() == 1000001;
+        std::printf("  tracer buckets %s, worst latency %s\n", counted ? "right" : "wrong", worst ? "kept" : "lost");
+
+        return counted && worst;
+    }
+
+    //**************************************************************************
+    // Creates the sleepers.
+    //
+    // Parameters:
+    //  p_spProcess - The process in which the sleepers run.
+    //  p_pSleepers - The SLEEPER_COUNT sleepers, which receive the measures.
+    //
+    // Returns:
+    //  The threads of the sleepers.
+    //**************************************************************************
+    ThreadVector SpawnSleepers(ProcessSP p_spProcess, Sleeper* p_pSleepers)
+    {
+        ThreadVector threads;
+        for (unsigned i = 0; i < SLEEPER_COUNT; ++i) {
+            Sleeper& rSleeper = p_pSleepers[i];
+            rSleeper.m_Period = SLEEPER_PERIODS[i];
+            rSleeper.m_Wakeups = rSleeper.m_TotalLatency = rSleeper.m_MaxLatency = 0;
+            threads.push_back(Spawn(p_spProcess, &SleeperEntry, &rSleeper));
+        }
+
+        return threads;
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that keeps acquiring a mutex shared with other
+    // threads.
+    //
+    // Parameters:
+    //  p_pConvoy - The convoy the thread belongs to.
+    //**************************************************************************
+    void ConvoyEntry(void* p_pConvoy)
+    {
+        Convoy* pConvoy = static_cast<Convoy*>(p_pConvoy);
+
+        for (unsigned i = 1; ; ++i) {
+            pConvoy->m_Mutex.Lock();
+            Execute(HOLD_CYCLES);
+
+            // Now and then, block while holding the mutex so that the other
+            // threads pile up behind it.
+            if (i % IO_INTERVAL == 0) g_pScheduler->SleepUntil(GetClockTicks() + 1);
+            ++pConvoy->m_Acquisitions;
+            pConvoy->m_Mutex.Unlock();
+            Execute(THINK_CYCLES);
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that periodically posts a burst of messages, and
+    // signals the condition variable for each of them. The last one is
+    // signaled once the mutex is released, so that a waiter is waked up
+    // rather than moved to the waiters of the mutex.
+    //
+    // Parameters:
+    //  p_pMailbox - The mailbox the messages are posted to.
+    //**************************************************************************
+    void ProducerEntry(void* p_pMailbox)
+    {
+        Mailbox* pMailbox = static_cast<Mailbox*>(p_pMailbox);
+
+        for (;;) {
+            g_pScheduler->SleepUntil(GetClockTicks() + MAILBOX_PERIOD);
+
+            for (unsigned i = 1; i <= MAILBOX_BURST; ++i) {
+                pMailbox->m_Mutex.Lock();
+                if (pMailbox->m_Count == MAILBOX_CAPACITY) {
+                    ++pMailbox->m_Overflows;
+                } else {
+                    pMailbox->m_Messages[(pMailbox->m_First + pMailbox->m_Count++) % MAILBOX_CAPACITY] = ReadTimestampCounter();
+                    ++pMailbox->m_Posted;
+                }
+                if (i < MAILBOX_BURST) pMailbox->m_Condition.Signal();
+                pMailbox->m_Mutex.Unlock();
+            }
+            pMailbox->m_Condition.Signal();
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that receives messages one at a time, and
+    // measures how long they waited.
+    //
+    // Parameters:
+    //  p_pMailbox - The mailbox the messages are received from.
+    //**************************************************************************
+    void ConsumerEntry(void* p_pMailbox)
+    {
+        Mailbox* pMailbox = static_cast<Mailbox*>(p_pMailbox);
+
+        pMailbox->m_Mutex.Lock();
+        for (;;) {
+            while (pMailbox->m_Count == 0) {
+                if (pMailbox->m_Condition.Wait(pMailbox->m_Mutex, GetClockTicks() + MAILBOX_TIMEOUT)) {
+                    ++pMailbox->m_Signaled;
+                } else {
+                    ++pMailbox->m_Timeouts;
+                }
+            }
+
+            unsigned long long delay = ReadTimestampCounter() - pMailbox->m_Messages[pMailbox->m_First];
+            pMailbox->m_First = (pMailbox->m_First + 1) % MAILBOX_CAPACITY;
+            --pMailbox->m_Count;
+            ++pMailbox->m_Received;
+            pMailbox->m_MaxDelay = std::max(pMailbox->m_MaxDelay, delay);
+
+            pMailbox->m_Mutex.Unlock();
+            Execute(SLEEPER_CYCLES);
+            pMailbox->m_Mutex.Lock();
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that periodically starts a new generation and
+    // broadcasts it, then holds the mutex until the next tick. The waiters
+    // should stay asleep until it releases the mutex, rather than wake up only
+    // to wait for it.
+    //
+    // Parameters:
+    //  p_pBroadcast - The broadcast workload the thread belongs to.
+    //**************************************************************************
+    void BroadcasterEntry(void* p_pBroadcast)
+    {
+        Broadcast* pBroadcast = static_cast<Broadcast*>(p_pBroadcast);
+
+        for (;;) {
+            g_pScheduler->SleepUntil(GetClockTicks() + BROADCAST_PERIOD);
+
+            pBroadcast->m_Mutex.Lock();
+            ++pBroadcast->m_Generation;
+            unsigned long long wakeups = g_pScheduler->Wakeups();
+            pBroadcast->m_Condition.Broadcast();
+
+            // Only the broadcaster itself should be waked up meanwhile
+            g_pScheduler->SleepUntil(GetClockTicks() + 1);
+            pBroadcast->m_Herded += g_pScheduler->Wakeups() - wakeups - 1;
+            pBroadcast->m_Mutex.Unlock();
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a thread that waits for each generation, and counts the
+    // ones it missed.
+    //
+    // Parameters:
+    //  p_pBroadcast - The broadcast workload the thread belongs to.
+    //**************************************************************************
+    void GenerationEntry(void* p_pBroadcast)
+    {
+        Broadcast* pBroadcast = static_cast<Broadcast*>(p_pBroadcast);
+
+        pBroadcast->m_Mutex.Lock();
+        unsigned long long generation = pBroadcast->m_Generation;
+        for (;;) {
+            while (pBroadcast->m_Generation == generation) pBroadcast->m_Condition.Wait(pBroadcast->m_Mutex);
+
+            pBroadcast->m_Missed += pBroadcast->m_Generation - generation - 1;
+            ++pBroadcast->m_Seen;
+            generation = pBroadcast->m_Generation;
+
+            pBroadcast->m_Mutex.Unlock();
+            Execute(THINK_CYCLES);
+            pBroadcast->m_Mutex.Lock();
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a low priority thread that holds a mutex most of the
+    // time.
+    //
+    // Parameters:
+    //  p_pInversion - The inversion workload the thread belongs to.
+    //**************************************************************************
+    void HolderEntry(void* p_pInversion)
+    {
+        Inversion* pInversion = static_cast<Inversion*>(p_pInversion);
+
+        for (;;) {
+            pInversion->m_Mutex.Lock();
+            for (unsigned long long i = 0; i < INVERSION_HOLD_CYCLES; i += HOG_CYCLES) Execute(HOG_CYCLES);
+            pInversion->m_Mutex.Unlock();
+            Execute(HOG_CYCLES);
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a realtime thread that periodically wants the mutex held
+    // by a low priority thread, and measures how long it waits for it.
+    //
+    // Parameters:
+    //  p_pInversion - The inversion workload the thread belongs to.
+    //**************************************************************************
+    void WaiterEntry(void* p_pInversion)
+    {
+        Inversion* pInversion = static_cast<Inversion*>(p_pInversion);
+
+        for (;;) {
+            g_pScheduler->SleepUntil(GetClockTicks() + INVERSION_PERIOD);
+
+            unsigned long long start = ReadTimestampCounter();
+            pInversion->m_Mutex.Lock();
+            unsigned long long wait = ReadTimestampCounter() - start;
+            ++pInversion->m_Acquisitions;
+            pInversion->m_TotalWait += wait;
+            pInversion->m_MaxWait = std::max(pInversion->m_MaxWait, wait);
+
+            Execute(SLEEPER_CYCLES);
+            pInversion->m_Mutex.Unlock();
+        }
+    }
+
+    //**************************************************************************
+    // Entry point of a real-time thread that never stops computing, and drops
+    // its reservation halfway through the run, while it runs.
+    //
+    // Parameters:
+    //  p_pReservation - The reservation, which receives the measures.
+    //**************************************************************************
+    void ReservedEntry(void* p_pReservation)
+    {
+        Reservation* pReservation = static_cast<Reservation*>(p_pReservation);
+
+        for (;;) {
+            Execute(HOG_CYCLES);
+
+            if (pReservation->m_DropTime == 0 && GetClockTicks() >= RUN_TICKS / 2) {
+                Thread* pThread = g_pScheduler->Current();
+                pReservation->m_DropTime = ReadTimestampCounter();
+                pReservation->m_ReservedCycles = Cycles(pThread);
+                g_pScheduler->Reserve(pThread, 0, 0);
+            }
+        }
+    }
+
+    //**************************************************************************
+    // Threads that compute all the time, and should share the processor evenly.
+    //**************************************************************************
+    bool RunHogs()
+    {
+        ProcessSP spProcess = Boot();
+        ThreadVector hogs;
+        for (unsigned i = 0; i < HOG_COUNT; ++i) hogs.push_back(Spawn(spProcess, &HogEntry));
+
+        Run();
+        double fairness = Fairness(hogs);
+        std::printf("  %u hogs, fairness %.4f\n", HOG_COUNT, fairness);
+
+        return fairness >= MINIMUM_FAIRNESS;
+    }
+
+    //**************************************************************************
+    // Growing numbers of hogs, to check that the cost of a scheduling decision
+    // grows no faster than the depth of the ready queues.
+    //**************************************************************************
+    bool RunSweep()
+    {
+        const size_t count = sizeof(SWEEP_COUNTS) / sizeof(SWEEP_COUNTS[0]);
+
+        double worst = 0;
+        for (size_t i = 0; i < count; ++i) {
+            ProcessSP spProcess = Boot();
+            for (unsigned j = 0; j < SWEEP_COUNTS[i]; ++j) Spawn(spProcess, &HogEntry);
+
+            // Let every hog run once before measuring, so that the host
+            // stacks of the tasks are already set up.
+            Simulate(SWEEP_COUNTS[i]);
+            unsigned long long decisions = Decisions();
+            unsigned long long comparisons = Threading::RunQueue::s_Comparisons;
+            double cost = Run();
+            decisions = Decisions() - decisions;
+            comparisons = Threading::RunQueue::s_Comparisons - comparisons;
+
+            // Compare the comparisons with the depth of the heap of threads
+            double perDecision = static_cast<double>(comparisons) / decisions;
+            double perLevel = perDecision / std::log(static_cast<double>(SWEEP_COUNTS[i])) * std::log(2.0);
+            std::printf("  %u hogs, %.0f ns and %.1f comparisons per decision, %.2f per level\n",
+                        SWEEP_COUNTS[i], cost, perDecision, perLevel);
+            worst = std::max(worst, perLevel);
+        }
+
+        return worst <= MAXIMUM_SWEEP_COMPARISONS;
+    }
+
+    //**************************************************************************
+    // Threads that sleep most of the time, next to hogs. They should run as
+    // soon as they wake up.
+    //**************************************************************************
+    bool RunSleepers()
+    {
+        ProcessSP spProcess = Boot();
+        ThreadVector hogs;
+        for (unsigned i = 0; i < HOG_COUNT; ++i) hogs.push_back(Spawn(spProcess, &HogEntry));
+        Sleeper sleepers[SLEEPER_COUNT];
+        SpawnSleepers(spProcess, sleepers);
+
+        Run();
+        double worst = 0;
+        for (unsigned i = 0; i < SLEEPER_COUNT; ++i) {
+            const Sleeper& rSleeper = sleepers[i];
+            double average = rSleeper.m_Wakeups == 0 ? 0 : static_cast<double>(rSleeper.m_TotalLatency) / rSleeper.m_Wakeups / CYCLES_PER_TICK;
+            double maximum = static_cast<double>(rSleeper.m_MaxLatency) / CYCLES_PER_TICK;
+            std::printf("  sleeper every %u ticks, %llu wakeups, latency %.4f ticks average, %.4f ticks max\n",
+                        rSleeper.m_Period, rSleeper.m_Wakeups, average, maximum);
+            if (rSleeper.m_Wakeups == 0) worst = MAXIMUM_LATENCY + 1;
+            worst = std::max(worst, maximum);
+        }
+        double fairness = Fairness(hogs);
+        std::printf("  %u hogs, fairness %.4f\n", HOG_COUNT, fairness);
+
+        return worst <= MAXIMUM_LATENCY && fairness >= MINIMUM_FAIRNESS;
+    }
+
+    //**************************************************************************
+    // Hogs of every priority next to sleepers. The sleepers get what they ask
+    // for, and the hogs share the rest in proportion to their weights.
+    //**************************************************************************
+    bool RunFairness()
+    {
+        static const Thread::Priorities s_Priorities[] = {
+            Thread::PRIORITY_HIGH,
+            Thread::PRIORITY_NORMAL,
+            Thread::PRIORITY_LOW,
+            Thread::PRIORITY_VERY_LOW
+        };
+        const size_t priorities = sizeof(s_Priorities) / sizeof(s_Priorities[0]);
+
+        // Two hogs of each priority
+        ProcessSP spProcess = Boot();
+        ThreadVector hogs;
+        double weights = 0;
+        for (size_t i = 0; i < 2 * priorities; ++i) {
+            hogs.push_back(Spawn(spProcess, &HogEntry, 0, s_Priorities[i % priorities]));
+            weights += Weight(s_Priorities[i % priorities]);
+        }
+        Sleeper sleepers[SLEEPER_COUNT];
+        ThreadVector threads = SpawnSleepers(spProcess, sleepers);
+
+        Run();
+
+        // Compare the share of each hog among the hogs with its weight
+        double cycles = 0;
+        for (ThreadVector::const_iterator it = hogs.begin(); it != hogs.end(); ++it) cycles += Cycles(*it);
+        double worst = 0;
+        for (ThreadVector::const_iterator it = hogs.begin(); it != hogs.end(); ++it) {
+            double share = Cycles(*it) / cycles;
+            double expected = Weight((*it)->Priority()) / weights;
+            std::printf("  hog of priority %3d, share %.4f for %.4f expected\n", (*it)->Priority(), share, expected);
+            worst = std::max(worst, std::fabs(share / expected - 1));
+        }
+        unsigned long long sleeping = 0;
+        for (ThreadVector::const_iterator it = threads.begin(); it != threads.end(); ++it) sleeping += Cycles(*it);
+        std::printf("  sleepers got %.4f of the processor, shares are off by %.2f%% at most\n",
+                    static_cast<double>(sleeping) / ReadTimestampCounter(), worst * 100);
+
+        return worst <= MAXIMUM_SHARE_ERROR;
+    }
+
+    //**************************************************************************
+    // Threads that spend most of their time holding the same mutex.
+    //
+    // Parameters:
+    //  p_Mode  - How the mutex is released to waiting threads.
+    //  p_Count - The number of threads.
+    //
+    // Returns:
+    //  Whether every release woke up at most one thread, and whether the
+    //  threads got the mutex in turn when it is handed off.
+    //**************************************************************************
+    bool RunConvoy(Mutex::Modes p_Mode, unsigned p_Count)
+    {
+        // The convoy is left behind with its threads, which still wait for
+        // its mutex.
+        ProcessSP spProcess = Boot();
+        Convoy* pConvoy = new Convoy(p_Mode);
+        ThreadVector threads;
+        for (unsigned i = 0; i < p_Count; ++i) threads.push_back(Spawn(spProcess, &ConvoyEntry, pConvoy));
+
+        Run();
+        unsigned long long acquisitions = pConvoy->m_Acquisitions;
+        double switches = acquisitions == 0 ? 0 : static_cast<double>(g_pScheduler->Switches()) / acquisitions;
+        double wakeups = acquisitions == 0 ? 0 : static_cast<double>(g_pScheduler->Wakeups()) / acquisitions;
+        double fairness = Fairness(threads);
+        std::printf("  %-8s %2u threads, %llu acquisitions, %.3f switches and %.3f wakeups per acquisition, fairness %.4f\n",
+                    ModeName(p_Mode), p_Count, acquisitions, switches, wakeups, fairness);
+
+        // Besides the mutex, threads are only waked up after blocking while
+        // they hold it.
+        return acquisitions > 0 && wakeups <= 1 + 1.0 / IO_INTERVAL + 0.01 &&
+               (p_Mode != Mutex::MODE_HANDOFF || fairness >= MINIMUM_FAIRNESS);
+    }
+
+    //**************************************************************************
+    // Growing numbers of threads convoying on a mutex, in each mode.
+    //**************************************************************************
+    bool RunConvoys()
+    {
+        static const Mutex::Modes s_Modes[] = {Mutex::MODE_COMPETE, Mutex::MODE_HANDOFF, Mutex::MODE_ADAPTIVE};
+
+        bool sane = true;
+        for (size_t i = 0; i < sizeof(s_Modes) / sizeof(s_Modes[0]); ++i) {
+            for (size_t j = 0; j < sizeof(CONVOY_COUNTS) / sizeof(CONVOY_COUNTS[0]); ++j) {
+                sane = RunConvoy(s_Modes[i], CONVOY_COUNTS[j]) && sane;
+            }
+        }
+
+        return sane;
+    }
+
+    //**************************************************************************
+    // Consumers waiting on a condition variable for messages, which a
+    // producer posts in bursts and signals one at a time.
+    //
+    // Parameters:
+    //  p_Mode - How the mutex is released to waiting threads.
+    //
+    // Returns:
+    //  Whether every message was received soon after it was posted, and
+    //  whether every signal ended exactly one wait: none was lost, and none
+    //  woke up more than one waiter.
+    //**************************************************************************
+    bool RunMailbox(Mutex::Modes p_Mode)
+    {
+        // The mailbox is left behind with its threads, which still wait on
+        // its condition variable.
+        ProcessSP spProcess = Boot();
+        Mailbox* pMailbox = new Mailbox(p_Mode);
+        Spawn(spProcess, &ProducerEntry, pMailbox);
+        for (unsigned i = 0; i < MAILBOX_CONSUMERS; ++i) Spawn(spProcess, &ConsumerEntry, pMailbox);
+
+        Simulate(RUN_TICKS);
+        double delay = static_cast<double>(pMailbox->m_MaxDelay) / CYCLES_PER_TICK;
+        std::printf("  %-8s %llu messages, %llu received, %llu signaled and %llu timed out waits, delay %.4f ticks max\n",
+                    ModeName(p_Mode), pMailbox->m_Posted, pMailbox->m_Received, pMailbox->m_Signaled, pMailbox->m_Timeouts, delay);
+
+        // The producer signals once per message, and a consumer always waits
+        // for it. The last burst may not have been received yet.
+        return pMailbox->m_Received > 0 && pMailbox->m_Overflows == 0 &&
+               pMailbox->m_Received + pMailbox->m_Count == pMailbox->m_Posted &&
+               pMailbox->m_Signaled + MAILBOX_BURST >= pMailbox->m_Posted &&
+               pMailbox->m_Signaled <= pMailbox->m_Posted && delay <= MAXIMUM_LATENCY;
+    }
+
+    //**************************************************************************
+    // Threads waiting on a condition variable for each generation, which is
+    // broadcast to them. Every thread should see every generation, and none
+    // should be waked up by the broadcast itself: it moves them to the waiters
+    // of the mutex instead of waking them all up to fight for it.
+    //
+    // Parameters:
+    //  p_Mode - How the mutex is released to waiting threads.
+    //
+    // Returns:
+    //  Whether no generation was missed, and whether no waiter was waked up
+    //  while the mutex was still held.
+    //**************************************************************************
+    bool RunBroadcast(Mutex::Modes p_Mode)
+    {
+        // The workload is left behind with its threads, which still wait on
+        // its condition variable.
+        ProcessSP spProcess = Boot();
+        Broadcast* pBroadcast = new Broadcast(p_Mode);
+        Spawn(spProcess, &BroadcasterEntry, pBroadcast);
+        for (unsigned i = 0; i < BROADCAST_WAITERS; ++i) Spawn(spProcess, &GenerationEntry, pBroadcast);
+
+        Simulate(RUN_TICKS);
+        unsigned long long generations = pBroadcast->m_Generation;
+        double wakeups = generations == 0 ? 0 : static_cast<double>(g_pScheduler->Wakeups()) / generations;
+        std::printf("  %-8s %llu broadcasts to %u waiters, %llu seen, %llu missed, %llu herded, %.3f wakeups per broadcast\n",
+                    ModeName(p_Mode), generations, BROADCAST_WAITERS, pBroadcast->m_Seen, pBroadcast->m_Missed,
+                    pBroadcast->m_Herded, wakeups);
+
+        // The last generation may not have been seen by all the waiters yet
+        return generations > 0 && pBroadcast->m_Missed == 0 && pBroadcast->m_Herded == 0 &&
+               pBroadcast->m_Seen + BROADCAST_WAITERS >= generations * BROADCAST_WAITERS;
+    }
+
+    //**************************************************************************
+    // Condition variables signaled and broadcast, with each mutex mode.
+    //**************************************************************************
+    bool RunConditions()
+    {
+        static const Mutex::Modes s_Modes[] = {Mutex::MODE_COMPETE, Mutex::MODE_HANDOFF, Mutex::MODE_ADAPTIVE};
+
+        bool sane = true;
+        for (size_t i = 0; i < sizeof(s_Modes) / sizeof(s_Modes[0]); ++i) {
+            sane = RunMailbox(s_Modes[i]) && sane;
+            sane = RunBroadcast(s_Modes[i]) && sane;
+        }
+
+        return sane;
+    }
+
+    //**************************************************************************
+    // A realtime thread waiting for a mutex held by a very low priority thread
+    // of a process with a small share, while hogs of another process keep the
+    // processor busy. The holder inherits the priority of the waiter, and its
+    // process takes the place of that of the waiter and is charged at its
+    // weight, so the waiter shouldn't wait longer than the hold itself.
+    //**************************************************************************
+    bool RunInversion()
+    {
+        // The workload is left behind with its threads, which still use its
+        // mutex.
+        Boot();
+        Inversion* pInversion = new Inversion();
+        ProcessSP spHogs = CreateProcess();
+        for (unsigned i = 0; i < HOG_COUNT; ++i) Spawn(spHogs, &HogEntry);
+        Spawn(CreateProcess(Process::DEFAULT_SHARE / 4), &HolderEntry, pInversion, Thread::PRIORITY_VERY_LOW);
+        Spawn(CreateProcess(), &WaiterEntry, pInversion, Thread::PRIORITY_REALTIME);
+
+        Run();
+        unsigned long long acquisitions = pInversion->m_Acquisitions;
+        double average = acquisitions == 0 ? 0 : static_cast<double>(pInversion->m_TotalWait) / acquisitions / INVERSION_HOLD_CYCLES;
+        double maximum = static_cast<double>(pInversion->m_MaxWait) / INVERSION_HOLD_CYCLES;
+        std::printf("  %llu acquisitions, wait %.3f holds average, %.3f holds max\n", acquisitions, average, maximum);
+
+        return acquisitions > 0 && maximum <= MAXIMUM_INVERSION;
+    }
+
+    //**************************************************************************
+    // Timers that keep being started with delays spread over all the levels of
+    // the timer wheel, and stopped before they expire. Each should expire on
+    // its deadline, after those with earlier deadlines, however far it had to
+    // cascade down the wheel. Some should expire from the top level.
+    //**************************************************************************
+    bool RunTimers()
+    {
+        // The timers are left behind, since they are still started
+        Boot();
+        Alarms* pAlarms = new Alarms();
+        pAlarms->m_pAlarms = new Alarm[ALARM_COUNT];
+        for (unsigned i = 0; i < ALARM_COUNT; ++i) {
+            Alarm& rAlarm = pAlarms->m_pAlarms[i];
+            rAlarm.m_Timer.Handler(&AlarmHandler, &rAlarm);
+            rAlarm.m_pAlarms = pAlarms;
+            rAlarm.m_Index = i;
+            StartAlarm(rAlarm, 0);
+        }
+
+        // Nothing but the timers runs, so time jumps from one to the next
+        Simulate(ALARM_TICKS);
+
+        // Check that no timer was missed
+        unsigned long long now = GetClockTicks();
+        for (unsigned i = 0; i < ALARM_COUNT; ++i) {
+            const Alarm& rAlarm = pAlarms->m_pAlarms[i];
+            if (!rAlarm.m_Timer.Armed() || rAlarm.m_Deadline <= now) ++pAlarms->m_Missed;
+        }
+        std::printf("  %llu expiries and %llu moves over %llu ticks, longest delay %llu ticks\n",
+                    pAlarms->m_Expiries, pAlarms->m_Moves, now, pAlarms->m_LongestDelay);
+        std::printf("  %llu late, %llu out of order, %llu missed\n", pAlarms->m_Late, pAlarms->m_Disorders, pAlarms->m_Missed);
+
+        return pAlarms->m_LongestDelay >= 1ULL << (ALARM_DELAY_BITS - 1) &&
+               pAlarms->m_Late == 0 && pAlarms->m_Disorders == 0 && pAlarms->m_Missed == 0;
+    }
+
+    //**************************************************************************
+    // Sleepers of each priority next to hogs, which record their own wake
+    // latencies. The scheduler should have counted the same latencies, in the
+    // same buckets of the same classes, and kept the same worst one.
+    //**************************************************************************
+    bool RunLatencies()
+    {
+        bool checked = CheckTracer();
+
+        // The workload is left behind with its threads, which still use its
+        // tracer.
+        ProcessSP spProcess = Boot();
+        for (unsigned i = 0; i < HOG_COUNT; ++i) Spawn(spProcess, &HogEntry);
+        LatencyTracer* pTracer = new LatencyTracer();
+        TracedSleeper* pSleepers = new TracedSleeper[SLEEPER_COUNT];
+        for (unsigned i = 0; i < SLEEPER_COUNT; ++i) {
+            pSleepers[i].m_Period = SLEEPER_PERIODS[i];
+            pSleepers[i].m_pTracer = pTracer;
+            Spawn(spProcess, &TracedSleeperEntry, &pSleepers[i], SLEEPER_PRIORITIES[i]);
+        }
+
+        Run();
+
+        // Compare every bucket of the scheduler with that of the sleepers
+        LatencyTracer traced;
+        g_pScheduler->CopyLatencies(traced);
+        unsigned long long latencies = 0, differences = 0;
+        for (size_t i = 0; i < LatencyTracer::CLASSES; ++i) {
+            unsigned long long classLatencies = 0;
+            for (size_t j = 0; j < LatencyTracer::BUCKETS; ++j) {
+                classLatencies += traced.Count(i, j);
+                if (traced.Count(i, j) != pTracer->Count(i, j)) ++differences;
+            }
+            if (classLatencies != 0) std::printf("  class %u, %llu latencies\n", static_cast<unsigned>(i), classLatencies);
+            latencies += classLatencies;
+        }
+        double worst = static_cast<double>(traced.Worst()) / CYCLES_PER_TICK;
+        double expectedWorst = static_cast<double>(pTracer->Worst()) / CYCLES_PER_TICK;
+        std::printf("  %llu buckets differ, worst latency %.4f ticks for %.4f ticks\n", differences, worst, expectedWorst);
+
+        return checked && latencies != 0 && differences == 0 && traced.Worst() == pTracer->Worst();
+    }
+
+    //**************************************************************************
+    // Reservations that are accepted or refused depending on how much of the
+    // processor is already reserved, including ones that replace an existing
+    // reservation. Then a real-time hog next to hogs, which should get its
+    // budget until it drops its reservation, and its fair share afterwards.
+    //**************************************************************************
+    bool RunReservations()
+    {
+        ProcessSP spProcess = Boot();
+        ThreadVector hogs;
+        for (unsigned i = 0; i < HOG_COUNT; ++i) hogs.push_back(Spawn(spProcess, &HogEntry));
+        Reservation reservation = {0, 0};
+        Thread* pReserved = Spawn(spProcess, &ReservedEntry, &reservation);
+
+        // Go over the limit of 90% with a new reservation, then with ones that
+        // replace existing reservations.
+        struct Request {
+            Thread*     m_pThread;  // The thread whose reservation changes.
+            unsigned    m_Budget;   // The budget requested, in clock ticks.
+            bool        m_Accepted; // Whether the reservation should be accepted.
+        };
+        const Request requests[] = {
+            {pReserved, RESERVED_BUDGET,        true},
+            {hogs[0],   6,                      false},
+            {hogs[0],   5,                      true},
+            {hogs[0],   6,                      false},
+            {pReserved, RESERVED_BUDGET + 1,    false},
+            {hogs[0],   0,                      true},
+            {pReserved, RESERVED_BUDGET + 1,    true},
+            {pReserved, RESERVED_BUDGET,        true}
+        };
+        bool admitted = true;
+        for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); ++i) {
+            const Request& rRequest = requests[i];
+            bool accepted = g_pScheduler->Reserve(rRequest.m_pThread, rRequest.m_Budget, RESERVED_PERIOD);
+            std::printf("  %s %u/%u ticks %s\n", rRequest.m_pThread == pReserved ? "real-time hog" : "hog",
+                        rRequest.m_Budget, RESERVED_PERIOD, accepted ? "accepted" : "refused");
+            admitted = admitted && accepted == rRequest.m_Accepted;
+        }
+
+        Run();
+
+        // Compare what the real-time hog got before and after it dropped its
+        // reservation with what it should have.
+        unsigned long long end = ReadTimestampCounter();
+        double reserved = 0, fair = 0;
+        if (reservation.m_DropTime != 0) {
+            reserved = static_cast<double>(reservation.m_ReservedCycles) / reservation.m_DropTime;
+            fair = static_cast<double>(Cycles(pReserved) - reservation.m_ReservedCycles) / (end - reservation.m_DropTime);
+        }
+        double expectedReserved = static_cast<double>(RESERVED_BUDGET) / RESERVED_PERIOD;
+        double expectedFair = 1.0 / (HOG_COUNT + 1);
+        std::printf("  real-time hog share %.4f for %.4f reserved, then %.4f for %.4f fair\n", reserved, expectedReserved, fair, expectedFair);
+
+        return admitted && reservation.m_DropTime != 0 &&
+               std::fabs(reserved / expectedReserved - 1) <= MAXIMUM_SHARE_ERROR &&
+               std::fabs(fair / expectedFair - 1) <= MAXIMUM_SHARE_ERROR;
+    }
+
+} // namespace
+
+// The workloads, ended by one without a name
+const Workload g_Workloads[] = {
+    {"hogs",        "CPU hogs sharing the processor",               &RunHogs},
+    {"sweep",       "From 10 to 10000 CPU hogs",                    &RunSweep},
+    {"sleepers",    "Periodic sleepers next to CPU hogs",           &RunSleepers},
+    {"fairness",    "CPU hogs of each priority next to sleepers",   &RunFairness},
+    {"convoy",      "Threads convoying on a mutex, in each mode",   &RunConvoys},
+    {"inversion",   "A realtime thread behind a low priority one",  &RunInversion},
+    {"reserve",     "Admission of reservations, and dropping one",  &RunReservations},
+    {"timers",      "Timers over every level of the timer wheel",   &RunTimers},
+    {"latency",     "Wake latencies traced by the scheduler",       &RunLatencies},
+    {"condition",   "Condition variables signaled and broadcast",   &RunConditions},
+    {0,             0,                                              0}
+};
+
+} // namespace Simulator
+} // namespace Nutshell
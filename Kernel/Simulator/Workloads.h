@@ -0,0 +1,26 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef SIMULATOR_WORKLOADS_H
+#define SIMULATOR_WORKLOADS_H
+
+namespace Nutshell {
+namespace Simulator {
+
+//******************************************************************************
+// This describes a workload that the simulator can run.
+//******************************************************************************
+struct Workload {
+    const char*     m_pName;            // The name of the workload on the command line.
+    const char*     m_pDescription;     // What the workload measures.
+    bool            (* m_pRun)();       // Runs the workload and writes its results, returns whether they're sane.
+};
+
+// The workloads, ended by one without a name
+extern const Workload g_Workloads[];
+
+} // namespace Simulator
+} // namespace Nutshell
+
+#endif // !SIMULATOR_WORKLOADS_H
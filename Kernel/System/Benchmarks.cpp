@@ -0,0 +1,240 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Machine.h"
+#include "Paging/Pager.h"
+#include "Threading/Scheduler.h"
+#include "Threading/Process.h"
+#include "Threading/PreemptLock.h"
+#include "Threading/QueuedSpinLock.h"
+#include "Threading/RecursiveSpinLock.h"
+#include "Threading/Mutex.h"
+#include "Utilities/Atomic.h"
+#include "System/Benchmarks.h"
+
+namespace Nutshell {
+namespace System {
+
+using Threading::Process;
+using Threading::ProcessSP;
+using Threading::Thread;
+using Threading::ThreadSP;
+
+//******************************************************************************
+// Runs all the benchmarks, one after the other. The current thread must be
+// able to sleep.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the results.
+//******************************************************************************
+void Benchmarks::Run(Core::Debugger& p_rDebugger)
+{
+    p_rDebugger << "Benchmark Cycles\n";
+    Switch(p_rDebugger);
+    SpinLocks(p_rDebugger);
+    Mutexes(p_rDebugger);
+    Atomics(p_rDebugger);
+}
+
+//******************************************************************************
+// Writes the result of a benchmark.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the result.
+//  p_pName     - The name of the benchmark.
+//  p_Cycles    - The cycles taken by all the runs.
+//  p_Runs      - The number of runs.
+//******************************************************************************
+void Benchmarks::Report(Core::Debugger& p_rDebugger, const char* p_pName, unsigned long long p_Cycles, unsigned p_Runs)
+{
+    p_rDebugger << p_pName << ' ' << p_Cycles / p_Runs << "\n";
+}
+
+//******************************************************************************
+// Times the switches between two threads of the same process that keep giving
+// the processor to each other, so that only the switch itself and the
+// scheduler bookkeeping around it are measured.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the result.
+//******************************************************************************
+void Benchmarks::Switch(Core::Debugger& p_rDebugger)
+{
+    // The process stays with the pager, like all the others, since its
+    // threads may still be exiting when we're done.
+    ProcessSP spProcess(new Process());
+    g_pPager->AddPageable(spProcess);
+
+    PingPong pingPong;
+    pingPong.m_Done = false;
+    pingPong.m_Cycles = 0;
+    ThreadSP spPing(new Thread(spProcess, &PingEntry, &pingPong));
+    ThreadSP spPong(new Thread(spProcess, &PongEntry, &pingPong));
+    pingPong.m_pPing = spPing.get();
+    pingPong.m_pPong = spPong.get();
+
+    g_pScheduler->AddThread(spPong);
+    g_pScheduler->AddThread(spPing);
+    pingPong.m_Finished.Wait();
+
+    // Each iteration of the ping thread switches twice
+    Report(p_rDebugger, "Switch", pingPong.m_Cycles, 2 * ITERATIONS);
+}
+
+//******************************************************************************
+// Entry point of the thread that times the switches.
+//
+// Parameters:
+//  p_pPingPong - The state of the benchmark.
+//******************************************************************************
+void Benchmarks::PingEntry(void* p_pPingPong)
+{
+    PingPong* pPingPong = static_cast<PingPong*>(p_pPingPong);
+
+    // Let the pong thread start before we time anything
+    g_pScheduler->YieldTo(pPingPong->m_pPong);
+
+    unsigned long long start = Machine::ReadTimestampCounter();
+    for (unsigned i = 0; i < ITERATIONS; ++i) {
+        g_pScheduler->YieldTo(pPingPong->m_pPong);
+    }
+    pPingPong->m_Cycles = Machine::ReadTimestampCounter() - start;
+
+    // The pong thread is the last one to look at the state, so it's the one
+    // that lets the benchmark go on.
+    pPingPong->m_Done = true;
+    g_pScheduler->Exit();
+}
+
+//******************************************************************************
+// Entry point of the thread that gives the processor back to the timing one.
+//
+// Parameters:
+//  p_pPingPong - The state of the benchmark.
+//******************************************************************************
+void Benchmarks::PongEntry(void* p_pPingPong)
+{
+    PingPong* pPingPong = static_cast<PingPong*>(p_pPingPong);
+
+    while (!pPingPong->m_Done) {
+        g_pScheduler->YieldTo(pPingPong->m_pPing);
+    }
+    pPingPong->m_Finished.Post();
+    g_pScheduler->Exit();
+}
+
+//******************************************************************************
+// Times the locking and unlocking of each kind of spin lock when no other
+// processor wants it. The kernel only drives one processor, so that's the
+// throughput of a lock nobody fights for.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the results.
+//******************************************************************************
+void Benchmarks::SpinLocks(Core::Debugger& p_rDebugger)
+{
+    Threading::PreemptLock prelock;
+
+    Threading::SpinLock spinLock("Benchmark");
+    unsigned long long start = Machine::ReadTimestampCounter();
+    for (unsigned i = 0; i < ITERATIONS; ++i) {
+        spinLock.Lock();
+        spinLock.Unlock();
+    }
+    Report(p_rDebugger, "SpinLock", Machine::ReadTimestampCounter() - start, ITERATIONS);
+
+    Threading::QueuedSpinLock queuedSpinLock;
+    Threading::QueuedSpinLock::Node node;
+    start = Machine::ReadTimestampCounter();
+    for (unsigned i = 0; i < ITERATIONS; ++i) {
+        queuedSpinLock.Lock(node);
+        queuedSpinLock.Unlock(node);
+    }
+    Report(p_rDebugger, "QueuedSpinLock", Machine::ReadTimestampCounter() - start, ITERATIONS);
+
+    Threading::RecursiveSpinLock recursiveSpinLock("Benchmark");
+    start = Machine::ReadTimestampCounter();
+    for (unsigned i = 0; i < ITERATIONS; ++i) {
+        recursiveSpinLock.Lock();
+        recursiveSpinLock.Unlock();
+    }
+    Report(p_rDebugger, "RecursiveSpinLock", Machine::ReadTimestampCounter() - start, ITERATIONS);
+}
+
+//******************************************************************************
+// Times the locking and unlocking of a mutex nobody else wants, in each mode.
+// Both only take a single atomic instruction, unless the mutex is adaptive,
+// which also reads the timestamp counter.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the results.
+//******************************************************************************
+void Benchmarks::Mutexes(Core::Debugger& p_rDebugger)
+{
+    static const Threading::Mutex::Modes s_Modes[] = {
+        Threading::Mutex::MODE_COMPETE,
+        Threading::Mutex::MODE_HANDOFF,
+        Threading::Mutex::MODE_ADAPTIVE
+    };
+    static const char* const s_pNames[] = {"CompeteMutex", "HandoffMutex", "AdaptiveMutex"};
+
+    for (size_t i = 0; i < sizeof(s_Modes) / sizeof(s_Modes[0]); ++i) {
+        Threading::Mutex mutex(s_Modes[i], "Benchmark");
+        unsigned long long start = Machine::ReadTimestampCounter();
+        for (unsigned j = 0; j < ITERATIONS; ++j) {
+            mutex.Lock();
+            mutex.Unlock();
+        }
+        Report(p_rDebugger, s_pNames[i], Machine::ReadTimestampCounter() - start, ITERATIONS);
+    }
+}
+
+//******************************************************************************
+// Times each operation of the atomic variables, of 32 and 64 bits, along with
+// the barriers. Nobody else uses the variables, so their cache lines stay with
+// the processor.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the results.
+//******************************************************************************
+void Benchmarks::Atomics(Core::Debugger& p_rDebugger)
+{
+    // Times a statement run over and over, and writes the cycles it takes
+#define BENCHMARK(p_pName, p_Statement)                                                    \
+    {                                                                                      \
+        unsigned long long start = Machine::ReadTimestampCounter();                        \
+        for (unsigned i = 0; i < ITERATIONS; ++i) {                                        \
+            p_Statement;                                                                   \
+        }                                                                                  \
+        Report(p_rDebugger, p_pName, Machine::ReadTimestampCounter() - start, ITERATIONS); \
+    }
+
+    Utilities::Atomic<unsigned> atomic;
+    BENCHMARK("Load",               atomic.Load());
+    BENCHMARK("Store",              atomic.Store(i));
+    BENCHMARK("Exchange",           atomic.Exchange(i));
+    BENCHMARK("CompareExchange",    atomic.CompareExchange(i, i - 1));
+    BENCHMARK("FetchAdd",           atomic.FetchAdd(1));
+    BENCHMARK("FetchSubstract",     atomic.FetchSubstract(1));
+    BENCHMARK("FetchOr",            atomic.FetchOr(i));
+    BENCHMARK("FetchAnd",           atomic.FetchAnd(~i));
+    BENCHMARK("Increment",          ++atomic);
+    BENCHMARK("Decrement",          --atomic);
+
+    Utilities::Atomic<unsigned long long> atomic64;
+    BENCHMARK("Load64",             atomic64.Load());
+    BENCHMARK("Store64",            atomic64.Store(i));
+    BENCHMARK("Exchange64",         atomic64.Exchange(i));
+    BENCHMARK("CompareExchange64",  atomic64.CompareExchange(i, i - 1));
+    BENCHMARK("FetchAdd64",         atomic64.FetchAdd(1));
+
+    BENCHMARK("CompilerBarrier",    Utilities::CompilerBarrier());
+    BENCHMARK("MemoryBarrier",      Utilities::MemoryBarrier());
+
+#undef BENCHMARK
+}
+
+} // namespace System
+} // namespace Nutshell
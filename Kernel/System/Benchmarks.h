@@ -0,0 +1,62 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef SYSTEM_BENCHMARKS_H
+#define SYSTEM_BENCHMARKS_H
+
+#include "Threading/Thread.h"
+#include "Threading/Semaphore.h"
+
+namespace Nutshell {
+namespace System {
+
+//******************************************************************************
+// This class holds the micro-benchmarks of the kernel primitives. Each one
+// times many runs of a primitive with the timestamp counter, and writes the
+// average number of cycles per run. They run in the system process at boot
+// when the kernel is built with _BENCHMARKS.
+//******************************************************************************
+class Benchmarks {
+private:
+
+    // The number of times each primitive is run
+    static const unsigned ITERATIONS = 100000;
+
+    //**************************************************************************
+    // This holds the state shared by the threads of the switch benchmark.
+    struct PingPong {
+        Threading::Thread*      m_pPing;        // The thread that times the switches.
+        Threading::Thread*      m_pPong;        // The thread that switches back to it.
+        volatile bool           m_Done;         // Whether the switches are timed.
+        unsigned long long      m_Cycles;       // The cycles taken by all the switches.
+        Threading::Semaphore    m_Finished;     // Posted once the threads are done with the state.
+    };
+
+public:
+
+    // Benchmarks management
+    static void Run(Core::Debugger& p_rDebugger);
+
+private:
+
+    // Output
+    static void Report(Core::Debugger& p_rDebugger, const char* p_pName, unsigned long long p_Cycles, unsigned p_Runs);
+
+    // Context switches
+    static void Switch(Core::Debugger& p_rDebugger);
+    static void PingEntry(void* p_pPingPong);
+    static void PongEntry(void* p_pPingPong);
+
+    // Locks
+    static void SpinLocks(Core::Debugger& p_rDebugger);
+    static void Mutexes(Core::Debugger& p_rDebugger);
+
+    // Atomic operations
+    static void Atomics(Core::Debugger& p_rDebugger);
+};
+
+} // namespace System
+} // namespace Nutshell
+
+#endif // !SYSTEM_BENCHMARKS_H
@@ -3,13 +3,20 @@
 //******************************************************************************
 
 #include "Global.h"
+#include "Threading/Scheduler.h"
+#include "System/Benchmarks.h"
 
 //******************************************************************************
 // System process entry point.
 //******************************************************************************
 extern "C" void Main(void*)
 {
+    BENCHMARKSCODE(Nutshell::System::Benchmarks::Run(*Nutshell::g_pDebugger));
+
+    // There is nothing to do yet. Sleep rather than spin, so that the idle
+    // thread gets to halt the processor.
     while (1) {
+        Nutshell::g_pScheduler->SleepUntil(Nutshell::Threading::INFINITE_DEADLINE);
     }
 
     PANIC("In system process!");
@@ -0,0 +1,95 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/ConditionVariable.h"
+#include "Threading/Mutex.h"
+#include "Threading/Scheduler.h"
+#include "Threading/PreemptLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+ConditionVariable::ConditionVariable()
+:   m_pMutex(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+ConditionVariable::~ConditionVariable()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Unlocks a mutex and waits for the condition variable to be signaled. The
+// mutex is locked again before returning, even if the deadline passed. The
+// current thread must hold the mutex exactly once, and all waiters must use
+// the same mutex.
+//
+// Parameters:
+//  p_rMutex    - The mutex that protects the condition.
+//  p_Deadline  - The tick at which we stop waiting.
+//
+// Returns:
+//  Whether the condition variable was signaled before the deadline.
+//******************************************************************************
+bool ConditionVariable::Wait(Mutex& p_rMutex, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    Thread* pCurrent = g_pScheduler->Current();
+    assert(p_rMutex.Owner() == pCurrent);
+    assert(p_rMutex.m_Count == 1);
+
+    bool signaled;
+    {
+        PreemptLock prelock;
+        Locker<SpinLock> lock(m_SpinLock);
+        assert(m_pMutex == 0 || m_pMutex == &p_rMutex);
+        m_pMutex = &p_rMutex;
+
+        // Signals need our spin lock, so none is lost between these two
+        p_rMutex.Unlock();
+        signaled = g_pScheduler->Sleep(this, &m_SpinLock, p_Deadline);
+    }
+
+    // A signal may have moved us to the waiters of the mutex after our deadline
+    return p_rMutex.Relock(pCurrent) || signaled;
+}
+
+//******************************************************************************
+// Signals the condition variable, releasing the thread that has been waiting
+// the longest.
+//******************************************************************************
+void ConditionVariable::Signal()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    if (m_pMutex != 0) m_pMutex->Requeue(this);
+}
+
+//******************************************************************************
+// Signals the condition variable, releasing all the threads that wait on it.
+//******************************************************************************
+void ConditionVariable::Broadcast()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    if (m_pMutex != 0) {
+        while (m_pMutex->Requeue(this)) {}
+    }
+}
+
+} // namespace Threading
+} // namespace Nutshell
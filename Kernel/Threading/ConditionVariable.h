@@ -0,0 +1,42 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_CONDITIONVARIABLE_H
+#define THREADING_CONDITIONVARIABLE_H
+
+#include "Threading/SpinLock.h"
+#include "Threading/Timer.h"
+
+namespace Nutshell {
+namespace Threading {
+
+class Mutex;
+
+//******************************************************************************
+// This class encapsulates a condition variable, used along with a mutex.
+// Signaled threads are moved to the waiters of the mutex instead of being
+// waked up, so they only run once they can actually lock it.
+//******************************************************************************
+class ConditionVariable : boost::noncopyable {
+private:
+
+    Mutex*      m_pMutex;   // The mutex used by the last waiter.
+    SpinLock    m_SpinLock; // The spin lock that protects the condition variable.
+
+public:
+
+    // Construction / destruction
+    ConditionVariable();
+    ~ConditionVariable();
+
+    // Condition variable manipulation
+    bool    Wait(Mutex& p_rMutex, unsigned long long p_Deadline = INFINITE_DEADLINE);
+    void    Signal();
+    void    Broadcast();
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_CONDITIONVARIABLE_H
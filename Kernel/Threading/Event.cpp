@@ -38,13 +38,38 @@ void Event::Signal()
 
 //******************************************************************************
 // Waits for the event to be signaled.
+//
+// Parameters:
+//  p_Deadline - The tick at which we stop waiting.
+//
+// Returns:
+//  Whether the event was signaled before the deadline.
 //******************************************************************************
-void Event::Wait()
+bool Event::Wait(unsigned long long p_Deadline)
 {
     assert(this != 0);
 
     // Wait until we're waked up
-    g_pScheduler->Sleep(this);
+    return g_pScheduler->Sleep(this, 0, p_Deadline);
+}
+
+//******************************************************************************
+// Signals the event, and waits for another one to be signaled.  The thread
+// that waited the longest for this event runs right away on what's left of
+// our time slice, rather than whenever the scheduler gets to it.
+//
+// Parameters:
+//  p_rReply    - The event to wait for.
+//  p_Deadline  - The tick at which we stop waiting.
+//
+// Returns:
+//  Whether the reply was signaled before the deadline.
+//******************************************************************************
+bool Event::SignalAndWait(Event& p_rReply, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+
+    return g_pScheduler->WakeUpAndSleep(this, &p_rReply, p_Deadline);
 }
 
 } // namespace Threading
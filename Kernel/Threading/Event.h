@@ -6,6 +6,7 @@
 #define THREADING_EVENT_H
 
 #include "Threading/SpinLock.h"
+#include "Threading/Timer.h"
 
 namespace Nutshell {
 namespace Threading {
@@ -27,7 +28,8 @@ public:
 
     // Event manipulation
     void Signal();
-    void Wait();
+    bool Wait(unsigned long long p_Deadline = INFINITE_DEADLINE);
+    bool SignalAndWait(Event& p_rReply, unsigned long long p_Deadline = INFINITE_DEADLINE);
 };
 
 } // namespace Threading
@@ -96,6 +96,82 @@ public:
     }
 };
 
+//******************************************************************************
+// This class allows exception safe scoped locking of an object for reading.
+//******************************************************************************
+template<typename TYPE>
+class ReadLocker : boost::noncopyable {
+private:
+    
+    TYPE&   m_rObject;  // The object we hold a read lock on.
+
+public:
+
+    //**************************************************************************
+    // Constructor.
+    //
+    // Parameters:
+    //  p_rObject - The object to lock.
+    //**************************************************************************
+    ReadLocker(TYPE& p_rObject)
+    :   m_rObject(p_rObject)
+    {
+        assert(this != 0);
+
+        // Lock the object for reading
+        m_rObject.LockRead();
+    }
+
+    //**************************************************************************
+    // Destructor.
+    //**************************************************************************
+    ~ReadLocker()
+    {
+        assert(this != 0);
+
+        // Unlock the object
+        m_rObject.UnlockRead();
+    }
+};
+
+//******************************************************************************
+// This class allows exception safe scoped locking of an object for writing.
+//******************************************************************************
+template<typename TYPE>
+class WriteLocker : boost::noncopyable {
+private:
+    
+    TYPE&   m_rObject;  // The object we hold a write lock on.
+
+public:
+
+    //**************************************************************************
+    // Constructor.
+    //
+    // Parameters:
+    //  p_rObject - The object to lock.
+    //**************************************************************************
+    WriteLocker(TYPE& p_rObject)
+    :   m_rObject(p_rObject)
+    {
+        assert(this != 0);
+
+        // Lock the object for writing
+        m_rObject.LockWrite();
+    }
+
+    //**************************************************************************
+    // Destructor.
+    //**************************************************************************
+    ~WriteLocker()
+    {
+        assert(this != 0);
+
+        // Unlock the object
+        m_rObject.UnlockWrite();
+    }
+};
+
 //******************************************************************************
 // This class allows exception safe scoped unlocking of an object.
 //******************************************************************************
@@ -0,0 +1,174 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/LatencyTracer.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+LatencyTracer::LatencyTracer()
+:   m_WorstCount(0),
+    m_Best(0)
+{
+    assert(this != 0);
+
+    std::fill(&m_Histograms[0][0], &m_Histograms[0][0] + CLASSES * BUCKETS, 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+LatencyTracer::~LatencyTracer()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Records the latency of a thread that was woken up.
+//
+// Parameters:
+//  p_Class     - The priority class of the thread.
+//  p_Latency   - The time between its wake up and the moment it ran, in cycles.
+//  p_Time      - The timestamp at which it ran.
+//  p_pThread   - The thread that was woken up.
+//  p_pRunning  - The thread that was running until then.
+//******************************************************************************
+void LatencyTracer::Record(size_t p_Class, unsigned long long p_Latency, unsigned long long p_Time, const Thread* p_pThread, const Thread* p_pRunning)
+{
+    assert(this != 0);
+    assert(p_Class < CLASSES);
+
+    // Count it in the histogram of its class
+    ++m_Histograms[p_Class][Bucket(p_Latency)];
+
+    // Check if it's one of the worst latencies, in which case it replaces the
+    // smallest one we have.
+    Event* pEvent;
+    if (m_WorstCount < WORST) {
+        pEvent = &m_Worst[m_WorstCount++];
+    } else if (p_Latency > m_Worst[m_Best].m_Latency) {
+        pEvent = &m_Worst[m_Best];
+    } else {
+        return;
+    }
+    pEvent->m_Latency   = p_Latency;
+    pEvent->m_Time      = p_Time;
+    pEvent->m_pThread   = p_pThread;
+    pEvent->m_pRunning  = p_pRunning;
+    pEvent->m_Class     = p_Class;
+
+    // Find the smallest of the worst latencies again
+    m_Best = 0;
+    for (size_t i = 1; i < m_WorstCount; ++i) {
+        if (m_Worst[i].m_Latency < m_Worst[m_Best].m_Latency) m_Best = i;
+    }
+}
+
+//******************************************************************************
+// Replaces the latencies with a copy of those of another tracer.
+//
+// Parameters:
+//  p_rOther - The tracer to copy.
+//******************************************************************************
+void LatencyTracer::Copy(const LatencyTracer& p_rOther)
+{
+    assert(this != 0);
+    assert(&p_rOther != this);
+
+    std::copy(&p_rOther.m_Histograms[0][0], &p_rOther.m_Histograms[0][0] + CLASSES * BUCKETS, &m_Histograms[0][0]);
+    std::copy(p_rOther.m_Worst, p_rOther.m_Worst + p_rOther.m_WorstCount, m_Worst);
+    m_WorstCount    = p_rOther.m_WorstCount;
+    m_Best          = p_rOther.m_Best;
+}
+
+//******************************************************************************
+// Writes the histograms and the worst latencies to the debugger.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the output.
+//******************************************************************************
+void LatencyTracer::Dump(Core::Debugger& p_rDebugger) const
+{
+    assert(this != 0);
+
+    // Write the non empty buckets of each class. Bucket n holds latencies of
+    // 2^n cycles up to 2^(n+1) cycles excluded.
+    for (size_t i = 0; i < CLASSES; ++i) {
+        p_rDebugger << "Class " << static_cast<unsigned>(i) << ":";
+        for (size_t j = 0; j < BUCKETS; ++j) {
+            if (m_Histograms[i][j] == 0) continue;
+            p_rDebugger << " 2^" << static_cast<unsigned>(j) << "=" << m_Histograms[i][j];
+        }
+        p_rDebugger << "\n";
+    }
+
+    // Write the worst latencies
+    p_rDebugger << "Latency Class Time Thread Running\n";
+    for (size_t i = 0; i < m_WorstCount; ++i) {
+        const Event& event = m_Worst[i];
+        p_rDebugger << event.m_Latency << ' '
+                    << static_cast<unsigned>(event.m_Class) << ' '
+                    << event.m_Time << ' '
+                    << static_cast<void*>(const_cast<Thread*>(event.m_pThread)) << ' '
+                    << static_cast<void*>(const_cast<Thread*>(event.m_pRunning)) << "\n";
+    }
+}
+
+//******************************************************************************
+// Returns the number of latencies counted in a histogram bucket.
+//
+// Parameters:
+//  p_Class  - The priority class of the histogram.
+//  p_Bucket - The bucket, which holds latencies of 2^p_Bucket cycles up to
+//             2^(p_Bucket+1) cycles excluded.
+//******************************************************************************
+unsigned long long LatencyTracer::Count(size_t p_Class, size_t p_Bucket) const
+{
+    assert(this != 0);
+    assert(p_Class < CLASSES);
+    assert(p_Bucket < BUCKETS);
+
+    return m_Histograms[p_Class][p_Bucket];
+}
+
+//******************************************************************************
+// Returns the worst latency so far, in processor cycles, or 0 if none was
+// recorded.
+//******************************************************************************
+unsigned long long LatencyTracer::Worst() const
+{
+    assert(this != 0);
+
+    unsigned long long worst = 0;
+    for (size_t i = 0; i < m_WorstCount; ++i) {
+        worst = std::max(worst, m_Worst[i].m_Latency);
+    }
+
+    return worst;
+}
+
+//******************************************************************************
+// Returns the histogram bucket of a latency: the index of its most significant
+// bit.
+//
+// Parameters:
+//  p_Latency - The latency, in processor cycles.
+//******************************************************************************
+size_t LatencyTracer::Bucket(unsigned long long p_Latency)
+{
+    unsigned high = static_cast<unsigned>(p_Latency >> 32);
+    if (high != 0) return 32 + Utilities::BitScanRight(high);
+
+    // A latency of 0 goes in the first bucket, along with a latency of 1
+    int bit = Utilities::BitScanRight(static_cast<unsigned>(p_Latency));
+
+    return bit < 0 ? 0 : bit;
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,72 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_LATENCYTRACER_H
+#define THREADING_LATENCYTRACER_H
+
+namespace Nutshell {
+namespace Threading {
+
+class Thread;
+
+//******************************************************************************
+// This class collects scheduling latencies: the time between the moment a
+// thread is woken up and the moment it actually runs. Latencies are counted
+// in log2 histograms, one per priority class, and the worst ones are kept
+// along with the thread that was running instead.
+//******************************************************************************
+class LatencyTracer : boost::noncopyable {
+public:
+
+    // The number of priority classes, one per base priority of threads
+    static const size_t CLASSES         = 5;
+
+    // The number of histogram buckets, one per power of 2 of cycles
+    static const size_t BUCKETS         = 64;
+
+private:
+
+    // The number of worst latencies kept
+    static const size_t WORST           = 16;
+
+    //**************************************************************************
+    // This holds information about a latency.
+    struct Event {
+        unsigned long long  m_Latency;  // The latency, in processor cycles.
+        unsigned long long  m_Time;     // The timestamp at which the thread ran.
+        const Thread*       m_pThread;  // The thread that was woken up.
+        const Thread*       m_pRunning; // The thread that was running instead.
+        size_t              m_Class;    // The priority class of the woken up thread.
+    };
+
+    unsigned long long  m_Histograms[CLASSES][BUCKETS]; // The number of latencies in each bucket.
+    Event               m_Worst[WORST];                 // The worst latencies so far, in no particular order.
+    size_t              m_WorstCount;                   // The number of worst latencies kept.
+    size_t              m_Best;                         // The index of the smallest of the worst latencies.
+
+public:
+
+    // Construction / destruction
+    LatencyTracer();
+    ~LatencyTracer();
+
+    // Latencies management
+    void    Record(size_t p_Class, unsigned long long p_Latency, unsigned long long p_Time, const Thread* p_pThread, const Thread* p_pRunning);
+    void    Copy(const LatencyTracer& p_rOther);
+    void    Dump(Core::Debugger& p_rDebugger) const;
+
+    // Misceallenous
+    unsigned long long  Count(size_t p_Class, size_t p_Bucket) const;
+    unsigned long long  Worst() const;
+
+private:
+
+    // Internal helpers
+    static size_t Bucket(unsigned long long p_Latency);
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_LATENCYTRACER_H
@@ -0,0 +1,184 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/LockClass.h"
+#include "Threading/InterruptLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+// Static members
+LockClass LockClass::s_Classes[MAX_CLASSES];
+
+//******************************************************************************
+// Counts an acquisition that didn't have to wait.
+//******************************************************************************
+void LockClass::Acquired()
+{
+    assert(this != 0);
+
+    Add(m_Acquisitions, 1);
+}
+
+//******************************************************************************
+// Counts an acquisition that had to wait for the lock to be released.
+//
+// Parameters:
+//  p_WaitCycles - The number of cycles spent waiting.
+//******************************************************************************
+void LockClass::Contended(unsigned long long p_WaitCycles)
+{
+    assert(this != 0);
+
+    Add(m_Acquisitions, 1);
+    Add(m_Contentions, 1);
+    Add(m_WaitCycles, p_WaitCycles);
+    Raise(m_MaxWaitCycles, p_WaitCycles);
+}
+
+//******************************************************************************
+// Counts iterations spent spinning on a lock.
+//
+// Parameters:
+//  p_Count - The number of iterations.
+//******************************************************************************
+void LockClass::Spun(unsigned long long p_Count)
+{
+    assert(this != 0);
+
+    Add(m_Spins, p_Count);
+}
+
+//******************************************************************************
+// Counts the time a lock was held, once it is released.
+//
+// Parameters:
+//  p_HoldCycles - The number of cycles the lock was held.
+//******************************************************************************
+void LockClass::Released(unsigned long long p_HoldCycles)
+{
+    assert(this != 0);
+
+    Add(m_HoldCycles, p_HoldCycles);
+}
+
+//******************************************************************************
+// Returns the class of the locks with a given name, adding it if needed.
+//
+// Parameters:
+//  p_pName - The name of the locks. It must stay valid forever.
+//******************************************************************************
+LockClass* LockClass::Find(const char* p_pName)
+{
+    assert(p_pName != 0);
+
+    // Locks are usually constructed before interrupts are enabled, but not
+    // always, and the lock being constructed can't protect the table.
+    InterruptLock intlock;
+    for (size_t i = 0; i < MAX_CLASSES - 1; ++i) {
+        LockClass& rClass = s_Classes[i];
+        if (rClass.m_pName == 0) rClass.m_pName = p_pName;
+        if (strcmp(rClass.m_pName, p_pName) == 0) return &rClass;
+    }
+
+    // The table is full, so put the lock with the other ones
+    LockClass& rOther = s_Classes[MAX_CLASSES - 1];
+    rOther.m_pName = "Other";
+
+    return &rOther;
+}
+
+//******************************************************************************
+// Writes the statistics of the classes to the debugger, from the one whose
+// locks were waited for the longest.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the output.
+//******************************************************************************
+void LockClass::Dump(Core::Debugger& p_rDebugger)
+{
+    // Sort the classes that were used
+    const LockClass* classes[MAX_CLASSES];
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_CLASSES; ++i) {
+        if (s_Classes[i].m_pName != 0 && s_Classes[i].m_Acquisitions != 0) classes[count++] = &s_Classes[i];
+    }
+    std::sort(classes, classes + count, &Hotter);
+
+    // Write them. Counters keep changing meanwhile, so they may not add up.
+    p_rDebugger << "Class Acquisitions Contentions Spins Wait MaxWait Hold\n";
+    for (size_t i = 0; i < count; ++i) {
+        const LockClass& rClass = *classes[i];
+        p_rDebugger << rClass.m_pName << ' '
+                    << rClass.m_Acquisitions << ' '
+                    << rClass.m_Contentions << ' '
+                    << rClass.m_Spins << ' '
+                    << rClass.m_WaitCycles << ' '
+                    << rClass.m_MaxWaitCycles << ' '
+                    << rClass.m_HoldCycles << "\n";
+    }
+}
+
+//******************************************************************************
+// Debugger command that writes the statistics of the lock classes.
+//
+// Parameters:
+//  p_pContext  - Unused.
+//  p_rDebugger - The debugger that receives the output.
+//******************************************************************************
+void LockClass::Command(void* p_pContext, Core::Debugger& p_rDebugger)
+{
+    Dump(p_rDebugger);
+}
+
+//******************************************************************************
+// Adds a value to a counter. Locks of the same class may update it at once.
+//
+// Parameters:
+//  p_rValue - The counter.
+//  p_Add    - The value to add.
+//******************************************************************************
+void LockClass::Add(unsigned long long& p_rValue, unsigned long long p_Add)
+{
+    unsigned long long old = p_rValue;
+    for (;;) {
+        unsigned long long current = Utilities::ThreadSafeCompareExchange64(p_rValue, old + p_Add, old);
+        if (current == old) return;
+        old = current;
+    }
+}
+
+//******************************************************************************
+// Raises a counter to a value, if it's lower.
+//
+// Parameters:
+//  p_rValue - The counter.
+//  p_Value  - The value it should at least have.
+//******************************************************************************
+void LockClass::Raise(unsigned long long& p_rValue, unsigned long long p_Value)
+{
+    unsigned long long old = p_rValue;
+    while (old < p_Value) {
+        unsigned long long current = Utilities::ThreadSafeCompareExchange64(p_rValue, p_Value, old);
+        if (current == old) return;
+        old = current;
+    }
+}
+
+//******************************************************************************
+// Returns whether the locks of a class were waited for longer than those of
+// another one.
+//
+// Parameters:
+//  p_pFirst  - The first class.
+//  p_pSecond - The second class.
+//******************************************************************************
+bool LockClass::Hotter(const LockClass* p_pFirst, const LockClass* p_pSecond)
+{
+    return p_pFirst->m_WaitCycles > p_pSecond->m_WaitCycles;
+}
+
+} // namespace Threading
+} // namespace Nutshell
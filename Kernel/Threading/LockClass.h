@@ -0,0 +1,59 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_LOCKCLASS_H
+#define THREADING_LOCKCLASS_H
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class collects contention statistics for all the locks that share a
+// name. Locks only update them when the kernel is built with _LOCKSTAT.
+//
+// Classes live in a fixed table that has no constructor, so that locks built
+// by global constructors can use it before it would have been constructed.
+//******************************************************************************
+class LockClass {
+private:
+
+    // The number of classes in the table. Locks whose name doesn't fit go
+    // in the last one.
+    static const size_t MAX_CLASSES = 64;
+
+    const char*         m_pName;            // The name of the locks of the class.
+    unsigned long long  m_Acquisitions;     // The number of times a lock was acquired.
+    unsigned long long  m_Contentions;      // The number of times a lock was acquired after waiting.
+    unsigned long long  m_Spins;            // The number of iterations spent spinning.
+    unsigned long long  m_WaitCycles;       // The total number of cycles spent waiting.
+    unsigned long long  m_MaxWaitCycles;    // The longest wait, in cycles.
+    unsigned long long  m_HoldCycles;       // The total number of cycles locks were held.
+
+    static LockClass    s_Classes[MAX_CLASSES]; // The known classes.
+
+public:
+
+    // Statistics management
+    void    Acquired();
+    void    Contended(unsigned long long p_WaitCycles);
+    void    Spun(unsigned long long p_Count);
+    void    Released(unsigned long long p_HoldCycles);
+
+    // Classes management
+    static LockClass*   Find(const char* p_pName);
+    static void         Dump(Core::Debugger& p_rDebugger);
+    static void         Command(void* p_pContext, Core::Debugger& p_rDebugger);
+
+private:
+
+    // Internal helpers
+    static void Add(unsigned long long& p_rValue, unsigned long long p_Add);
+    static void Raise(unsigned long long& p_rValue, unsigned long long p_Value);
+    static bool Hotter(const LockClass* p_pFirst, const LockClass* p_pSecond);
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_LOCKCLASS_H
@@ -3,21 +3,39 @@
 //******************************************************************************
 
 #include "Global.h"
+#include "Machine.h"
 #include "Threading/Mutex.h"
 #include "Threading/Scheduler.h"
-#include "Threading/InterruptLock.h"
+#include "Threading/PreemptLock.h"
 
 namespace Nutshell {
 namespace Threading {
 
+// Static members
+QueuedSpinLock Mutex::s_InheritanceLock;
+
 //******************************************************************************
 // Constructor.
+//
+// Parameters:
+//  p_Mode  - How the mutex is released to waiting threads.
+//  p_pName - The name of the class of the mutex, for lock statistics.
 //******************************************************************************
-Mutex::Mutex()
-:   m_pOwner(0),
-    m_Count(0)
+Mutex::Mutex(Modes p_Mode, const char* p_pName)
+:   m_Mode(p_Mode),
+    m_pOwner(0),
+    m_Count(0),
+    m_AcquireTime(0),
+    m_HoldCycles(MAX_SPIN_CYCLES / SPIN_FACTOR),
+    m_pNextHeld(0),
+    m_Linked(false)
 {
     assert(this != 0);
+
+    std::fill(m_Waiters, m_Waiters + Thread::PRIORITY_CLASSES, 0);
+
+    LOCKSTATCODE(m_pClass = LockClass::Find(p_pName));
+    LOCKSTATCODE(m_LockTime = 0);
 }
 
 //******************************************************************************
@@ -34,23 +52,57 @@ Mutex::~Mutex()
 void Mutex::Lock()
 {
     assert(this != 0);
-    InterruptLock intlock;
-    Locker<SpinLock> lock(m_SpinLock);
+
+    // Wait for as long as it takes
+    VERIFY(LockUntil(INFINITE_DEADLINE));
+}
+
+//******************************************************************************
+// Locks the mutex, unless it can't be acquired before a deadline.
+//
+// Parameters:
+//  p_Deadline - The tick at which we stop waiting for the mutex.
+//
+// Returns:
+//  Whether the mutex has been locked.
+//******************************************************************************
+bool Mutex::LockUntil(unsigned long long p_Deadline)
+{
+    assert(this != 0);
 
     // Check if we currently own the mutex
-    if (m_pOwner != g_pScheduler->Current()) {
-        // Loop until we were able to acquire the mutex
-        while (Utilities::ThreadSafeCompareExchange(m_pOwner, g_pScheduler->Current(), 0) != 0) {
-            // Wait for something to happen to the mutex
-            g_pScheduler->Sleep(this, AWAKEN_THREAD_BOOST, &m_SpinLock);
+    Thread* pCurrent = g_pScheduler->Current();
+    if (Owner() != pCurrent) {
+        // If nobody owns the mutex, it becomes ours in a single instruction.
+        // Otherwise we have to wait for it, spinning first in adaptive mode.
+        LOCKSTATCODE(unsigned long long start = Machine::ReadTimestampCounter());
+        LOCKSTATCODE(bool contended = false);
+        if (Utilities::ThreadSafeCompareExchange(m_pOwner, pCurrent, static_cast<Thread*>(0)) != 0) {
+            LOCKSTATCODE(contended = true);
+            if (!(m_Mode == MODE_ADAPTIVE && Spin(pCurrent)) && !Contend(pCurrent, p_Deadline)) return false;
         }
+
+        // Time how long we hold it, to tune how long waiters spin.
+        if (m_Mode == MODE_ADAPTIVE) m_AcquireTime = Machine::ReadTimestampCounter();
+
+#ifdef _LOCKSTAT
+        // Account for the acquisition, and for the wait if there was one
+        m_LockTime = Machine::ReadTimestampCounter();
+        if (contended) {
+            m_pClass->Contended(m_LockTime - start);
+        } else {
+            m_pClass->Acquired();
+        }
+#endif // _LOCKSTAT
     }
 
     // When we get here, the mutex should be ours.
-    assert(m_pOwner == g_pScheduler->Current());
+    assert(Owner() == pCurrent);
 
     // Increment the lock count
     ++m_Count;
+
+    return true;
 }
 
 //******************************************************************************
@@ -59,18 +111,438 @@ void Mutex::Lock()
 void Mutex::Unlock()
 {
     assert(this != 0);
-    assert(m_pOwner == g_pScheduler->Current());
-    InterruptLock intlock;
+    assert(Owner() == g_pScheduler->Current());
+    assert(m_Count > 0);
+
+    // Decrement the lock count, the mutex is released when it reaches 0.
+    if (--m_Count != 0) return;
+
+    LOCKSTATCODE(m_pClass->Released(Machine::ReadTimestampCounter() - m_LockTime));
+
+    // Account for how long we held the mutex. Only the owner writes this, and
+    // spinning waiters don't mind reading it while it changes.
+    if (m_Mode == MODE_ADAPTIVE) {
+        unsigned long long held = Machine::ReadTimestampCounter() - m_AcquireTime;
+        m_HoldCycles = m_HoldCycles - m_HoldCycles / HOLD_WEIGHT + held / HOLD_WEIGHT;
+    }
+
+    // If nobody waits for the mutex, it is released in a single instruction.
+    // Otherwise we have to wake a waiter up.
+    Thread* pCurrent = g_pScheduler->Current();
+    if (Utilities::ThreadSafeCompareExchange(m_pOwner, static_cast<Thread*>(0), pCurrent) != pCurrent) Release();
+}
+
+//******************************************************************************
+// Spins until the mutex is released, as long as its owner is running on
+// another processor and the mutex isn't held longer than usual. This saves
+// the waiter from sleeping and switching when the mutex is only held briefly.
+//
+// Parameters:
+//  p_pThread - The current thread.
+//
+// Returns:
+//  Whether the mutex has been locked. If not, the waiter should sleep.
+//******************************************************************************
+bool Mutex::Spin(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    unsigned long long start = Machine::ReadTimestampCounter();
+    unsigned long long budget = m_HoldCycles * SPIN_FACTOR;
+    if (budget > MAX_SPIN_CYCLES) budget = MAX_SPIN_CYCLES;
+    for (;;) {
+        // Take the mutex as soon as it's released
+        Thread* pOwner = Owner();
+        if (pOwner == 0) {
+            if (Utilities::ThreadSafeCompareExchange(m_pOwner, p_pThread, static_cast<Thread*>(0)) == 0) return true;
+            continue;
+        }
+
+        // Stop spinning if the owner can't release the mutex before it runs
+        // again, or if it holds it for too long.
+        if (!g_pScheduler->Running(pOwner)) return false;
+        if (Machine::ReadTimestampCounter() - start >= budget) return false;
+
+        Utilities::SpinPause();
+        LOCKSTATCODE(m_pClass->Spun(1));
+    }
+}
+
+//******************************************************************************
+// Waits until the mutex can be acquired. This is the slow path of LockUntil,
+// taken when the mutex is owned by another thread.
+//
+// Parameters:
+//  p_pThread   - The current thread.
+//  p_Deadline  - The tick at which we stop waiting for the mutex.
+//  p_Blocked   - Whether the thread is already among the waiters  of  the
+//                mutex, because a condition variable moved it there.
+//
+// Returns:
+//  Whether the mutex has been locked.
+//******************************************************************************
+bool Mutex::Contend(Thread* p_pThread, unsigned long long p_Deadline, bool p_Blocked)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Loop until we were able to acquire the mutex
+    bool blocked = p_Blocked;
+    for (;;) {
+        // Take the mutex if it has been released meanwhile. The mutex may also
+        // have been handed to us directly.
+        Thread* pOwner = m_pOwner;
+        if (pOwner == 0) {
+            if (Utilities::ThreadSafeCompareExchange(m_pOwner, p_pThread, static_cast<Thread*>(0)) == 0) break;
+            continue;
+        }
+        if (Owner() == p_pThread) break;
+
+        // Make sure the owner wakes us up when it unlocks the mutex.  It  may
+        // unlock it in the meantime, which is why we check again.
+        if (pOwner != Waited(pOwner) && Utilities::ThreadSafeCompareExchange(m_pOwner, Waited(pOwner), pOwner) != pOwner) continue;
+
+        // Lend our priority to the owner while we wait
+        if (!blocked) {
+            Block(p_pThread);
+            blocked = true;
+        }
+
+        // Wait for something to happen to the mutex
+        bool waked = g_pScheduler->Sleep(this, &m_SpinLock, p_Deadline);
+
+        // Give up if the deadline has been reached, unless the mutex has been
+        // handed to us at the last moment. Since we might have been waked up
+        // to take the mutex, let another waiter look at it instead.
+        if (!waked && Owner() != p_pThread) {
+            Unblock(p_pThread);
+            if (Waiting()) g_pScheduler->WakeOne(this, &m_SpinLock);
+            return false;
+        }
+    }
+
+    // We no longer wait. If other threads still do, the unlock must wake them
+    // up, and we get their priority meanwhile. Nobody else changes the owner
+    // while we hold the spin lock and own the mutex.
+    if (blocked) Unblock(p_pThread);
+    if (Waiting()) {
+        m_pOwner = Waited(p_pThread);
+        Acquired(p_pThread);
+    }
+
+    return true;
+}
+
+//******************************************************************************
+// Releases the mutex to its waiters. This is the slow path of Unlock, taken
+// when threads wait for the mutex.
+//******************************************************************************
+void Mutex::Release()
+{
+    assert(this != 0);
+    PreemptLock prelock;
     Locker<SpinLock> lock(m_SpinLock);
 
-    // Decrement the lock count
-    --m_Count;
+    // Stop lending the priority of our waiters to the owner
+    Released(Owner());
 
-    // If the lock count has reached 0, release the mutex.
-    if (m_Count == 0) {
-        // Release the mutex
+    // Release the mutex and wake up only the longest waiter, so that the other
+    // ones don't wake up just to go back to sleep. In handoff mode the waiter
+    // becomes the owner before it even runs, unless they all gave up.
+    if (m_Mode == MODE_HANDOFF) {
+        if (g_pScheduler->WakeOne(this, &m_SpinLock, &m_pOwner) == 0) m_pOwner = 0;
+    } else {
         m_pOwner = 0;
-        g_pScheduler->WakeUp(this, &m_SpinLock);
+        g_pScheduler->WakeOne(this, &m_SpinLock);
+    }
+}
+
+//******************************************************************************
+// Moves the thread that has been waiting the longest on a condition variable
+// to the waiters of the mutex, rather than waking it up only to have it wait
+// for the mutex right away. If nobody owns the mutex, the thread is waked  up
+// instead.
+//
+// Parameters:
+//  p_pChannel - The channel on which the thread waits.
+//
+// Returns:
+//  Whether a thread was waiting.
+//******************************************************************************
+bool Mutex::Requeue(void* p_pChannel)
+{
+    assert(this != 0);
+    assert(p_pChannel != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Make sure the owner wakes the thread up when it unlocks the mutex
+    for (;;) {
+        Thread* pOwner = m_pOwner;
+        if (pOwner == 0) return g_pScheduler->WakeOne(p_pChannel) != 0;
+        if (pOwner == Waited(pOwner) || Utilities::ThreadSafeCompareExchange(m_pOwner, Waited(pOwner), pOwner) == pOwner) break;
+    }
+
+    // Move the thread, which now lends its priority to the owner
+    Thread* pThread = g_pScheduler->Requeue(p_pChannel, this);
+    if (pThread != 0) Block(pThread);
+
+    return pThread != 0;
+}
+
+//******************************************************************************
+// Locks the mutex again after waiting on a condition variable.
+//
+// Parameters:
+//  p_pThread - The current thread.
+//
+// Returns:
+//  Whether the thread had been moved to the waiters of the mutex, which means
+//  that the condition variable was signaled.
+//******************************************************************************
+bool Mutex::Relock(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    // Only Requeue blocks a thread on our behalf, and only we unblock it.
+    bool requeued = p_pThread->m_pBlockedOn == this;
+    if (requeued) {
+        LOCKSTATCODE(unsigned long long start = Machine::ReadTimestampCounter());
+        VERIFY(Contend(p_pThread, INFINITE_DEADLINE, true));
+        ++m_Count;
+
+        LOCKSTATCODE(m_LockTime = Machine::ReadTimestampCounter());
+        LOCKSTATCODE(m_pClass->Contended(m_LockTime - start));
+    } else {
+        Lock();
+    }
+
+    return requeued;
+}
+
+//******************************************************************************
+// Returns the thread that currently owns the mutex, or 0 if there's none.
+//******************************************************************************
+Thread* Mutex::Owner() const
+{
+    assert(this != 0);
+
+    return reinterpret_cast<Thread*>(reinterpret_cast<size_t>(m_pOwner) & ~WAITED);
+}
+
+//******************************************************************************
+// Returns the value of the owner word that makes the owner go through the slow
+// path to unlock the mutex.
+//
+// Parameters:
+//  p_pOwner - The thread that owns the mutex.
+//******************************************************************************
+Thread* Mutex::Waited(Thread* p_pOwner)
+{
+    assert(p_pOwner != 0);
+
+    return reinterpret_cast<Thread*>(reinterpret_cast<size_t>(p_pOwner) | WAITED);
+}
+
+//******************************************************************************
+// Returns whether threads wait for the mutex. The mutex spin lock must be held.
+//******************************************************************************
+bool Mutex::Waiting() const
+{
+    assert(this != 0);
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    for (size_t i = 0; i < Thread::PRIORITY_CLASSES; ++i) {
+        if (m_Waiters[i] != 0) return true;
+    }
+
+    return false;
+}
+
+//******************************************************************************
+// Adds a thread to the waiters of the mutex, which raises the priority of the
+// owner if needed and lends it the place of the thread in the ready queues.
+// The mutex spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread that waits for the mutex.
+//******************************************************************************
+void Mutex::Block(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pBlockedOn == 0);
+    PreemptLock prelock;
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    p_pThread->m_pBlockedOn = this;
+    ++m_Waiters[p_pThread->PriorityClass()];
+    Link(Owner());
+    Inherit(Owner());
+    g_pScheduler->Lend(p_pThread, Owner());
+}
+
+//******************************************************************************
+// Removes a thread from the waiters of the mutex, which lowers the priority of
+// the owner if needed. The mutex spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread that no longer waits for the mutex.
+//******************************************************************************
+void Mutex::Unblock(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pBlockedOn == this);
+    PreemptLock prelock;
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    assert(m_Waiters[p_pThread->PriorityClass()] > 0);
+    --m_Waiters[p_pThread->PriorityClass()];
+    p_pThread->m_pBlockedOn = 0;
+    Inherit(Owner());
+}
+
+//******************************************************************************
+// Adds the mutex to those owned by a thread, which inherits the priority of
+// the remaining waiters. The mutex spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread that acquired the mutex.
+//******************************************************************************
+void Mutex::Acquired(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    PreemptLock prelock;
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    Link(p_pThread);
+    Inherit(p_pThread);
+}
+
+//******************************************************************************
+// Removes the mutex from those owned by a thread, which gets back the
+// priority it had without its waiters. The mutex spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread that releases the mutex.
+//******************************************************************************
+void Mutex::Released(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    PreemptLock prelock;
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    // Nothing to do if no thread ever waited while it owned the mutex
+    if (!m_Linked) return;
+
+    // Unlink it from the owned mutexes, it's usually the last one acquired.
+    Mutex** ppMutex = &p_pThread->m_pHeld;
+    while (*ppMutex != this) {
+        assert(*ppMutex != 0);
+        ppMutex = &(*ppMutex)->m_pNextHeld;
+    }
+    *ppMutex = m_pNextHeld;
+    m_pNextHeld = 0;
+    m_Linked = false;
+
+    Inherit(p_pThread);
+}
+
+//******************************************************************************
+// Adds the mutex to those owned by a thread, unless it's already there. Only
+// mutexes that threads wait for are added, since the others can't raise the
+// priority of their owner: the fast paths never touch the list. The
+// inheritance spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread that owns the mutex.
+//******************************************************************************
+void Mutex::Link(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    if (m_Linked) return;
+
+    m_pNextHeld = p_pThread->m_pHeld;
+    p_pThread->m_pHeld = this;
+    m_Linked = true;
+}
+
+//******************************************************************************
+// Returns the best priority among the threads waiting for the mutex, or the
+// worst priority if there are none. The inheritance spin lock must be held.
+//******************************************************************************
+Thread::Priorities Mutex::Highest() const
+{
+    assert(this != 0);
+
+    for (size_t i = 0; i < Thread::PRIORITY_CLASSES; ++i) {
+        if (m_Waiters[i] != 0) return Thread::ClassPriority(i);
+    }
+
+    return Thread::PRIORITY_VERY_LOW;
+}
+
+//******************************************************************************
+// Changes the base priority of a thread, and passes the change on to the
+// owners of the mutex it waits for.
+//
+// Parameters:
+//  p_pThread   - The thread whose priority changes.
+//  p_Priority  - The new base priority.
+//******************************************************************************
+void Mutex::Rebase(Thread* p_pThread, Thread::Priorities p_Priority)
+{
+    assert(p_pThread != 0);
+    PreemptLock prelock;
+    QueuedSpinLockLocker lock(s_InheritanceLock);
+
+    p_pThread->m_Base = p_Priority;
+    Inherit(p_pThread);
+}
+
+//******************************************************************************
+// Brings the effective priority of a thread up to date with its base priority
+// and the waiters of its mutexes. If it changes and the thread itself waits
+// for a mutex, the owner of that mutex is updated in turn, and so on down the
+// chain. The inheritance spin lock must be held.
+//
+// The owners met along the chain are read without their mutex spin lock: this
+// is fine since preemption is disabled and the kernel only drives one
+// processor.
+//
+// Parameters:
+//  p_pThread - The thread to update, or 0 if there's none.
+//******************************************************************************
+void Mutex::Inherit(Thread* p_pThread)
+{
+    while (p_pThread != 0) {
+        // Find the best priority among its own and that of its waiters
+        Thread::Priorities effective = p_pThread->m_Base;
+        for (Mutex* pMutex = p_pThread->m_pHeld; pMutex != 0; pMutex = pMutex->m_pNextHeld) {
+            effective = std::min(effective, pMutex->Highest());
+        }
+
+        // The chain stops as soon as a priority doesn't change
+        if (effective == p_pThread->m_Effective) break;
+
+        // Move the thread to its new priority class among the waiters of the
+        // mutex it waits for, and go on with the owner of that mutex.
+        Mutex* pBlockedOn = p_pThread->m_pBlockedOn;
+        if (pBlockedOn != 0) {
+            --pBlockedOn->m_Waiters[p_pThread->PriorityClass()];
+            ++pBlockedOn->m_Waiters[Thread::PriorityClass(effective)];
+        }
+        p_pThread->m_Effective = effective;
+        p_pThread = pBlockedOn != 0 ? pBlockedOn->Owner() : 0;
     }
 }
 
@@ -7,35 +7,98 @@
 
 #include "Threading/Thread.h"
 #include "Threading/SpinLock.h"
+#include "Threading/QueuedSpinLock.h"
 #include "Threading/Guards.h"
 
 namespace Nutshell {
 namespace Threading {
 
 //******************************************************************************
-// This class encapsulates an mutex.
+// This class encapsulates a mutex. While threads wait for it, its owner runs
+// with the best priority among theirs, and so on down the chain of owners of
+// the mutexes that owners themselves wait for. By default, a released mutex
+// goes to whichever thread gets it first, which avoids convoys; handoff mode
+// is for mutexes that must be acquired in strict FIFO order.
 //******************************************************************************
 class Mutex : boost::noncopyable {
+public:
+
+    // The ways the mutex can be released to waiting threads.
+    enum Modes {
+        MODE_COMPETE    = 0,    // The longest waiter is waked up and competes for the mutex.
+        MODE_HANDOFF    = 1,    // The mutex is handed directly to the longest waiter.
+        MODE_ADAPTIVE   = 2     // Like MODE_COMPETE, but waiters spin while the owner runs.
+    };
+
 private:
 
-    // This  controls the priority boost that a thread that was waiting on the
-    // mutex  gets  when he's woken  up. It should be  just  enough to prevent
-    // starvation from happening among threads of the same priority.
-    static const int AWAKEN_THREAD_BOOST = 1;
+    // The bit of the owner word that is raised while threads wait for the
+    // mutex, so that its owner goes through the slow path to unlock it.
+    static const size_t WAITED = 1;
+
+    // In adaptive mode, waiters spin for up to a multiple of the average time
+    // the mutex is held, within a limit in processor cycles that is about the
+    // cost of sleeping and being waked up. The average  gives  a  weight  of
+    // 1 / HOLD_WEIGHT to the latest hold time.
+    static const unsigned long long SPIN_FACTOR     = 2;
+    static const unsigned long long MAX_SPIN_CYCLES = 20000;
+    static const unsigned long long HOLD_WEIGHT     = 8;
 
-    Thread*             m_pOwner;       // The thread that currently owns the mutex.
+    Modes               m_Mode;         // How the mutex is released to waiting threads.
+    Thread*             m_pOwner;       // The thread that owns the mutex, with the WAITED bit, or 0.
     int                 m_Count;        // The number of times that the mutex has been locked.
     mutable SpinLock    m_SpinLock;     // The spin lock that protects the mutex.
 
+    unsigned long long  m_AcquireTime;  // The timestamp at which the mutex was acquired, in adaptive mode.
+    unsigned long long  m_HoldCycles;   // The average number of cycles the mutex is held, in adaptive mode.
+
+#ifdef _LOCKSTAT
+    LockClass*          m_pClass;       // The class whose statistics the mutex updates.
+    unsigned long long  m_LockTime;     // The timestamp at which the mutex was acquired.
+#endif // _LOCKSTAT
+
+    unsigned                m_Waiters[Thread::PRIORITY_CLASSES];    // The number of waiting threads of each priority class.
+    Mutex*                  m_pNextHeld;                            // The next mutex owned by the same thread.
+    bool                    m_Linked;                               // Whether the mutex is among those its owner holds.
+    static QueuedSpinLock   s_InheritanceLock;                      // The spin lock that protects priority inheritance.
+
+    friend class Thread;
+    friend class ConditionVariable;
+
 public:
 
     // Construction / destruction
-    Mutex();
+    Mutex(Modes p_Mode = MODE_COMPETE, const char* p_pName = "Mutex");
     ~Mutex();
 
     // Mutex management
     void Lock();
+    bool LockUntil(unsigned long long p_Deadline);
     void Unlock();
+
+private:
+
+    // Slow paths
+    bool            Spin(Thread* p_pThread);
+    bool            Contend(Thread* p_pThread, unsigned long long p_Deadline, bool p_Blocked = false);
+    void            Release();
+    Thread*         Owner() const;
+    static Thread*  Waited(Thread* p_pOwner);
+    bool            Waiting() const;
+
+    // Condition variables support
+    bool            Requeue(void* p_pChannel);
+    bool            Relock(Thread* p_pThread);
+
+    // Priority inheritance
+    void                        Block(Thread* p_pThread);
+    void                        Unblock(Thread* p_pThread);
+    void                        Acquired(Thread* p_pThread);
+    void                        Released(Thread* p_pThread);
+    void                        Link(Thread* p_pThread);
+    Thread::Priorities          Highest() const;
+    static void                 Rebase(Thread* p_pThread, Thread::Priorities p_Priority);
+    static void                 Inherit(Thread* p_pThread);
 };
 
 typedef Locker<Mutex> MutexLocker;
@@ -0,0 +1,36 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/PreemptLock.h"
+#include "Threading/Scheduler.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+PreemptLock::PreemptLock()
+{
+    assert(this != 0);
+
+    // Disable preemption, unless there's no scheduler yet to preempt us.
+    m_Disabled = g_pScheduler != 0;
+    if (m_Disabled) g_pScheduler->DisablePreemption();
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+PreemptLock::~PreemptLock()
+{
+    assert(this != 0);
+
+    // Enable preemption back, which may switch right away.
+    if (m_Disabled) g_pScheduler->EnablePreemption();
+}
+
+} // namespace Threading
+} // namespace Nutshell
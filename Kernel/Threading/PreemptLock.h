@@ -0,0 +1,31 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_PREEMPTLOCK_H
+#define THREADING_PREEMPTLOCK_H
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class prevents the current thread from being preempted until  it  is
+// destroyed. Interrupts stay enabled: use it to protect data that interrupt
+// handlers never touch, and InterruptLock for data that they do.
+//******************************************************************************
+class PreemptLock : boost::noncopyable {
+private:
+
+    bool    m_Disabled; // Whether preemption was disabled by us.
+
+public:
+
+    // Construction / destruction
+    PreemptLock();
+    ~PreemptLock();
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_PREEMPTLOCK_H
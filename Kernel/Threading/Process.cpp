@@ -11,10 +11,17 @@ namespace Threading {
 
 //******************************************************************************
 // Constructor.
+//
+// Parameters:
+//  p_Share - The weight of the process, relative to other processes.
 //******************************************************************************
-Process::Process()
+Process::Process(unsigned p_Share)
+:   m_Share(p_Share),
+    m_Ready(),
+    m_MinRuntime(0)
 {
     assert(this != 0);
+    assert(p_Share > 0);
 }
 
 //******************************************************************************
@@ -25,5 +32,31 @@ Process::~Process()
     assert(this != 0);
 }
 
+//******************************************************************************
+// Returns the weight of the process, relative to other processes.
+//******************************************************************************
+unsigned Process::Share() const
+{
+    assert(this != 0);
+
+    return m_Share;
+}
+
+//******************************************************************************
+// Changes the weight of the process, relative  to other processes. Doubling
+// it doubles the share of the processor that the process gets when others
+// compete for it.
+//
+// Parameters:
+//  p_Share - The new weight of the process.
+//******************************************************************************
+void Process::Share(unsigned p_Share)
+{
+    assert(this != 0);
+    assert(p_Share > 0);
+
+    m_Share = p_Share;
+}
+
 } // namespace Threading
 } // namespace Nutshell
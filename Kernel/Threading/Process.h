@@ -6,24 +6,43 @@
 #define THREADING_PROCESS_H
 
 #include "Paging/Pager.h"
+#include "Threading/Schedulable.h"
+#include "Threading/RunQueue.h"
 
 namespace Nutshell {
 namespace Threading {
 
 //******************************************************************************
-// This class encapsulates a process.
+// This class encapsulates a process. The process gets a share of the processor
+// that is split among its threads, no matter how many threads it has.
 //******************************************************************************
 class Process
 :   public Paging::Pageable,
+    public Schedulable,
     boost::noncopyable
 {
+public:
+
+    // The share of the processor that a process gets by default
+    static const unsigned   DEFAULT_SHARE   = NORMAL_WEIGHT;
+
 private:
 
+    unsigned            m_Share;        // The weight of the process, relative to other processes.
+    RunQueue            m_Ready;        // The ready threads of the process.
+    unsigned long long  m_MinRuntime;   // The smallest virtual runtime among the threads, never decreasing.
+
+    friend class Scheduler;
+
 public:
 
     // Construction / destruction
-    Process();
+    Process(unsigned p_Share = DEFAULT_SHARE);
     ~Process();
+
+    // Scheduling information
+    unsigned    Share() const;
+    void        Share(unsigned p_Share);
 };
 
 typedef boost::shared_ptr<Process> ProcessSP;
@@ -0,0 +1,124 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/QueuedSpinLock.h"
+#include "Threading/SpinLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+QueuedSpinLock::QueuedSpinLock()
+:   m_pTail(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+QueuedSpinLock::~QueuedSpinLock()
+{
+    assert(this != 0);
+    assert(m_pTail == 0);
+}
+
+//******************************************************************************
+// Locks the spin lock.
+//
+// Parameters:
+//  p_rNode - The place of the current processor in the queue, which must stay
+//            alive until the lock is released.
+//******************************************************************************
+void QueuedSpinLock::Lock(Node& p_rNode)
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+
+    // Get at the end of the queue, once our node is ready to be seen.
+    p_rNode.m_pNext     = 0;
+    p_rNode.m_Waiting   = true;
+    Utilities::CompilerBarrier();
+    Node* pPrevious = Utilities::ThreadSafeExchange(m_pTail, &p_rNode);
+
+    // If someone was there before us, tell them about us and wait  until  they
+    // hand us the lock. We only read our own node while we wait.
+    if (pPrevious != 0) {
+        pPrevious->m_pNext = &p_rNode;
+        while (p_rNode.m_Waiting) Utilities::SpinPause();
+    }
+
+    // Don't let accesses to the data we protect happen before we got it
+    Utilities::CompilerBarrier();
+}
+
+//******************************************************************************
+// Attempts to lock the spin lock.
+//
+// Parameters:
+//  p_rNode - The place of the current processor in the queue, which must stay
+//            alive until the lock is released.
+//
+// Returns:
+//  Whether we got the lock.
+//******************************************************************************
+bool QueuedSpinLock::TryLock(Node& p_rNode)
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+
+    // We only get the lock if nobody holds it, nor waits for it.
+    p_rNode.m_pNext     = 0;
+    p_rNode.m_Waiting   = false;
+    Utilities::CompilerBarrier();
+    if (Utilities::ThreadSafeCompareExchange(m_pTail, &p_rNode, static_cast<Node*>(0)) != 0) return false;
+
+    // Don't let accesses to the data we protect happen before we got it
+    Utilities::CompilerBarrier();
+
+    return true;
+}
+
+//******************************************************************************
+// Unlocks the spin lock.
+//
+// Parameters:
+//  p_rNode - The node with which the lock was locked.
+//******************************************************************************
+void QueuedSpinLock::Unlock(Node& p_rNode)
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+    assert(m_pTail != 0);
+
+    // Don't let accesses to the data we protect happen after we released it
+    Utilities::CompilerBarrier();
+
+    // If nobody seems to wait after us, try to leave the queue empty.
+    if (p_rNode.m_pNext == 0) {
+        if (Utilities::ThreadSafeCompareExchange(m_pTail, static_cast<Node*>(0), &p_rNode) == &p_rNode) return;
+
+        // Someone just got in the queue, wait until they tell us about them.
+        while (p_rNode.m_pNext == 0) Utilities::SpinPause();
+    }
+
+    // Hand the lock over to the next waiter
+    p_rNode.m_pNext->m_Waiting = false;
+}
+
+//******************************************************************************
+// Returns whether the spin lock is held.
+//******************************************************************************
+bool QueuedSpinLock::Locked() const
+{
+    assert(this != 0);
+
+    return m_pTail != 0;
+}
+
+} // namespace Threading
+} // namespace Nutshell
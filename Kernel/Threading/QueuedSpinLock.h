@@ -0,0 +1,96 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_QUEUEDSPINLOCK_H
+#define THREADING_QUEUEDSPINLOCK_H
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class encapsulates a queued (MCS) spin lock. Each processor that waits
+// for the lock brings its own node and spins on it alone,  so  a  contended
+// lock doesn't have all waiters hammering the same cache line. The lock goes
+// to the waiters in the order they asked for it. It can't be locked
+// recursively.
+//******************************************************************************
+class QueuedSpinLock : boost::noncopyable {
+public:
+
+    //**************************************************************************
+    // The place in the queue of a processor that holds or waits for the lock.
+    // It must stay alive until the lock is released, which is why it usually
+    // lives on the stack of the holder.
+    //**************************************************************************
+    class Node : boost::noncopyable {
+    private:
+
+        Node*   m_pNext;    // The processor that waits after us, if any.
+        bool    m_Waiting;  // Whether we still wait for the lock.
+
+        friend class QueuedSpinLock;
+    };
+
+private:
+
+    Node*   m_pTail;    // The last processor that holds or waits for the lock.
+
+public:
+
+    // Construction / destruction
+    QueuedSpinLock();
+    ~QueuedSpinLock();
+
+    // Spinlock management
+    void    Lock(Node& p_rNode);
+    bool    TryLock(Node& p_rNode);
+    void    Unlock(Node& p_rNode);
+
+    // Spinlock information
+    bool    Locked() const;
+};
+
+//******************************************************************************
+// This class allows exception safe scoped locking of a queued spin lock. It
+// holds the node of the current processor in the queue of the lock.
+//******************************************************************************
+class QueuedSpinLockLocker : boost::noncopyable {
+private:
+
+    QueuedSpinLock&         m_rSpinLock;    // The spin lock we hold.
+    QueuedSpinLock::Node    m_Node;         // Our place in the queue of the lock.
+
+public:
+
+    //**************************************************************************
+    // Constructor.
+    //
+    // Parameters:
+    //  p_rSpinLock - The spin lock to lock.
+    //**************************************************************************
+    QueuedSpinLockLocker(QueuedSpinLock& p_rSpinLock)
+    :   m_rSpinLock(p_rSpinLock)
+    {
+        assert(this != 0);
+
+        // Lock the spin lock
+        m_rSpinLock.Lock(m_Node);
+    }
+
+    //**************************************************************************
+    // Destructor.
+    //**************************************************************************
+    ~QueuedSpinLockLocker()
+    {
+        assert(this != 0);
+
+        // Unlock the spin lock
+        m_rSpinLock.Unlock(m_Node);
+    }
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_QUEUEDSPINLOCK_H
@@ -0,0 +1,102 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/RWLock.h"
+#include "Threading/Scheduler.h"
+#include "Threading/PreemptLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+RWLock::RWLock()
+:   m_Readers(0),
+    m_Writers(0),
+    m_pWriter(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+RWLock::~RWLock()
+{
+    assert(this != 0);
+    assert(m_Readers == 0);
+    assert(m_pWriter == 0);
+}
+
+//******************************************************************************
+// Locks the lock for reading. Readers sleep on the reader count, and writers
+// on the lock itself.
+//******************************************************************************
+void RWLock::LockRead()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Wait until no writer holds or waits for the lock
+    while (m_pWriter != 0 || m_Writers != 0) g_pScheduler->Sleep(&m_Readers, &m_SpinLock);
+
+    ++m_Readers;
+}
+
+//******************************************************************************
+// Unlocks the lock after reading.
+//******************************************************************************
+void RWLock::UnlockRead()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+    assert(m_Readers > 0);
+
+    // The last reader lets the longest waiting writer in
+    if (--m_Readers == 0 && m_Writers != 0) g_pScheduler->WakeOne(this, &m_SpinLock);
+}
+
+//******************************************************************************
+// Locks the lock for writing.
+//******************************************************************************
+void RWLock::LockWrite()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+    assert(m_pWriter != g_pScheduler->Current());
+
+    // Keep new readers out while we wait for the current ones to leave
+    ++m_Writers;
+    while (m_pWriter != 0 || m_Readers != 0) g_pScheduler->Sleep(this, &m_SpinLock);
+    --m_Writers;
+
+    m_pWriter = g_pScheduler->Current();
+}
+
+//******************************************************************************
+// Unlocks the lock after writing. The longest waiting writer goes next, or
+// else all the waiting readers.
+//******************************************************************************
+void RWLock::UnlockWrite()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+    assert(m_pWriter == g_pScheduler->Current());
+
+    m_pWriter = 0;
+    if (m_Writers != 0) {
+        g_pScheduler->WakeOne(this, &m_SpinLock);
+    } else {
+        g_pScheduler->WakeUp(&m_Readers, &m_SpinLock);
+    }
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,49 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_RWLOCK_H
+#define THREADING_RWLOCK_H
+
+#include "Threading/SpinLock.h"
+#include "Threading/Guards.h"
+
+namespace Nutshell {
+namespace Threading {
+
+class Thread;
+
+//******************************************************************************
+// This class encapsulates a reader-writer lock whose waiters sleep. Any number
+// of readers may hold it at once, or a single writer. Writers have the
+// preference: once one waits, new readers wait as well, so that they can't
+// starve it. It can't be locked recursively.
+//******************************************************************************
+class RWLock : boost::noncopyable {
+private:
+
+    unsigned            m_Readers;  // The number of readers that hold the lock.
+    unsigned            m_Writers;  // The number of writers that wait for the lock.
+    Thread*             m_pWriter;  // The writer that holds the lock, if any.
+    mutable SpinLock    m_SpinLock; // The spin lock that protects the lock.
+
+public:
+
+    // Construction / destruction
+    RWLock();
+    ~RWLock();
+
+    // Lock management
+    void    LockRead();
+    void    UnlockRead();
+    void    LockWrite();
+    void    UnlockWrite();
+};
+
+typedef ReadLocker<RWLock> RWLockReadLocker;
+typedef WriteLocker<RWLock> RWLockWriteLocker;
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_RWLOCK_H
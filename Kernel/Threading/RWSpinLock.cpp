@@ -0,0 +1,94 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/RWSpinLock.h"
+#include "Threading/SpinLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+RWSpinLock::RWSpinLock()
+:   m_State(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+RWSpinLock::~RWSpinLock()
+{
+    assert(this != 0);
+    assert(m_State == 0);
+}
+
+//******************************************************************************
+// Locks the spin lock for reading.
+//******************************************************************************
+void RWSpinLock::LockRead()
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+
+    // Count ourselves among the readers once no writer holds or waits for the
+    // lock.
+    for (;;) {
+        unsigned state = m_State;
+        if ((state & (WRITER | WAITING)) == 0 && Utilities::ThreadSafeCompareExchange(m_State, state + READER, state) == state) break;
+        Utilities::SpinPause();
+    }
+}
+
+//******************************************************************************
+// Unlocks the spin lock after reading.
+//******************************************************************************
+void RWSpinLock::UnlockRead()
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+    assert(m_State >= READER);
+
+    Utilities::ThreadSafeExchangeAdd(m_State, 0u - READER);
+}
+
+//******************************************************************************
+// Locks the spin lock for writing.
+//******************************************************************************
+void RWSpinLock::LockWrite()
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+
+    // Take the lock once nobody holds it. Until then, tell new readers that we
+    // wait: the flag may have been cleared by another writer that got the
+    // lock before us.
+    for (;;) {
+        unsigned state = m_State;
+        if ((state & ~WAITING) == 0) {
+            if (Utilities::ThreadSafeCompareExchange(m_State, WRITER, state) == state) break;
+            continue;
+        }
+        if ((state & WAITING) == 0) Utilities::ThreadSafeCompareExchange(m_State, state | WAITING, state);
+        Utilities::SpinPause();
+    }
+}
+
+//******************************************************************************
+// Unlocks the spin lock after writing. Other waiting writers keep their flag.
+//******************************************************************************
+void RWSpinLock::UnlockWrite()
+{
+    assert(this != 0);
+    assert(SpinLock::Protected());
+    assert((m_State & WRITER) != 0);
+
+    Utilities::ThreadSafeExchangeAdd(m_State, 0u - WRITER);
+}
+
+} // namespace Threading
+} // namespace Nutshell
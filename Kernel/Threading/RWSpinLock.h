@@ -0,0 +1,48 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_RWSPINLOCK_H
+#define THREADING_RWSPINLOCK_H
+
+#include "Threading/Guards.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class encapsulates a reader-writer spin lock. Any number of readers may
+// hold it at once, or a single writer. Writers have the preference: once one
+// waits, new readers wait as well, so that they can't starve it. It can't be
+// locked recursively.
+//******************************************************************************
+class RWSpinLock : boost::noncopyable {
+private:
+
+    // The bits of the state of the lock
+    static const unsigned WRITER    = 1;    // Raised while a writer holds the lock.
+    static const unsigned WAITING   = 2;    // Raised while a writer waits for the lock.
+    static const unsigned READER    = 4;    // Added for each reader that holds the lock.
+
+    unsigned    m_State;    // The state of the lock.
+
+public:
+
+    // Construction / destruction
+    RWSpinLock();
+    ~RWSpinLock();
+
+    // Spinlock management
+    void    LockRead();
+    void    UnlockRead();
+    void    LockWrite();
+    void    UnlockWrite();
+};
+
+typedef ReadLocker<RWSpinLock> RWSpinLockReadLocker;
+typedef WriteLocker<RWSpinLock> RWSpinLockWriteLocker;
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_RWSPINLOCK_H
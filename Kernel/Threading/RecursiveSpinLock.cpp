@@ -0,0 +1,102 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Machine.h"
+#include "Threading/RecursiveSpinLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_pName - The name of the class of the lock, for lock statistics.
+//******************************************************************************
+RecursiveSpinLock::RecursiveSpinLock(const char* p_pName)
+:   m_SpinLock(p_pName),
+    m_Owner(0),
+    m_Count(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+RecursiveSpinLock::~RecursiveSpinLock()
+{
+    assert(this != 0);
+    assert(m_Owner == 0);
+}
+
+//******************************************************************************
+// Locks the spin lock.
+//******************************************************************************
+void RecursiveSpinLock::Lock()
+{
+    assert(this != 0);
+
+    // Only wait for the lock if we don't already hold it. The owner can only
+    // be us if we set it ourselves.
+    int descriptor = Machine::GetCurrentTaskDescriptor();
+    if (m_Owner != descriptor) {
+        m_SpinLock.Lock();
+        m_Owner = descriptor;
+    }
+
+    ++m_Count;
+}
+
+//******************************************************************************
+// Attempts to lock the spin lock.
+//
+// Returns:
+//  Whether we got the lock.
+//******************************************************************************
+bool RecursiveSpinLock::TryLock()
+{
+    assert(this != 0);
+
+    // Attempt to get the lock once, unless we already hold it.
+    int descriptor = Machine::GetCurrentTaskDescriptor();
+    if (m_Owner != descriptor) {
+        if (!m_SpinLock.TryLock()) return false;
+        m_Owner = descriptor;
+    }
+
+    ++m_Count;
+    return true;
+}
+
+//******************************************************************************
+// Unlocks the spin lock.
+//******************************************************************************
+void RecursiveSpinLock::Unlock()
+{
+    assert(this != 0);
+    assert(m_Owner == Machine::GetCurrentTaskDescriptor());
+    assert(m_Count > 0);
+
+    // Release the lock if the lock count drops to zero
+    if (--m_Count == 0) {
+        m_Owner = 0;
+        m_SpinLock.Unlock();
+    }
+}
+
+//******************************************************************************
+// Returns the number of times the spinlock have been recursively locked.
+//******************************************************************************
+size_t RecursiveSpinLock::Count() const
+{
+    assert(this != 0);
+    assert(m_Owner == Machine::GetCurrentTaskDescriptor());
+
+    return m_Count;
+}
+
+} // namespace Threading
+} // namespace Nutshell
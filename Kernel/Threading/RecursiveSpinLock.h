@@ -0,0 +1,46 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_RECURSIVESPINLOCK_H
+#define THREADING_RECURSIVESPINLOCK_H
+
+#include "Threading/SpinLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class encapsulates a spin lock that its holder may lock again, as long
+// as it unlocks it as many times.
+//******************************************************************************
+class RecursiveSpinLock : boost::noncopyable {
+private:
+
+    SpinLock    m_SpinLock; // The spin lock that is actually held.
+    int         m_Owner;    // The task descriptor that owns the spin lock.
+    size_t      m_Count;    // The number of times we've been locked.
+
+public:
+
+    // Construction / destruction
+    explicit RecursiveSpinLock(const char* p_pName = "RecursiveSpinLock");
+    ~RecursiveSpinLock();
+
+    // Spinlock management
+    void    Lock();
+    bool    TryLock();
+    void    Unlock();
+
+    // Spinlock information
+    size_t  Count() const;
+};
+
+typedef Locker<RecursiveSpinLock> RecursiveSpinLockLocker;
+typedef TryLocker<RecursiveSpinLock> RecursiveSpinLockTryLocker;
+typedef Unlocker<RecursiveSpinLock> RecursiveSpinLockUnlocker;
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_RECURSIVESPINLOCK_H
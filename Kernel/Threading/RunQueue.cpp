@@ -0,0 +1,221 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/RunQueue.h"
+#include "Threading/Schedulable.h"
+
+namespace Nutshell {
+namespace Threading {
+
+#ifdef _SIMULATOR_
+unsigned long long RunQueue::s_Comparisons = 0;
+#endif // _SIMULATOR_
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_Order - How the schedulables are ordered.
+//******************************************************************************
+RunQueue::RunQueue(Orders p_Order)
+:   m_Order(p_Order),
+    m_Heap()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+RunQueue::~RunQueue()
+{
+    assert(this != 0);
+    assert(m_Heap.empty());
+}
+
+//******************************************************************************
+// Adds a schedulable to the queue, according to its current virtual runtime or
+// deadline.
+//
+// Parameters:
+//  p_pSchedulable - The schedulable to add to the queue.
+//******************************************************************************
+void RunQueue::Enqueue(Schedulable* p_pSchedulable)
+{
+    assert(this != 0);
+    assert(p_pSchedulable != 0);
+    assert(p_pSchedulable->m_ReadyIndex == Schedulable::NOT_READY);
+
+    // Add the schedulable at the bottom of the heap and move it up to its place
+    m_Heap.push_back(0);
+    Place(p_pSchedulable, m_Heap.size() - 1);
+    SiftUp(p_pSchedulable->m_ReadyIndex);
+}
+
+//******************************************************************************
+// Removes the schedulable that comes first from the queue.
+//
+// Returns:
+//  The schedulable that was removed, or 0 if the queue is empty.
+//******************************************************************************
+Schedulable* RunQueue::Dequeue()
+{
+    assert(this != 0);
+
+    // Take the schedulable at the top of the heap, if any
+    Schedulable* pSchedulable = Front();
+    if (pSchedulable != 0) Remove(pSchedulable);
+
+    return pSchedulable;
+}
+
+//******************************************************************************
+// Removes a schedulable from anywhere within the queue.
+//
+// Parameters:
+//  p_pSchedulable - The schedulable to remove from the queue.
+//******************************************************************************
+void RunQueue::Remove(Schedulable* p_pSchedulable)
+{
+    assert(this != 0);
+    assert(p_pSchedulable != 0);
+    assert(p_pSchedulable->m_ReadyIndex < m_Heap.size());
+    assert(m_Heap[p_pSchedulable->m_ReadyIndex] == p_pSchedulable);
+
+    // Fill the hole with the last schedulable of the heap, and move it to
+    // where it now belongs.
+    size_t index = p_pSchedulable->m_ReadyIndex;
+    Schedulable* pLast = m_Heap.back();
+    m_Heap.pop_back();
+    if (pLast != p_pSchedulable) {
+        Place(pLast, index);
+        SiftUp(index);
+        SiftDown(pLast->m_ReadyIndex);
+    }
+
+    // The schedulable no longer belongs to the queue
+    p_pSchedulable->m_ReadyIndex = Schedulable::NOT_READY;
+}
+
+//******************************************************************************
+// Returns the schedulable that comes first, or 0 if the queue is empty.
+//******************************************************************************
+Schedulable* RunQueue::Front() const
+{
+    assert(this != 0);
+
+    return m_Heap.empty() ? 0 : m_Heap.front();
+}
+
+//******************************************************************************
+// Returns whether the queue is empty.
+//******************************************************************************
+bool RunQueue::Empty() const
+{
+    assert(this != 0);
+
+    return m_Heap.empty();
+}
+
+//******************************************************************************
+// Returns the number of schedulables in the queue.
+//******************************************************************************
+size_t RunQueue::Size() const
+{
+    assert(this != 0);
+
+    return m_Heap.size();
+}
+
+//******************************************************************************
+// Returns whether a schedulable comes before another one.
+//
+// Parameters:
+//  p_pFirst    - The first schedulable.
+//  p_pSecond   - The second schedulable.
+//******************************************************************************
+bool RunQueue::Before(const Schedulable* p_pFirst, const Schedulable* p_pSecond) const
+{
+    assert(this != 0);
+
+#ifdef _SIMULATOR_
+    ++s_Comparisons;
+#endif // _SIMULATOR_
+
+    if (m_Order == ORDER_DEADLINE) return p_pFirst->m_Deadline < p_pSecond->m_Deadline;
+
+    return p_pFirst->m_Runtime < p_pSecond->m_Runtime;
+}
+
+//******************************************************************************
+// Stores a schedulable at a specific position within the heap.
+//
+// Parameters:
+//  p_pSchedulable - The schedulable to store.
+//  p_Index   - The position at which to store it.
+//******************************************************************************
+void RunQueue::Place(Schedulable* p_pSchedulable, size_t p_Index)
+{
+    assert(this != 0);
+    assert(p_Index < m_Heap.size());
+
+    m_Heap[p_Index] = p_pSchedulable;
+    p_pSchedulable->m_ReadyIndex = p_Index;
+}
+
+//******************************************************************************
+// Moves a schedulable up the heap until its parent doesn't run after it.
+//
+// Parameters:
+//  p_Index - The position of the schedulable to move.
+//******************************************************************************
+void RunQueue::SiftUp(size_t p_Index)
+{
+    assert(this != 0);
+    assert(p_Index < m_Heap.size());
+
+    Schedulable* pSchedulable = m_Heap[p_Index];
+    while (p_Index > 0) {
+        // Stop when the parent should run first
+        size_t parent = (p_Index - 1) / 2;
+        if (!Before(pSchedulable, m_Heap[parent])) break;
+
+        // Move the parent down
+        Place(m_Heap[parent], p_Index);
+        p_Index = parent;
+    }
+    Place(pSchedulable, p_Index);
+}
+
+//******************************************************************************
+// Moves a schedulable down the heap until its children don't run before it.
+//
+// Parameters:
+//  p_Index - The position of the schedulable to move.
+//******************************************************************************
+void RunQueue::SiftDown(size_t p_Index)
+{
+    assert(this != 0);
+    assert(p_Index < m_Heap.size());
+
+    Schedulable* pSchedulable = m_Heap[p_Index];
+    for (;;) {
+        // Find the child that should run first, if any
+        size_t child = 2 * p_Index + 1;
+        if (child >= m_Heap.size()) break;
+        if (child + 1 < m_Heap.size() && Before(m_Heap[child + 1], m_Heap[child])) ++child;
+
+        // Stop when the schedulable should run before it
+        if (!Before(m_Heap[child], pSchedulable)) break;
+
+        // Move the child up
+        Place(m_Heap[child], p_Index);
+        p_Index = child;
+    }
+    Place(pSchedulable, p_Index);
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,75 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_RUNQUEUE_H
+#define THREADING_RUNQUEUE_H
+
+namespace Nutshell {
+namespace Threading {
+
+class Schedulable;
+
+//******************************************************************************
+// This class encapsulates a queue of ready schedulables, ordered by  virtual
+// runtime or by deadline.  It is kept as a binary heap, and each schedulable
+// remembers its position within the heap so that it can be removed from
+// anywhere in logarithmic time.
+//
+// This replaces the bitmap of per-priority lists, which picked the next thread
+// in constant time. Virtual runtimes and deadlines don't fall into a small set
+// of levels that a bitmap could index, so picking a thread now costs time
+// logarithmic in the number of ready ones. In exchange, threads share the
+// processor in proportion to their weights.
+//******************************************************************************
+class RunQueue : boost::noncopyable {
+public:
+
+    // The ways the schedulables can be ordered.
+    enum Orders {
+        ORDER_RUNTIME   = 0,    // The smallest virtual runtime comes first.
+        ORDER_DEADLINE  = 1     // The earliest deadline comes first.
+    };
+
+private:
+
+    typedef std::vector<Schedulable*> SchedulableVector;
+
+    Orders              m_Order;    // How the schedulables are ordered.
+    SchedulableVector   m_Heap;     // The schedulables, as a heap.
+
+public:
+
+    // Construction / destruction
+    RunQueue(Orders p_Order = ORDER_RUNTIME);
+    ~RunQueue();
+
+    // Queue management
+    void            Enqueue(Schedulable* p_pSchedulable);
+    Schedulable*    Dequeue();
+    void            Remove(Schedulable* p_pSchedulable);
+
+    // Queue information
+    Schedulable*    Front() const;
+    bool            Empty() const;
+    size_t          Size() const;
+
+#ifdef _SIMULATOR_
+    // The number of comparisons made by all the queues, with which the
+    // simulator measures the cost of scheduling decisions.
+    static unsigned long long s_Comparisons;
+#endif // _SIMULATOR_
+
+private:
+
+    // Heap management
+    bool            Before(const Schedulable* p_pFirst, const Schedulable* p_pSecond) const;
+    void            Place(Schedulable* p_pSchedulable, size_t p_Index);
+    void            SiftUp(size_t p_Index);
+    void            SiftDown(size_t p_Index);
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_RUNQUEUE_H
@@ -0,0 +1,89 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/Schedulable.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+Schedulable::Schedulable()
+:   m_Runtime(0),
+    m_Deadline(0),
+    m_ReadyIndex(NOT_READY)
+{
+    assert(this != 0);
+
+    std::fill(m_Cycles, m_Cycles + MODE_COUNT, 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Schedulable::~Schedulable()
+{
+    assert(this != 0);
+    assert(m_ReadyIndex == NOT_READY);
+}
+
+//******************************************************************************
+// Returns the number of processor cycles spent in a given mode.
+//
+// Parameters:
+//  p_Mode - The mode whose time is requested.
+//******************************************************************************
+unsigned long long Schedulable::Cycles(Modes p_Mode) const
+{
+    assert(this != 0);
+    assert(p_Mode < MODE_COUNT);
+
+    return m_Cycles[p_Mode];
+}
+
+//******************************************************************************
+// Charges the schedulable for running during some time. Its virtual runtime
+// grows more slowly as its weight gets bigger.
+//
+// Parameters:
+//  p_Cycles - The number of processor cycles during which it ran.
+//  p_Weight - The weight of the schedulable.
+//******************************************************************************
+void Schedulable::Charge(unsigned long long p_Cycles, unsigned p_Weight)
+{
+    assert(this != 0);
+    assert(p_Weight > 0);
+
+    m_Runtime += p_Cycles * NORMAL_WEIGHT / p_Weight;
+}
+
+//******************************************************************************
+// Returns whether the schedulable is in a ready queue.
+//******************************************************************************
+bool Schedulable::Queued() const
+{
+    assert(this != 0);
+
+    return m_ReadyIndex != NOT_READY;
+}
+
+//******************************************************************************
+// Adds processor time spent in a given mode.
+//
+// Parameters:
+//  p_Cycles - The number of processor cycles spent.
+//  p_Mode   - The mode in which they were spent.
+//******************************************************************************
+void Schedulable::Spend(unsigned long long p_Cycles, Modes p_Mode)
+{
+    assert(this != 0);
+    assert(p_Mode < MODE_COUNT);
+
+    m_Cycles[p_Mode] += p_Cycles;
+}
+
+} // namespace Threading
+} // namespace Nutshell
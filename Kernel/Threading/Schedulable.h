@@ -0,0 +1,67 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_SCHEDULABLE_H
+#define THREADING_SCHEDULABLE_H
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class holds what the scheduler needs to know about anything that gets
+// a share of the processor:  threads, and the processes whose share is split
+// among their threads.
+//******************************************************************************
+class Schedulable {
+public:
+
+    // The ways processor time is spent
+    enum Modes {
+        MODE_USER           = 0,
+        MODE_KERNEL         = 1,
+        MODE_INTERRUPT      = 2,
+        MODE_COUNT          = 3
+    };
+
+protected:
+
+    // The weight of a schedulable that gets a normal share of the processor
+    static const unsigned   NORMAL_WEIGHT   = 1024;
+
+    // The ready queue position of a schedulable that isn't in a ready queue
+    static const size_t     NOT_READY       = ~0U;
+
+private:
+
+    unsigned long long  m_Runtime;              // The virtual runtime, in weighted cycles.
+    unsigned long long  m_Deadline;             // The tick by which a real-time thread must get its reserved time.
+    size_t              m_ReadyIndex;           // The position within the ready queue holding it.
+    unsigned long long  m_Cycles[MODE_COUNT];   // The processor cycles spent in each mode.
+
+    friend class RunQueue;
+    friend class Scheduler;
+
+public:
+
+    // Construction / destruction
+    Schedulable();
+    ~Schedulable();
+
+    // Processor time information
+    unsigned long long  Cycles(Modes p_Mode) const;
+
+private:
+
+    // Virtual runtime management
+    void    Charge(unsigned long long p_Cycles, unsigned p_Weight);
+    bool    Queued() const;
+
+    // Processor time management
+    void    Spend(unsigned long long p_Cycles, Modes p_Mode);
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_SCHEDULABLE_H
@@ -3,6 +3,7 @@
 //******************************************************************************
 
 #include "Global.h"
+#include "Machine.h"
 #include "Threading/Scheduler.h"
 #include "Threading/InterruptLock.h"
 
@@ -11,11 +12,40 @@ namespace Threading {
 
 //******************************************************************************
 // Constructor.
+//
+// Parameters:
+//  p_Tickless - Whether the clock interrupt is only requested when there is a
+//               time slice to enforce, rather than at every tick.
 //******************************************************************************
-Scheduler::Scheduler()
-:   m_pCurrent(0)
+Scheduler::Scheduler(bool p_Tickless)
+:   m_RealTime(RunQueue::ORDER_DEADLINE),
+    m_pCurrent(0),
+    m_pRunning(0),
+    m_Tickless(p_Tickless),
+    m_ClockDeadline(INFINITE_DEADLINE),
+    m_SliceEnd(0),
+    m_SliceCycles(SLICE_TICKS * Machine::GetCyclesPerClockTick()),
+    m_SwitchTime(Machine::ReadTimestampCounter()),
+    m_MinRuntime(0),
+    m_Reserved(0),
+    m_IdleCycles(0),
+    m_SpendTime(m_SwitchTime),
+    m_Switches(0),
+    m_Preemptions(0),
+    m_Wakeups(0),
+    m_Preemption(0),
+    m_Deferred(false),
+    m_SpinLock("Scheduler"),
+    m_ZombiesLock("SchedulerZombies")
 {
     assert(this != 0);
+
+    // Let the processor time and latencies of threads be looked at from the
+    // debugger.
+    if (g_pDebugger != 0) {
+        g_pDebugger->AddCommand("times", &TimesCommand, this);
+        g_pDebugger->AddCommand("latency", &LatencyCommand, this);
+    }
 }
 
 //******************************************************************************
@@ -40,23 +70,24 @@ void Scheduler::AddThread(ThreadSP p_spThread)
     InterruptLock intlock;
     Locker<SpinLock> lock(m_SpinLock);
 
-    // Check if this is the first thread added to the scheduler
-    if (m_pCurrent == 0) {
-        // Initialize the thread effective priority
-        p_spThread->m_Effective = 0;
-    } else {
-        // Initialize the thread effective priority related to ours
-        p_spThread->m_Effective  = m_pCurrent->m_Effective;
-        p_spThread->m_Effective += p_spThread->m_Base - p_spThread->m_Boost;
-        p_spThread->m_Effective -= m_pCurrent->m_Base - m_pCurrent->m_Boost;
+    // Add it to the thread vector
+    {
+        RWSpinLockWriteLocker threadsLock(m_ThreadsLock);
+        m_Threads.push_back(p_spThread);
     }
 
-    // Add it to the thread vector
-    m_Threads.push_back(p_spThread);
+    // Timed sleeps of the thread end up in our timeout handler, and the end
+    // of its throttling in our replenish handler.
+    p_spThread->m_Timeout.Handler(&TimeoutHandler, p_spThread.get());
+    p_spThread->m_Replenish.Handler(&ReplenishHandler, p_spThread.get());
 
-    // Add it to the ready heap
-    m_Ready.push_back(p_spThread.get());
-    std::push_heap(m_Ready.begin(), m_Ready.end(), Utilities::DereferenceCompare<Thread>());
+    // Add it to the ready queue. It starts with the smallest virtual runtime
+    // of its process, so that it neither owes nor is owed processor time.
+    p_spThread->m_Runtime = p_spThread->m_pProcess->m_MinRuntime;
+    EnqueueReady(p_spThread.get());
+
+    // The current thread now has to share the processor
+    if (m_pCurrent != 0) UpdateClock();
 }
 
 //******************************************************************************
@@ -69,10 +100,110 @@ void Scheduler::RemoveThread(Thread* p_pThread)
 {
     assert(this != 0);
     assert(p_pThread != 0);
+
+    // This will hold our reference to the thread, so that it gets destroyed
+    // only once we've released the spin lock.
+    ThreadSP spThread;
+
+    // We must hold the spin lock while we're modifying data
+    {
+        InterruptLock intlock;
+        Locker<SpinLock> lock(m_SpinLock);
+        assert(p_pThread != m_pCurrent);
+        assert(p_pThread != m_spIdle.get());
+
+        // Take the thread out of the queue it's waiting in, if any. A ready
+        // thread isn't queued while it's throttled.
+        if (p_pThread->Queued()) {
+            RemoveReady(p_pThread);
+        } else if (p_pThread->m_State == Thread::STATE_SLEEPING) {
+            Channel(p_pThread->m_pChannel).Remove(p_pThread);
+            p_pThread->m_pChannel = 0;
+            if (p_pThread->m_Timeout.Armed()) m_Timers.Remove(&p_pThread->m_Timeout);
+        }
+        assert(p_pThread->m_pQueue == 0);
+
+        // Give back its reservation, if any.
+        if (p_pThread->RealTime()) {
+            m_Reserved -= Utilization(p_pThread);
+            if (p_pThread->m_Replenish.Armed()) m_Timers.Remove(&p_pThread->m_Replenish);
+        }
+
+        // Remove it from the thread vector, the order doesn't matter
+        RWSpinLockWriteLocker threadsLock(m_ThreadsLock);
+        for (ThreadSPVector::iterator it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+            if (it->get() == p_pThread) {
+                spThread = *it;
+                *it = m_Threads.back();
+                m_Threads.pop_back();
+                break;
+            }
+        }
+        assert(spThread != 0);
+    }
+}
+
+//******************************************************************************
+// Terminates the current thread. Its resources are released later on by the
+// reaper thread, since we're still running on its stack.
+//******************************************************************************
+void Scheduler::Exit()
+{
+    assert(this != 0);
+    assert(m_pCurrent != 0);
     InterruptLock intlock;
-    Locker<SpinLock> lock(m_SpinLock);
 
-    assert(false);
+    // Make sure the current thread never gets scheduled again
+    {
+        Locker<SpinLock> lock(m_SpinLock);
+        m_pCurrent->m_State = Thread::STATE_ZOMBIE;
+    }
+
+    // Hand it over to the reaper
+    {
+        Locker<SpinLock> lock(m_ZombiesLock);
+        m_Zombies.PushBack(m_pCurrent);
+    }
+    WakeUp(&m_Zombies);
+
+    // Give the processor away for good
+    Switch();
+    PANIC("Terminated thread was scheduled!");
+}
+
+//******************************************************************************
+// Creates the thread that releases the resources of terminated threads.
+//
+// Parameters:
+//  p_spProcess - The process in which the reaper runs.
+//******************************************************************************
+void Scheduler::StartReaper(ProcessSP p_spProcess)
+{
+    assert(this != 0);
+    assert(p_spProcess != 0);
+
+    AddThread(ThreadSP(new Thread(p_spProcess, &ReaperEntry, this)));
+}
+
+//******************************************************************************
+// Creates the idle thread, which runs whenever no other thread is ready. It
+// never waits in the ready queues.
+//
+// Parameters:
+//  p_spProcess - The process in which the idle thread runs.
+//******************************************************************************
+void Scheduler::StartIdle(ProcessSP p_spProcess)
+{
+    assert(this != 0);
+    assert(p_spProcess != 0);
+
+    // Create the thread before taking the spin lock
+    ThreadSP spIdle(new Thread(p_spProcess, &IdleEntry, this));
+
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+    assert(m_spIdle == 0);
+    m_spIdle = spIdle;
 }
 
 //******************************************************************************
@@ -80,14 +211,297 @@ void Scheduler::RemoveThread(Thread* p_pThread)
 //******************************************************************************
 void Scheduler::Clock()
 {
+    assert(this != 0);
+
+    // Fire the timers that have expired. The handlers are called without the
+    // spin lock, since they may very well call back into the scheduler.
+    unsigned long long now = Machine::GetClockTicks();
+    for (;;) {
+        Timer* pTimer;
+        {
+            Locker<SpinLock> lock(m_SpinLock);
+            pTimer = m_Timers.Expire(now);
+        }
+        if (pTimer == 0) break;
+        pTimer->Fire();
+    }
+
+    // This flag will be raised if the current thread must give up the processor
+    bool preempt;
+    {
+        Locker<SpinLock> lock(m_SpinLock);
+
+        // The clock interrupt is one-shot, so it is no longer armed
+        m_ClockDeadline = INFINITE_DEADLINE;
+
+        // Check if the slice of the current thread is over, or if  it  must
+        // give up the processor for some other reason, unless it disabled
+        // preemption.
+        Account();
+        preempt = (m_pCurrent == 0 || now >= m_SliceEnd || Preempted()) && Reschedule();
+
+        // If we keep running the current thread, wait for the next event.
+        if (!preempt) UpdateClock();
+    }
+
     // Switch to another thread
-    Switch();
+    if (preempt) Switch();
+}
+
+//******************************************************************************
+// Called when an interrupt handler starts. The time the current thread spent
+// until then is attributed to it, and the time the handler takes is counted
+// as interrupt time until LeaveInterrupt is called.
+//
+// Parameters:
+//  p_pEIP - The address of the interrupted instruction.
+//******************************************************************************
+void Scheduler::EnterInterrupt(void* p_pEIP)
+{
+    assert(this != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Check if there's a thread to account for
+    if (m_pCurrent == 0) return;
+
+    // The thread was running user code if it was interrupted below the kernel
+    // space, unless it was already handling an interrupt.
+    if (m_pCurrent->m_Interrupts > 0) {
+        Spend(Schedulable::MODE_INTERRUPT);
+    } else if (reinterpret_cast<size_t>(p_pEIP) < KERNEL_SPACE_BOUNDARY) {
+        Spend(Schedulable::MODE_USER);
+    } else {
+        Spend(Schedulable::MODE_KERNEL);
+    }
+    ++m_pCurrent->m_Interrupts;
+}
+
+//******************************************************************************
+// Called when an interrupt handler ends. The time it took is attributed to the
+// current thread as interrupt time. If the handler switched threads, this is
+// called once the interrupted thread runs again.
+//******************************************************************************
+void Scheduler::LeaveInterrupt()
+{
+    assert(this != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Check if there's a thread to account for
+    if (m_pCurrent == 0) return;
+
+    assert(m_pCurrent->m_Interrupts > 0);
+    Spend(Schedulable::MODE_INTERRUPT);
+    --m_pCurrent->m_Interrupts;
+}
+
+//******************************************************************************
+// Reserves processor time for a thread: it gets to run for a budget of time in
+// every period, ahead of all threads without  reservation,  and  threads with
+// reservations run by earliest deadline first. A thread that uses its budget
+// up is throttled until its next period starts.
+//
+// Parameters:
+//  p_pThread   - The thread whose reservation changes.
+//  p_Budget    - The processor time reserved per period, in clock ticks, or 0
+//                to remove the reservation.
+//  p_Period    - The period, in clock ticks.
+//
+// Returns:
+//  Whether the reservation has been made. It is refused when  the  processor
+//  time reserved by all threads would go over RESERVATION_LIMIT.
+//******************************************************************************
+bool Scheduler::Reserve(Thread* p_pThread, unsigned p_Budget, unsigned p_Period)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_Budget == 0 || (p_Period > 0 && p_Budget <= p_Period));
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Check if the processor can accomodate the new reservation
+    unsigned previous = p_pThread->RealTime() ? Utilization(p_pThread) : 0;
+    unsigned requested = p_Budget == 0 ? 0 : static_cast<unsigned long long>(p_Budget) * UTILIZATION_SCALE / p_Period;
+    if (m_Reserved - previous + requested > RESERVATION_LIMIT) return false;
+    m_Reserved = m_Reserved - previous + requested;
+
+    // Charge the current thread for the time it ran in its old class
+    bool current = p_pThread == m_pCurrent;
+    if (current) Account();
+
+    // Take the thread out of its ready queue while its class changes
+    bool wasRealTime = p_pThread->RealTime();
+    bool queued = p_pThread->Queued();
+    if (queued) RemoveReady(p_pThread);
+
+    // Forget about the current period, if any.
+    if (p_pThread->m_Replenish.Armed()) m_Timers.Remove(&p_pThread->m_Replenish);
+    p_pThread->m_Throttled = false;
+
+    // Setup the new reservation
+    if (p_Budget == 0) {
+        p_pThread->m_Budget = 0;
+        p_pThread->m_Period = 0;
+    } else {
+        p_pThread->m_Budget = p_Budget * Machine::GetCyclesPerClockTick();
+        p_pThread->m_Period = p_Period;
+        StartPeriod(p_pThread, Machine::GetClockTicks());
+    }
+
+    // A thread that leaves the real-time class wasn't charged any virtual
+    // runtime meanwhile, so it starts over from that of its process.
+    if (wasRealTime && !p_pThread->RealTime()) Credit(p_pThread, p_pThread->m_pProcess->m_MinRuntime);
+
+    // Put the thread back in the ready queue of its new class
+    if (queued) EnqueueReady(p_pThread);
+
+    // The process of the current thread stays out of the ready queue while
+    // the thread runs, unless the thread is real-time.
+    if (current && p_pThread->RealTime() && m_pRunning != 0) {
+        if (!m_pRunning->m_Ready.Empty()) m_Ready.Enqueue(m_pRunning);
+        m_pRunning = 0;
+    } else if (current && !p_pThread->RealTime() && m_pRunning == 0) {
+        m_pRunning = p_pThread->m_pProcess;
+        if (m_pRunning->Queued()) {
+            m_Ready.Remove(m_pRunning);
+        } else {
+            Credit(m_pRunning, m_MinRuntime);
+        }
+    }
+    UpdateClock();
+
+    return true;
+}
+
+//******************************************************************************
+// Lends the place of a thread that starts waiting for a mutex to the owner of
+// the mutex. Within a process, the owner moves up to the place of the waiter
+// among the threads; otherwise the process of the owner moves up to the place
+// of that of the waiter, and the owner to the front of its process. Together
+// with the weight the owner inherits, this lets it run through the mutex on
+// behalf of the waiter, even behind processes with a larger share.
+//
+// Parameters:
+//  p_pDonor - The thread that waits for the mutex.
+//  p_pOwner - The thread that owns the mutex.
+//******************************************************************************
+void Scheduler::Lend(Thread* p_pDonor, Thread* p_pOwner)
+{
+    assert(this != 0);
+    assert(p_pDonor != 0);
+    assert(p_pOwner != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Real-time threads are scheduled by deadline, not by virtual runtime
+    if (p_pDonor->RealTime() || p_pOwner->RealTime()) return;
+
+    Process* pProcess = p_pOwner->m_pProcess;
+    if (pProcess == p_pDonor->m_pProcess) {
+        Promote(pProcess->m_Ready, p_pOwner, p_pDonor->m_Runtime);
+    } else {
+        Promote(m_Ready, pProcess, p_pDonor->m_pProcess->m_Runtime);
+        if (!pProcess->m_Ready.Empty()) Promote(pProcess->m_Ready, p_pOwner, pProcess->m_Ready.Front()->m_Runtime);
+    }
+}
+
+//******************************************************************************
+// Starts a timer. If the timer is already started, its deadline is changed.
+//
+// Parameters:
+//  p_pTimer    - The timer to start.
+//  p_Deadline  - The tick at which the timer expires.
+//******************************************************************************
+void Scheduler::StartTimer(Timer* p_pTimer, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    assert(p_pTimer != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Add the timer to the wheel, moving it if needed
+    if (p_pTimer->Armed()) m_Timers.Remove(p_pTimer);
+    m_Timers.Insert(p_pTimer, p_Deadline);
+
+    // Make sure the clock is armed in time
+    UpdateClock();
+}
+
+//******************************************************************************
+// Stops a timer before it expires.
+//
+// Parameters:
+//  p_pTimer - The timer to stop.
+//
+// Returns:
+//  Whether the timer was started. If not, it either has never been started,
+//  or it has already expired.
+//******************************************************************************
+bool Scheduler::StopTimer(Timer* p_pTimer)
+{
+    assert(this != 0);
+    assert(p_pTimer != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Check if the timer is still waiting for its deadline
+    if (!p_pTimer->Armed()) return false;
+
+    // Remove it from the wheel. The clock may still be armed for it, but an
+    // early interrupt is harmless.
+    m_Timers.Remove(p_pTimer);
+
+    return true;
 }
 
 //******************************************************************************
 // Switches execution to another thread.
 //******************************************************************************
 void Scheduler::Switch()
+{
+    assert(this != 0);
+
+    SwitchTo(0);
+}
+
+//******************************************************************************
+// Gives what's left of the time slice of the current thread to another ready
+// thread, which runs right away.
+//
+// Parameters:
+//  p_pThread - The thread to run.
+//
+// Returns:
+//  Whether the thread was ready, and so ran.
+//******************************************************************************
+bool Scheduler::YieldTo(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    InterruptLock intlock;
+
+    // Only a thread waiting in the ready queues can run, not the current or a
+    // throttled one.
+    {
+        Locker<SpinLock> lock(m_SpinLock);
+        if (!p_pThread->Queued()) return false;
+    }
+
+    // Interrupts are still disabled, so the thread can't have gone anywhere.
+    SwitchTo(p_pThread);
+
+    return true;
+}
+
+//******************************************************************************
+// Switches execution to another thread.
+//
+// Parameters:
+//  p_pNext - The ready thread that gets what's left of the time slice, or 0 to
+//            let the scheduler pick the next thread, with a new time slice.
+//******************************************************************************
+void Scheduler::SwitchTo(Thread* p_pNext)
 {
     assert(this != 0);
     InterruptLock intlock; 
@@ -96,57 +510,86 @@ void Scheduler::Switch()
     {
         Locker<SpinLock> lock(m_SpinLock);
 
-        // Check if the current thread is still ready
-        if (m_pCurrent != 0 && m_pCurrent->m_State == Thread::STATE_READY) {
-            // Increment the thread's effective priority
-            m_pCurrent->m_Effective += m_pCurrent->m_Base;
+        // Charge the current thread for the time it ran
+        Account();
+        Spend(m_pCurrent != 0 && m_pCurrent->m_Interrupts > 0 ? Schedulable::MODE_INTERRUPT : Schedulable::MODE_KERNEL);
 
-            // Decrement it's priority boost, if any.
-            if (m_pCurrent->m_Boost > 0) {
-                --m_pCurrent->m_Boost;
-                ++m_pCurrent->m_Effective;
-            }
+        // The process of the current thread competes again if it has other
+        // ready threads.
+        if (m_pRunning != 0) {
+            if (!m_pRunning->m_Ready.Empty()) m_Ready.Enqueue(m_pRunning);
+            m_pRunning = 0;
+        }
 
-            // Put it back into the heap
-            m_Ready.push_back(m_pCurrent);
-            std::push_heap(m_Ready.begin(), m_Ready.end(), Utilities::DereferenceCompare<Thread>());
+        // Check if the current thread is still ready. The idle thread always
+        // is, but it never waits in the ready queues.
+        if (m_pCurrent != 0 && m_pCurrent != m_spIdle.get() && m_pCurrent->m_State == Thread::STATE_READY) {
+            // Put it back in the ready queues, unless it is throttled.
+            if (!m_pCurrent->m_Throttled) EnqueueReady(m_pCurrent);
         }
 
-        // At this time we must still have a ready thread
-        assert(!m_Ready.empty());
-
-        // The  top thread  in the queue is the one with  the lowest effective
-        // priority.   Since  this  priority  always  grows,  and  to  avoid a
-        // wrapping when the limit of an integer is  reached, we decrement all
-        // of them at a 'regular' interval.
-        if (m_Ready.front()->m_Effective >= EFFECTIVE_PRIORITY_LIMIT) {
-            // Reduce the priority of all ready threads
-            for (ThreadVector::iterator it = m_Ready.begin(); it != m_Ready.end(); ++it) {
-                // Update the priority of the current thread
-                (*it)->m_Effective -= EFFECTIVE_PRIORITY_LIMIT;
+        // Retrieve the thread we yield to, if any. Otherwise retrieve the
+        // real-time thread with the earliest deadline, or else the thread that
+        // got the least processor time, or else the idle thread.
+        Thread* pPrevious = m_pCurrent;
+        m_pCurrent = p_pNext != 0 ? DequeueReady(p_pNext) : DequeueReady();
+
+        // Count the switch. If the new current thread was woken up, record
+        // how long it waited. The preemption disable count follows the thread
+        // it belongs to.
+        m_Deferred = false;
+        if (m_pCurrent != pPrevious) {
+            if (pPrevious != 0) pPrevious->m_Preemption = m_Preemption;
+            m_Preemption = m_pCurrent->m_Preemption;
+            ++m_Switches;
+            if (pPrevious != 0 && pPrevious != m_spIdle.get() && pPrevious->m_State == Thread::STATE_READY) ++m_Preemptions;
+            m_pCurrent->m_SwitchInTime = m_SwitchTime;
+            if (m_pCurrent->m_WakeTime != 0) {
+                m_Latencies.Record(m_pCurrent->PriorityClass(), m_SwitchTime - m_pCurrent->m_WakeTime, m_SwitchTime, m_pCurrent, pPrevious);
+                m_pCurrent->m_WakeTime = 0;
             }
         }
 
-        // Retrieve  the  thread  with  the  best  priority  (the  one  at the
-        // beginning of the vector, since the vector is a heap).
-        m_pCurrent = m_Ready.front();
-        std::pop_heap(m_Ready.begin(), m_Ready.end(), Utilities::DereferenceCompare<Thread>());
-        m_Ready.pop_back();
+        // The new current thread starts a new time slice, unless it was given
+        // what's left of ours.
+        if (p_pNext == 0) m_SliceEnd = Machine::GetClockTicks() + SLICE_TICKS;
+        UpdateClock();
     }
 
     // Switch execution to the new current thread
     m_pCurrent->Switch();
 }
 
+//******************************************************************************
+// Checks if the current thread may be preempted right away. If it disabled
+// preemption, the switch is deferred until it enables it again.  The
+// scheduler spin lock must be held.
+//
+// Returns:
+//  Whether the current thread can be switched out now.
+//******************************************************************************
+bool Scheduler::Reschedule()
+{
+    assert(this != 0);
+
+    if (m_Preemption == 0) return true;
+
+    m_Deferred = true;
+    return false;
+}
+
 //******************************************************************************
 // Makes the current thread sleep on a specific channel.
 //
 // Parameters:
 //  p_pChannel  - The channel on which to sleep.
-//  p_Boost     - The priority boost to give to the thread when it awakes.
 //  p_pSpinLock - A spin lock to release and reacquire after sleeping.
+//  p_Deadline  - The tick at which the thread stops waiting for the channel.
+//
+// Returns:
+//  Whether the thread was waked up before the deadline.
 //******************************************************************************
-void Scheduler::Sleep(void* p_pChannel, int p_Boost, SpinLock* p_pSpinLock)
+bool Scheduler::Sleep(void* p_pChannel, SpinLock* p_pSpinLock, unsigned long long p_Deadline)
 {
     assert(this != 0);
     assert(m_pCurrent != 0);
@@ -158,13 +601,7 @@ void Scheduler::Sleep(void* p_pChannel, int p_Boost, SpinLock* p_pSpinLock)
         Locker<SpinLock> lock(m_SpinLock);
 
         // Mark the current thread as sleeping
-        m_pCurrent->m_State     = Thread::STATE_SLEEPING;
-        m_pCurrent->m_Boost     = std::max(p_Boost, m_pCurrent->m_Boost);
-        m_pCurrent->m_Effective = m_pCurrent->m_Base + m_pCurrent->m_Boost;
-        m_pCurrent->m_pChannel  = p_pChannel;
-
-        // Add it to the  sleeping threads
-        m_Sleeping.push_back(m_pCurrent);
+        Suspend(p_pChannel, p_Deadline);
 
         // Unlock the specified spin lock, if any.
         if (p_pSpinLock != 0) p_pSpinLock->Unlock();
@@ -172,9 +609,80 @@ void Scheduler::Sleep(void* p_pChannel, int p_Boost, SpinLock* p_pSpinLock)
 
     // Wait for someone to wake us up
     Switch();
+    bool timedOut = m_pCurrent->m_TimedOut;
 
     // Lock back the specified spin lock, if any.
     if (p_pSpinLock != 0) p_pSpinLock->Lock();
+
+    return !timedOut;
+}
+
+//******************************************************************************
+// Wakes up all threads waiting on a channel, and makes the current thread
+// sleep on another one. The thread that waited the longest gets what's left
+// of the time slice of the current thread, so that a request and its reply
+// only take one switch each.
+//
+// Parameters:
+//  p_pWakeChannel  - The channel whose threads will be waked up.
+//  p_pSleepChannel - The channel on which to sleep.
+//  p_Deadline      - The tick at which the thread stops waiting for the channel.
+//
+// Returns:
+//  Whether the thread was waked up before the deadline.
+//******************************************************************************
+bool Scheduler::WakeUpAndSleep(void* p_pWakeChannel, void* p_pSleepChannel, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    assert(m_pCurrent != 0);
+    assert(p_pWakeChannel != 0);
+    assert(p_pSleepChannel != 0);
+    InterruptLock intlock;
+
+    // This will be the thread that runs next, if any.
+    Thread* pNext = 0;
+
+    // We must hold the spin lock while we're modifying data
+    {
+        Locker<SpinLock> lock(m_SpinLock);
+
+        // Move the threads waiting on the first channel to the ready queues
+        ThreadQueue& sleeping = Channel(p_pWakeChannel);
+        for (Thread* pThread = sleeping.Front(); pThread != 0;) {
+            Thread* pFollowing = sleeping.Next(pThread);
+            if (pThread->m_pChannel == p_pWakeChannel) {
+                Ready(pThread);
+                if (pNext == 0) pNext = pThread;
+            }
+            pThread = pFollowing;
+        }
+
+        // A throttled thread doesn't get to run
+        if (pNext != 0 && !pNext->Queued()) pNext = 0;
+
+        // Mark the current thread as sleeping
+        Suspend(p_pSleepChannel, p_Deadline);
+    }
+
+    // Run the thread we woke up, or whichever thread is next.
+    SwitchTo(pNext);
+
+    return !m_pCurrent->m_TimedOut;
+}
+
+//******************************************************************************
+// Makes the current thread sleep until a specific tick. The thread sleeps on
+// itself, so it may also be waked up earlier through /WakeUp/.
+//
+// Parameters:
+//  p_Deadline - The tick at which the thread wakes up.
+//******************************************************************************
+void Scheduler::SleepUntil(unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    assert(m_pCurrent != 0);
+
+    Sleep(m_pCurrent, 0, p_Deadline);
 }
 
 //******************************************************************************
@@ -204,36 +712,26 @@ size_t Scheduler::WakeUp(void* p_pChannel, SpinLock* p_pSpinLock)
     {
         Locker<SpinLock> lock(m_SpinLock);
 
-        // Go through the sleeping threads  (in reverse order  so that threads
-        // that  were  waiting  for  longer gets  a  slightly  better priority
-        // boost).
-        for (ThreadVector::reverse_iterator it = m_Sleeping.rbegin(); it != m_Sleeping.rend(); ++it) {
+        // Go through the threads that sleep on channels sharing the same hash
+        // bucket, in the order they went to sleep, so  that threads that were
+        // waiting for longer are queued first within their priority level.
+        ThreadQueue& sleeping = Channel(p_pChannel);
+        for (Thread* pThread = sleeping.Front(); pThread != 0;) {
+            // Remember the next one, since we might remove the current one
+            Thread* pNext = sleeping.Next(pThread);
+
             // Check if the current thread is waiting on the correct channel
-            if ((*it)->m_pChannel == p_pChannel) {
-                // Mark the thread as ready
-                (*it)->m_State      = Thread::STATE_READY;
-                (*it)->m_Boost     += count++;
-                (*it)->m_Effective  = m_pCurrent->m_Effective;
-                (*it)->m_Effective += (*it)->m_Base - (*it)->m_Boost;
-                (*it)->m_Effective -= m_pCurrent->m_Base - m_pCurrent->m_Boost;
-
-                // Add it to the ready heap
-                m_Ready.push_back(*it);
-                std::push_heap(m_Ready.begin(), m_Ready.end(), Utilities::DereferenceCompare<Thread>());
-
-                // Check if the thread has a better priority than ours
-                higher |= (*it)->m_Effective < m_pCurrent->m_Effective;
-
-                // Mark the thread for deletion in the sleeping vector
-                *it = 0;
+            if (pThread->m_pChannel == p_pChannel) {
+                // Move it to the ready queue
+                higher |= Ready(pThread);
+                ++count;
             }
-        }
 
-        // Now remove the threads that were waked up from the vector
-        std::remove(m_Sleeping.begin(), m_Sleeping.end(), static_cast<Thread*>(0));
-        m_Sleeping.resize(m_Sleeping.size() - count);
+            pThread = pNext;
+        }
 
         // If we're gonna switch, unlock the specified spin lock, if any.
+        higher = higher && Reschedule();
         if (higher && p_pSpinLock != 0) p_pSpinLock->Unlock();
     }
 
@@ -251,14 +749,973 @@ size_t Scheduler::WakeUp(void* p_pChannel, SpinLock* p_pSpinLock)
 }
 
 //******************************************************************************
-// Returns the current thread.
+// Wakes up the thread that has been waiting the longest on a specific channel.
+//
+// Parameters:
+//  p_pChannel  - The channel whose thread will be waked up.
+//  p_pSpinLock - A spin lock to release and reacquire after switching.
+//  p_ppOwner   - If not 0, receives the thread that is waked up before it gets
+//                a chance to run. This allows the caller to hand it ownership
+//                of an object.
+//
+// Returns:
+//  The thread that has been waked up, or 0 if no thread was waiting.
 //******************************************************************************
-Thread* Scheduler::Current() const
+Thread* Scheduler::WakeOne(void* p_pChannel, SpinLock* p_pSpinLock, Thread** p_ppOwner)
 {
     assert(this != 0);
-
+    assert(p_pChannel != 0);
+    InterruptLock intlock; 
+
+    // This will be the thread we woke up
+    Thread* pWoken = 0;
+
+    // This flag will be raised if we wake up a thread with a better  priority
+    // than the one of the current thread.
+    bool higher = false;
+
+    // We must hold the spin lock while we're modifying data
+    {
+        Locker<SpinLock> lock(m_SpinLock);
+
+        // Look for the first thread of the bucket waiting on the channel
+        ThreadQueue& sleeping = Channel(p_pChannel);
+        for (Thread* pThread = sleeping.Front(); pThread != 0; pThread = sleeping.Next(pThread)) {
+            if (pThread->m_pChannel == p_pChannel) {
+                pWoken = pThread;
+                break;
+            }
+        }
+
+        // Move the thread to the ready queue, if we found one
+        if (pWoken != 0) {
+            if (p_ppOwner != 0) *p_ppOwner = pWoken;
+            higher = Ready(pWoken) && Reschedule();
+        }
+
+        // If we're gonna switch, unlock the specified spin lock, if any.
+        if (higher && p_pSpinLock != 0) p_pSpinLock->Unlock();
+    }
+
+    // If we woke up a thread with a better priority, let him have the control
+    // of the processor.
+    if (higher) {
+        // Give the processor to the more prioritive thread
+        Switch();
+
+        // Lock back the specified spin lock, if any.
+        if (p_pSpinLock != 0) p_pSpinLock->Lock();
+    }
+
+    return pWoken;
+}
+
+//******************************************************************************
+// Moves the thread that has been waiting the longest on a channel to another
+// channel, without waking it up. It then wakes up along with the threads of
+// its new channel.
+//
+// Parameters:
+//  p_pChannel  - The channel whose thread will be moved.
+//  p_pTarget   - The channel on which the thread will sleep from now on.
+//
+// Returns:
+//  The thread that has been moved, or 0 if no thread was waiting.
+//******************************************************************************
+Thread* Scheduler::Requeue(void* p_pChannel, void* p_pTarget)
+{
+    assert(this != 0);
+    assert(p_pChannel != 0);
+    assert(p_pTarget != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Look for the first thread of the bucket waiting on the channel
+    ThreadQueue& sleeping = Channel(p_pChannel);
+    for (Thread* pThread = sleeping.Front(); pThread != 0; pThread = sleeping.Next(pThread)) {
+        if (pThread->m_pChannel == p_pChannel) {
+            // Put it at the end of the other channel, it keeps its timeout.
+            sleeping.Remove(pThread);
+            pThread->m_pChannel = p_pTarget;
+            Channel(p_pTarget).PushBack(pThread);
+            return pThread;
+        }
+    }
+
+    return 0;
+}
+
+//******************************************************************************
+// Prevents the current thread from being preempted, until EnablePreemption is
+// called as many times. It may still give up the processor  by  sleeping,  in
+// which case preemption stays disabled for it alone.
+//******************************************************************************
+void Scheduler::DisablePreemption()
+{
+    assert(this != 0);
+
+    // Only interrupt handlers look at the count while we change it, and they
+    // can't switch threads unless it's 0.
+    ++m_Preemption;
+}
+
+//******************************************************************************
+// Allows the current thread to be preempted again, once  it  has  been  called
+// as many times as DisablePreemption. A preemption that  was  deferred  until
+// then takes place right away.
+//******************************************************************************
+void Scheduler::EnablePreemption()
+{
+    assert(this != 0);
+    assert(m_Preemption > 0);
+
+    if (--m_Preemption == 0 && m_Deferred) Switch();
+}
+
+//******************************************************************************
+// Returns whether the current thread may be preempted.
+//******************************************************************************
+bool Scheduler::Preemptible() const
+{
+    assert(this != 0);
+
+    return m_Preemption == 0;
+}
+
+//******************************************************************************
+// Returns the number of processor cycles spent in the idle  thread  so  far.
+// Compared to the timestamp counter, it tells how busy the processor is.
+//******************************************************************************
+unsigned long long Scheduler::IdleCycles() const
+{
+    assert(this != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // The current idle period counts as well
+    unsigned long long cycles = m_IdleCycles;
+    if (m_pCurrent != 0 && m_pCurrent == m_spIdle.get()) cycles += Machine::ReadTimestampCounter() - m_SwitchTime;
+
+    return cycles;
+}
+
+//******************************************************************************
+// Returns the number of times another thread was switched to so far.
+//******************************************************************************
+unsigned long long Scheduler::Switches() const
+{
+    assert(this != 0);
+
+    return m_Switches;
+}
+
+//******************************************************************************
+// Returns the number of times a sleeping thread was made ready so far.
+//******************************************************************************
+unsigned long long Scheduler::Wakeups() const
+{
+    assert(this != 0);
+
+    return m_Wakeups;
+}
+
+//******************************************************************************
+// Copies the latencies between wake ups and switches recorded so far.
+//
+// Parameters:
+//  p_rCopy - The tracer that receives the copy.
+//******************************************************************************
+void Scheduler::CopyLatencies(LatencyTracer& p_rCopy) const
+{
+    assert(this != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    p_rCopy.Copy(m_Latencies);
+}
+
+//******************************************************************************
+// Returns the current thread.
+//******************************************************************************
+Thread* Scheduler::Current() const
+{
+    assert(this != 0);
+
     return m_pCurrent;
 }
 
+//******************************************************************************
+// Returns whether a thread is currently running on a processor. The answer
+// may be outdated as soon as it is returned, so it's only good as a hint.
+//
+// Parameters:
+//  p_pThread - The thread to check.
+//******************************************************************************
+bool Scheduler::Running(const Thread* p_pThread) const
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    return p_pThread == m_pCurrent;
+}
+
+//******************************************************************************
+// Returns the queue of sleeping threads that holds the threads  sleeping on a
+// specific channel. The queue may also contain threads sleeping on  channels
+// that share the same hash bucket.
+//
+// Parameters:
+//  p_pChannel - The channel whose queue is requested.
+//******************************************************************************
+ThreadQueue& Scheduler::Channel(void* p_pChannel)
+{
+    assert(this != 0);
+    assert(p_pChannel != 0);
+
+    // Channels are  usually  the address of  a synchronization object, so use
+    // a multiplicative hash to spread neighbouring addresses among buckets.
+    size_t hash = reinterpret_cast<size_t>(p_pChannel) * 2654435761u;
+
+    return m_Sleeping[(hash >> 16) & (CHANNEL_BUCKETS - 1)];
+}
+
+//******************************************************************************
+// Marks the current thread as sleeping on a channel. It actually stops running
+// at the next switch. The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_pChannel  - The channel on which to sleep.
+//  p_Deadline  - The tick at which the thread stops waiting for the channel.
+//******************************************************************************
+void Scheduler::Suspend(void* p_pChannel, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    assert(m_pCurrent != 0);
+
+    // Mark the current thread as sleeping
+    m_pCurrent->m_State     = Thread::STATE_SLEEPING;
+    m_pCurrent->m_pChannel  = p_pChannel;
+    m_pCurrent->m_TimedOut  = false;
+
+    // Add it to the waiters of the channel
+    Channel(p_pChannel).PushBack(m_pCurrent);
+
+    // Arrange to be waked up at the deadline, if any.
+    if (p_Deadline != INFINITE_DEADLINE) {
+        m_Timers.Insert(&m_pCurrent->m_Timeout, p_Deadline);
+        UpdateClock();
+    }
+}
+
+//******************************************************************************
+// Moves a sleeping thread to the ready queue. The scheduler spin lock must be
+// held.
+//
+// Parameters:
+//  p_pThread - The thread to wake up.
+//
+// Returns:
+//  Whether the thread should preempt the current one.
+//******************************************************************************
+bool Scheduler::Ready(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_State == Thread::STATE_SLEEPING);
+
+    // Remove the thread from the channel it sleeps on
+    Channel(p_pThread->m_pChannel).Remove(p_pThread);
+    p_pThread->m_pChannel = 0;
+
+    // It no longer needs its timeout
+    if (p_pThread->m_Timeout.Armed()) m_Timers.Remove(&p_pThread->m_Timeout);
+
+    if (p_pThread->RealTime()) {
+        // If the period of a real-time thread has gone by while it slept, it
+        // starts a new one.
+        unsigned long long now = Machine::GetClockTicks();
+        if (!p_pThread->m_Throttled && now >= p_pThread->m_Deadline) StartPeriod(p_pThread, now);
+    } else {
+        // Credit the thread for the time it slept
+        Credit(p_pThread, p_pThread->m_pProcess->m_MinRuntime);
+    }
+
+    // Mark it as ready and add it to the ready queue, unless it's throttled.
+    // Its latency is measured from now on.
+    p_pThread->m_State = Thread::STATE_READY;
+    p_pThread->m_WakeTime = Machine::ReadTimestampCounter();
+    ++m_Wakeups;
+    if (!p_pThread->m_Throttled) EnqueueReady(p_pThread);
+
+    // The current thread now has to share the processor
+    UpdateClock();
+
+    // Bring the virtual runtime of the current thread up to date
+    Account();
+
+    return Preempts(p_pThread);
+}
+
+//******************************************************************************
+// Adds a thread to the ready queues. A real-time thread joins the other ones,
+// otherwise the thread is added to the ready queue of its process. If the
+// process had no ready threads, it starts competing with the other processes
+// again, unless it is the process of the current thread. The scheduler spin
+// lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread to add to the ready queues.
+//******************************************************************************
+void Scheduler::EnqueueReady(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(!p_pThread->m_Throttled);
+
+    // Real-time threads are scheduled on their own
+    if (p_pThread->RealTime()) {
+        m_RealTime.Enqueue(p_pThread);
+        return;
+    }
+
+    // Check if the process must join the other ones
+    Process* pProcess = p_pThread->m_pProcess;
+    if (pProcess->m_Ready.Empty() && pProcess != m_pRunning) {
+        // Credit it for the time it had nothing to run
+        Credit(pProcess, m_MinRuntime);
+        m_Ready.Enqueue(pProcess);
+    }
+
+    // Add the thread among the ones of its process
+    pProcess->m_Ready.Enqueue(p_pThread);
+}
+
+//******************************************************************************
+// Removes a thread from the ready queues. The scheduler  spin lock must  be
+// held.
+//
+// Parameters:
+//  p_pThread - The thread to remove from the ready queues.
+//******************************************************************************
+void Scheduler::RemoveReady(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    // Real-time threads are scheduled on their own
+    if (p_pThread->RealTime()) {
+        m_RealTime.Remove(p_pThread);
+        return;
+    }
+
+    // Remove the thread, along with its process if it has nothing left to run
+    Process* pProcess = p_pThread->m_pProcess;
+    pProcess->m_Ready.Remove(p_pThread);
+    if (pProcess->m_Ready.Empty() && pProcess->Queued()) m_Ready.Remove(pProcess);
+}
+
+//******************************************************************************
+// Removes the next thread to run from the ready queues: the real-time thread
+// with the earliest deadline if there is one, otherwise the thread that got
+// the least processor time within the process that got the least processor
+// time. The scheduler spin lock must be held.
+//
+// Returns:
+//  The thread that was removed.
+//******************************************************************************
+Thread* Scheduler::DequeueReady()
+{
+    assert(this != 0);
+
+    // Real-time threads come first
+    if (!m_RealTime.Empty()) return static_cast<Thread*>(m_RealTime.Dequeue());
+
+    // If nothing is ready, the processor idles.
+    if (m_Ready.Empty()) {
+        assert(m_spIdle != 0);
+        return m_spIdle.get();
+    }
+
+    // Take the process, then the thread within it. The process stays out of
+    // the ready queue while its thread runs.
+    Process* pProcess = static_cast<Process*>(m_Ready.Dequeue());
+    m_pRunning = pProcess;
+    Thread* pThread = static_cast<Thread*>(pProcess->m_Ready.Dequeue());
+    assert(pThread != 0);
+
+    // Their virtual runtimes are now the smallest ones
+    m_MinRuntime = std::max(m_MinRuntime, pProcess->m_Runtime);
+    pProcess->m_MinRuntime = std::max(pProcess->m_MinRuntime, pThread->m_Runtime);
+
+    return pThread;
+}
+
+//******************************************************************************
+// Removes a specific thread from the ready queues, to run it next. If it's not
+// a real-time thread, its process is taken out of the ready queue while it
+// runs, and the minimum virtual runtimes move forward just like when the head
+// of the queues is taken. The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The thread to remove, which must be in a ready queue.
+//
+// Returns:
+//  The thread that was removed.
+//******************************************************************************
+Thread* Scheduler::DequeueReady(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->Queued());
+
+    RemoveReady(p_pThread);
+    if (!p_pThread->RealTime()) {
+        Process* pProcess = p_pThread->m_pProcess;
+        if (pProcess->Queued()) m_Ready.Remove(pProcess);
+        m_pRunning = pProcess;
+
+        // The thread might have been picked ahead of its turn, so the minimum
+        // runtimes can't go past the ones still queued.
+        unsigned long long runtime = pProcess->m_Runtime;
+        if (!m_Ready.Empty()) runtime = std::min(runtime, m_Ready.Front()->m_Runtime);
+        m_MinRuntime = std::max(m_MinRuntime, runtime);
+
+        runtime = p_pThread->m_Runtime;
+        if (!pProcess->m_Ready.Empty()) runtime = std::min(runtime, pProcess->m_Ready.Front()->m_Runtime);
+        pProcess->m_MinRuntime = std::max(pProcess->m_MinRuntime, runtime);
+    }
+
+    return p_pThread;
+}
+
+//******************************************************************************
+// Returns whether  other threads are waiting for the processor.  The process
+// of the current thread is kept out of the ready queue while it runs, so its
+// own ready threads must be checked too. The scheduler spin lock must be held.
+//******************************************************************************
+bool Scheduler::Contended() const
+{
+    assert(this != 0);
+
+    return !m_Ready.Empty() || !m_RealTime.Empty() || (m_pRunning != 0 && !m_pRunning->m_Ready.Empty());
+}
+
+//******************************************************************************
+// Returns whether the current thread must give up the processor before the
+// end of its slice, because a thread or a process that is owed enough time
+// is ready, or because it used its reserved time up. The scheduler spin lock
+// must be held.
+//******************************************************************************
+bool Scheduler::Preempted() const
+{
+    assert(this != 0);
+    assert(m_pCurrent != 0);
+
+    // The idle thread gives way to anyone
+    if (m_pCurrent == m_spIdle.get()) return Contended();
+
+    // A real-time thread runs until it's throttled, or until a thread with an
+    // earlier deadline is ready.
+    if (m_pCurrent->RealTime()) {
+        if (m_pCurrent->m_Throttled) return true;
+        return !m_RealTime.Empty() && m_RealTime.Front()->m_Deadline < m_pCurrent->m_Deadline;
+    }
+
+    // Other threads give way to real-time threads
+    if (!m_RealTime.Empty()) return true;
+
+    // Check the other processes, then the other threads of the process
+    if (!m_Ready.Empty() && Leads(m_Ready.Front(), m_pRunning)) return true;
+
+    return !m_pRunning->m_Ready.Empty() && Leads(m_pRunning->m_Ready.Front(), m_pCurrent);
+}
+
+//******************************************************************************
+// Charges the current thread for the time it ran since it was last charged.
+// A real-time thread uses its reserved time up,  and gets throttled when it
+// has none left; otherwise the thread and its process are charged virtual
+// runtime, the process at the weight the thread inherits if that's larger.
+// The scheduler spin lock must be held.
+//******************************************************************************
+void Scheduler::Account()
+{
+    assert(this != 0);
+
+    unsigned long long now = Machine::ReadTimestampCounter();
+    unsigned long long cycles = now - m_SwitchTime;
+    m_SwitchTime = now;
+
+    // Check if there's a thread to charge
+    if (m_pCurrent == 0) return;
+
+    // The idle thread isn't charged, but we keep track of the time spent idle
+    if (m_pCurrent == m_spIdle.get()) {
+        m_IdleCycles += cycles;
+        return;
+    }
+
+    if (m_pCurrent->RealTime()) {
+        // Ignore threads that are already throttled
+        if (m_pCurrent->m_Throttled) return;
+
+        // If the period is over, the thread starts a new one.
+        unsigned long long ticks = Machine::GetClockTicks();
+        if (ticks >= m_pCurrent->m_Deadline) StartPeriod(m_pCurrent, ticks);
+
+        // Use the reserved time up
+        m_pCurrent->m_Remaining -= std::min(cycles, m_pCurrent->m_Remaining);
+
+        // If there's none left, throttle the thread until its next period.
+        if (m_pCurrent->m_Remaining == 0) {
+            m_pCurrent->m_Throttled = true;
+            m_Timers.Insert(&m_pCurrent->m_Replenish, m_pCurrent->m_Deadline);
+        }
+    } else {
+        // Charge both the thread and its process
+        m_pCurrent->Charge(cycles, m_pCurrent->Weight());
+        m_pCurrent->m_pProcess->Charge(cycles, m_pCurrent->Share());
+    }
+}
+
+//******************************************************************************
+// Credits a thread or process that didn't compete for the processor for some
+// time.  It is allowed to lag only a fraction of a slice behind the smallest
+// virtual runtime, so that it gets to run quickly  without being  able  to
+// monopolize the processor. The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_pSchedulable  - The thread or process to credit.
+//  p_MinRuntime    - The smallest virtual runtime among its competitors.
+//******************************************************************************
+void Scheduler::Credit(Schedulable* p_pSchedulable, unsigned long long p_MinRuntime)
+{
+    assert(this != 0);
+    assert(p_pSchedulable != 0);
+
+    unsigned long long credit = std::min(p_MinRuntime, m_SliceCycles / SLEEPER_CREDIT_DIVISOR);
+    p_pSchedulable->m_Runtime = std::max(p_pSchedulable->m_Runtime, p_MinRuntime - credit);
+}
+
+//******************************************************************************
+// Brings the virtual runtime of a thread or process down to a given one, if
+// it's larger, keeping its ready queue in order. The scheduler spin lock must
+// be held.
+//
+// Parameters:
+//  p_rQueue        - The ready queue that holds it, if it is ready.
+//  p_pSchedulable  - The thread or process to promote.
+//  p_Runtime       - The virtual runtime it may have at most.
+//******************************************************************************
+void Scheduler::Promote(RunQueue& p_rQueue, Schedulable* p_pSchedulable, unsigned long long p_Runtime)
+{
+    assert(this != 0);
+    assert(p_pSchedulable != 0);
+
+    if (p_pSchedulable->m_Runtime <= p_Runtime) return;
+
+    bool queued = p_pSchedulable->Queued();
+    if (queued) p_rQueue.Remove(p_pSchedulable);
+    p_pSchedulable->m_Runtime = p_Runtime;
+    if (queued) p_rQueue.Enqueue(p_pSchedulable);
+}
+
+//******************************************************************************
+// Returns whether a thread or process is owed enough processor time, compared
+// to another one, to take the processor from it right away.
+//
+// Parameters:
+//  p_pFirst    - The one that is waiting.
+//  p_pSecond   - The one that is running.
+//******************************************************************************
+bool Scheduler::Leads(const Schedulable* p_pFirst, const Schedulable* p_pSecond) const
+{
+    assert(this != 0);
+    assert(p_pFirst != 0);
+    assert(p_pSecond != 0);
+
+    return p_pFirst->m_Runtime + m_SliceCycles / WAKEUP_GRANULARITY_DIVISOR < p_pSecond->m_Runtime;
+}
+
+//******************************************************************************
+// Returns whether a ready thread should preempt the current thread. Threads of
+// the same process are compared with each other,  otherwise their processes
+// are. The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_pThread - The ready thread.
+//******************************************************************************
+bool Scheduler::Preempts(Thread* p_pThread) const
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+
+    // Anyone preempts the idle thread
+    if (m_pCurrent == m_spIdle.get()) return true;
+
+    // A throttled current thread gives way to anyone, while  a throttled
+    // thread waits for its next period.
+    if (m_pCurrent->m_Throttled) return true;
+    if (p_pThread->m_Throttled) return false;
+
+    // Real-time threads preempt other threads, and real-time threads with a
+    // later deadline.
+    if (p_pThread->RealTime()) return !m_pCurrent->RealTime() || p_pThread->m_Deadline < m_pCurrent->m_Deadline;
+
+    // Nothing else preempts real-time threads
+    if (m_pCurrent->RealTime()) return false;
+
+    if (p_pThread->m_pProcess == m_pRunning) return Leads(p_pThread, m_pCurrent);
+
+    return Leads(p_pThread->m_pProcess, m_pRunning);
+}
+
+//******************************************************************************
+// Attributes the processor time spent since it was last attributed  to  the
+// current thread and its process. The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_Mode - The mode in which the time was spent.
+//******************************************************************************
+void Scheduler::Spend(Schedulable::Modes p_Mode)
+{
+    assert(this != 0);
+
+    unsigned long long now = Machine::ReadTimestampCounter();
+    if (m_pCurrent != 0) {
+        m_pCurrent->Spend(now - m_SpendTime, p_Mode);
+        m_pCurrent->m_pProcess->Spend(now - m_SpendTime, p_Mode);
+    }
+    m_SpendTime = now;
+}
+
+//******************************************************************************
+// Writes the processor time spent by each thread and each process, in cycles,
+// to the debugger.
+//
+// Parameters:
+//  p_rDebugger - The debugger that receives the output.
+//******************************************************************************
+void Scheduler::DumpTimes(Core::Debugger& p_rDebugger)
+{
+    assert(this != 0);
+
+    // Copy the times while the thread vector is locked, and write them out
+    // once it's released, so that the scheduler doesn't wait for the output.
+    // The times are read while interrupts are disabled, so they can't change
+    // on this processor meanwhile. We're called from the debugger interrupt,
+    // which may have interrupted a thread that holds the heap lock, so the
+    // copy goes in a buffer of our own rather than in an allocated one.
+    size_t count, dumped = 0;
+    unsigned long long idleCycles, switches, preemptions, wakeups, timestamp;
+    {
+        InterruptLock intlock;
+        RWSpinLockReadLocker lock(m_ThreadsLock);
+
+        count = m_Threads.size();
+        for (ThreadSPVector::const_iterator it = m_Threads.begin(); it != m_Threads.end() && dumped < DUMPED_THREADS; ++it) {
+            Times& entry = m_DumpedTimes[dumped++];
+            entry.m_pThread     = it->get();
+            entry.m_pProcess    = (*it)->m_pProcess;
+            for (int mode = 0; mode < Schedulable::MODE_COUNT; ++mode) {
+                entry.m_ThreadCycles[mode]  = entry.m_pThread->Cycles(static_cast<Schedulable::Modes>(mode));
+                entry.m_ProcessCycles[mode] = entry.m_pProcess->Cycles(static_cast<Schedulable::Modes>(mode));
+            }
+        }
+
+        idleCycles  = m_IdleCycles;
+        switches    = m_Switches;
+        preemptions = m_Preemptions;
+        wakeups     = m_Wakeups;
+        timestamp   = Machine::ReadTimestampCounter();
+    }
+
+    // Write the time of each thread
+    p_rDebugger << "Thread Process User Kernel Interrupt\n";
+    const Times* pEnd = m_DumpedTimes + dumped;
+    for (const Times* it = m_DumpedTimes; it != pEnd; ++it) {
+        p_rDebugger << static_cast<void*>(const_cast<Thread*>(it->m_pThread)) << ' '
+                    << static_cast<void*>(const_cast<Process*>(it->m_pProcess)) << ' '
+                    << it->m_ThreadCycles[Schedulable::MODE_USER] << ' '
+                    << it->m_ThreadCycles[Schedulable::MODE_KERNEL] << ' '
+                    << it->m_ThreadCycles[Schedulable::MODE_INTERRUPT] << "\n";
+    }
+
+    // Write the time of each process, the first time one of its threads shows
+    // up.
+    p_rDebugger << "Process User Kernel Interrupt\n";
+    for (const Times* it = m_DumpedTimes; it != pEnd; ++it) {
+        bool seen = false;
+        for (const Times* other = m_DumpedTimes; other != it && !seen; ++other) {
+            seen = other->m_pProcess == it->m_pProcess;
+        }
+        if (seen) continue;
+
+        p_rDebugger << static_cast<void*>(const_cast<Process*>(it->m_pProcess)) << ' '
+                    << it->m_ProcessCycles[Schedulable::MODE_USER] << ' '
+                    << it->m_ProcessCycles[Schedulable::MODE_KERNEL] << ' '
+                    << it->m_ProcessCycles[Schedulable::MODE_INTERRUPT] << "\n";
+    }
+
+    // Tell how many threads didn't fit in the copy
+    if (count > dumped) {
+        p_rDebugger << "Skipped " << static_cast<unsigned>(count - dumped) << " threads\n";
+    }
+
+    // Write the time during which nothing was ready, and how often threads
+    // were switched and waked up.
+    p_rDebugger << "Idle " << idleCycles << "\n";
+    p_rDebugger << "Switches " << switches << " Preemptions " << preemptions << " Wakeups " << wakeups << " Timestamp " << timestamp << "\n";
+}
+
+//******************************************************************************
+// Debugger command that writes the processor time of threads and processes.
+//
+// Parameters:
+//  p_pScheduler - The scheduler whose threads are looked at.
+//  p_rDebugger  - The debugger that receives the output.
+//******************************************************************************
+void Scheduler::TimesCommand(void* p_pScheduler, Core::Debugger& p_rDebugger)
+{
+    static_cast<Scheduler*>(p_pScheduler)->DumpTimes(p_rDebugger);
+}
+
+//******************************************************************************
+// Debugger command that writes the latencies between wake ups and switches.
+//
+// Parameters:
+//  p_pScheduler - The scheduler whose latencies are looked at.
+//  p_rDebugger  - The debugger that receives the output.
+//******************************************************************************
+void Scheduler::LatencyCommand(void* p_pScheduler, Core::Debugger& p_rDebugger)
+{
+    Scheduler* pScheduler = static_cast<Scheduler*>(p_pScheduler);
+
+    // Copy the latencies while the scheduler is locked, and write them out
+    // once it's released. The copy is kept by the scheduler, since nothing
+    // may be allocated from the debugger interrupt.
+    pScheduler->CopyLatencies(pScheduler->m_DumpedLatencies);
+    pScheduler->m_DumpedLatencies.Dump(p_rDebugger);
+}
+
+//******************************************************************************
+// Returns the part of the processor reserved by a real-time thread, relative
+// to UTILIZATION_SCALE.
+//
+// Parameters:
+//  p_pThread - The real-time thread.
+//******************************************************************************
+unsigned Scheduler::Utilization(Thread* p_pThread) const
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->RealTime());
+
+    unsigned long long budget = p_pThread->m_Budget / Machine::GetCyclesPerClockTick();
+
+    return budget * UTILIZATION_SCALE / p_pThread->m_Period;
+}
+
+//******************************************************************************
+// Starts a new period for a real-time thread, giving it its whole budget back.
+// The scheduler spin lock must be held.
+//
+// Parameters:
+//  p_pThread   - The real-time thread.
+//  p_Now       - The current tick.
+//******************************************************************************
+void Scheduler::StartPeriod(Thread* p_pThread, unsigned long long p_Now)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->RealTime());
+
+    p_pThread->m_Deadline   = p_Now + p_pThread->m_Period;
+    p_pThread->m_Remaining  = p_pThread->m_Budget;
+}
+
+//******************************************************************************
+// Ends the throttling of a real-time thread when its next period starts.
+//
+// Parameters:
+//  p_pThread - The throttled thread.
+//******************************************************************************
+void Scheduler::Replenish(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Make sure the thread is still throttled, its reservation may have been
+    // changed since the timer expired.
+    if (!p_pThread->RealTime() || !p_pThread->m_Throttled || p_pThread->m_Replenish.Armed()) return;
+
+    // Start the next period right where the previous one ended, so that the
+    // thread keeps its pace.
+    StartPeriod(p_pThread, std::max(p_pThread->m_Deadline, Machine::GetClockTicks()));
+    p_pThread->m_Throttled = false;
+
+    // Let it compete again if it's ready, the clock handler will decide
+    // whether to switch to it.
+    if (p_pThread->m_State == Thread::STATE_READY && p_pThread != m_pCurrent) EnqueueReady(p_pThread);
+    UpdateClock();
+}
+
+//******************************************************************************
+// Timer handler for the replenishment of real-time threads.
+//
+// Parameters:
+//  p_pThread - The throttled thread.
+//******************************************************************************
+void Scheduler::ReplenishHandler(void* p_pThread)
+{
+    g_pScheduler->Replenish(static_cast<Thread*>(p_pThread));
+}
+
+//******************************************************************************
+// Ends the timed sleep of a thread whose deadline has been reached.
+//
+// Parameters:
+//  p_pThread - The thread whose sleep timed out.
+//******************************************************************************
+void Scheduler::Timeout(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    InterruptLock intlock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Make sure the thread hasn't been waked up, or put back to sleep with a
+    // new deadline, since the timer expired.
+    if (p_pThread->m_State == Thread::STATE_SLEEPING && !p_pThread->m_Timeout.Armed()) {
+        // Move it to the ready queue, the clock handler will decide whether
+        // to switch to it.
+        p_pThread->m_TimedOut = true;
+        Ready(p_pThread);
+    }
+}
+
+//******************************************************************************
+// Timer handler for the timed sleeps of threads.
+//
+// Parameters:
+//  p_pThread - The thread whose sleep timed out.
+//******************************************************************************
+void Scheduler::TimeoutHandler(void* p_pThread)
+{
+    g_pScheduler->Timeout(static_cast<Thread*>(p_pThread));
+}
+
+//******************************************************************************
+// Releases the resources of terminated threads as they come. Never returns.
+//******************************************************************************
+void Scheduler::Reap()
+{
+    assert(this != 0);
+
+    for (;;) {
+        // Wait for a terminated thread
+        Thread* pZombie;
+        {
+            InterruptLock intlock;
+            Locker<SpinLock> lock(m_ZombiesLock);
+            while (m_Zombies.Empty()) Sleep(&m_Zombies, &m_ZombiesLock);
+            pZombie = m_Zombies.PopFront();
+        }
+
+        // Get rid of it
+        RemoveThread(pZombie);
+    }
+}
+
+//******************************************************************************
+// Entry point of the reaper thread.
+//
+// Parameters:
+//  p_pScheduler - The scheduler whose terminated threads are reaped.
+//******************************************************************************
+void Scheduler::ReaperEntry(void* p_pScheduler)
+{
+    static_cast<Scheduler*>(p_pScheduler)->Reap();
+}
+
+//******************************************************************************
+// Halts the processor until some other thread is ready to run. Never returns.
+//******************************************************************************
+void Scheduler::Idle()
+{
+    assert(this != 0);
+
+    for (;;) {
+        // Interrupts stay disabled from the moment we check for ready threads
+        // until the processor is halted, so that a wake up can't sneak in
+        // between and leave us sleeping with work to do.
+        Machine::DisableInterrupts();
+        bool contended;
+        {
+            Locker<SpinLock> lock(m_SpinLock);
+            contended = Contended();
+        }
+
+        // Give the processor away, or halt it until the next interrupt.
+        if (contended) {
+            Machine::EnableInterrupts();
+            Switch();
+        } else {
+            Machine::WaitForInterrupt();
+        }
+    }
+}
+
+//******************************************************************************
+// Entry point of the idle thread.
+//
+// Parameters:
+//  p_pScheduler - The scheduler that has nothing else to run.
+//******************************************************************************
+void Scheduler::IdleEntry(void* p_pScheduler)
+{
+    static_cast<Scheduler*>(p_pScheduler)->Idle();
+}
+
+//******************************************************************************
+// Arms or disarms the  clock interrupt for the next thing the scheduler has
+// to do: ending the current time slice or firing a timer. The scheduler spin
+// lock must be held.
+//
+// In tickless mode, the slice is only enforced while other threads are ready
+// to run; a thread that runs alone isn't interrupted until a timer expires or
+// something wakes up a competitor.
+//******************************************************************************
+void Scheduler::UpdateClock()
+{
+    assert(this != 0);
+
+    // Find the earliest tick at which we'll have something to do
+    unsigned long long deadline = m_Timers.NextExpiry();
+    if (!m_Tickless || Contended()) deadline = std::min(deadline, m_SliceEnd);
+
+    // A real-time thread must be stopped when its reserved time is used up
+    if (m_pCurrent != 0 && m_pCurrent->RealTime() && !m_pCurrent->m_Throttled) {
+        unsigned long long cycles = Machine::GetCyclesPerClockTick();
+        deadline = std::min(deadline, Machine::GetClockTicks() + (m_pCurrent->m_Remaining + cycles - 1) / cycles);
+    }
+
+    if (deadline == INFINITE_DEADLINE) {
+        // Nothing would happen, so skip the interrupt
+        if (m_ClockDeadline != INFINITE_DEADLINE) {
+            Machine::DisarmClock();
+            m_ClockDeadline = INFINITE_DEADLINE;
+        }
+    } else if (deadline < m_ClockDeadline) {
+        // Request an interrupt at that tick. The delay may be cut short, in
+        // which case we'll just arm the clock again when it expires.
+        unsigned long long now = Machine::GetClockTicks();
+        unsigned delay = 1;
+        if (deadline > now) delay = std::min(deadline - now, 0xFFFFFFFFULL);
+        m_ClockDeadline = now + Machine::ArmClock(delay);
+    }
+}
+
 } // namespace Threading
 } // namespace Nutshell
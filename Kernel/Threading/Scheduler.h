@@ -6,7 +6,11 @@
 #define THREADING_SCHEDULER_H
 
 #include "Threading/Thread.h"
+#include "Threading/RunQueue.h"
+#include "Threading/TimerWheel.h"
+#include "Threading/LatencyTracer.h"
 #include "Threading/SpinLock.h"
+#include "Threading/RWSpinLock.h"
 
 namespace Nutshell {
 namespace Threading {
@@ -19,39 +23,174 @@ class Scheduler
 {
 private:
 
-    // When the  lowest effective priority reachs this limit, all threads gets
-    // their effective priority truncated to avoid wrapping.
-    static const int    EFFECTIVE_PRIORITY_LIMIT    = 1000;
+    // The number of buckets in the sleeping threads hash table. This must be
+    // a power of 2.
+    static const size_t CHANNEL_BUCKETS = 64;
+
+    // The number of clock ticks a thread may run before being preempted by
+    // another ready thread.
+    static const unsigned SLICE_TICKS = 1;
+
+    // The fixed point scale of processor utilizations, and the part of the
+    // processor that can be reserved by real-time threads. The rest is kept
+    // for the other threads.
+    static const unsigned UTILIZATION_SCALE = 1 << 16;
+    static const unsigned RESERVATION_LIMIT = UTILIZATION_SCALE / 10 * 9;
+
+    // The virtual runtime a waking thread may be credited for having slept,
+    // and the lead it must have on the current thread to preempt it, both in
+    // fractions of a slice.
+    static const unsigned SLEEPER_CREDIT_DIVISOR        = 2;
+    static const unsigned WAKEUP_GRANULARITY_DIVISOR    = 4;
+
+    // The number of threads whose processor times the debugger can write out.
+    // They're copied in a buffer of the scheduler, since the debugger runs in
+    // an interrupt handler, where nothing may be allocated.
+    static const size_t DUMPED_THREADS = 128;
+
+    //**************************************************************************
+    // This holds the processor times of a thread and of its process, copied
+    // so that they can be written out once the scheduler is unlocked.
+    struct Times {
+        const Thread*       m_pThread;                                  // The thread.
+        const Process*      m_pProcess;                                 // The process that owns the thread.
+        unsigned long long  m_ThreadCycles[Schedulable::MODE_COUNT];    // The cycles spent by the thread in each mode.
+        unsigned long long  m_ProcessCycles[Schedulable::MODE_COUNT];   // The cycles spent by the process in each mode.
+    };
 
     typedef std::vector<ThreadSP> ThreadSPVector;
-    typedef std::vector<Thread*>  ThreadVector;
 
-    ThreadSPVector      m_Threads;      // Vector that contains all the threads.
-    ThreadVector        m_Ready;        // Heap of ready threads.
-    ThreadVector        m_Sleeping;     // Vector of sleeping threads.
-    Thread*             m_pCurrent;     // Pointer to the current thread.
-    mutable SpinLock    m_SpinLock;     // The spin lock that protects the scheduler.
+    ThreadSPVector      m_Threads;                      // Vector that contains all the threads.
+    mutable RWSpinLock  m_ThreadsLock;                  // The spin lock that protects the thread vector, mostly read.
+    ThreadSP            m_spIdle;                       // The thread that runs when no other thread is ready.
+    RunQueue            m_Ready;                        // Queue of processes that have ready threads.
+    RunQueue            m_RealTime;                     // Queue of ready real-time threads, by deadline.
+    ThreadQueue         m_Sleeping[CHANNEL_BUCKETS];    // Sleeping threads, hashed by channel.
+    ThreadQueue         m_Zombies;                      // Terminated threads waiting for the reaper.
+    TimerWheel          m_Timers;                       // Timers waiting for their deadline.
+    Thread*             m_pCurrent;                     // Pointer to the current thread.
+    Process*            m_pRunning;                     // The process taken out of the ready queue for the current thread.
+    bool                m_Tickless;                     // Whether the clock is only armed when needed.
+    unsigned long long  m_ClockDeadline;                // The tick at which the clock is armed, if any.
+    unsigned long long  m_SliceEnd;                     // The tick at which the current slice ends.
+    unsigned long long  m_SliceCycles;                  // The length of a slice, in processor cycles.
+    unsigned long long  m_SwitchTime;                   // The timestamp at which the current thread was last charged.
+    unsigned long long  m_MinRuntime;                   // The smallest virtual runtime among processes, never decreasing.
+    unsigned            m_Reserved;                     // The processor utilization reserved by real-time threads.
+    unsigned long long  m_IdleCycles;                   // The processor cycles spent in the idle thread.
+    unsigned long long  m_SpendTime;                    // The timestamp at which processor time was last attributed.
+    LatencyTracer       m_Latencies;                    // The latencies between wake ups and switches.
+    LatencyTracer       m_DumpedLatencies;              // The copy of the latencies written out by the debugger.
+    Times               m_DumpedTimes[DUMPED_THREADS];  // The copy of the processor times written out by the debugger.
+    unsigned long long  m_Switches;                     // The number of times another thread was switched to.
+    unsigned long long  m_Preemptions;                  // The number of those switches that preempted a ready thread.
+    unsigned long long  m_Wakeups;                      // The number of times a sleeping thread was made ready.
+    volatile unsigned   m_Preemption;                   // The number of times the current thread disabled preemption.
+    volatile bool       m_Deferred;                     // Whether a preemption waits for the current thread to enable it.
+    mutable SpinLock    m_SpinLock;                     // The spin lock that protects the scheduler.
+    SpinLock            m_ZombiesLock;                  // The spin lock that protects the terminated threads.
 
 public:
 
     // Construction / destruction
-    Scheduler();
+    Scheduler(bool p_Tickless = true);
     ~Scheduler();
 
     // Thread list management
     void AddThread(ThreadSP p_spThread);
     void RemoveThread(Thread* p_pThread);
+    void Exit();
+    void StartReaper(ProcessSP p_spProcess);
+    void StartIdle(ProcessSP p_spProcess);
 
     // Interrupts handlers
     void Clock();
+    void EnterInterrupt(void* p_pEIP);
+    void LeaveInterrupt();
+
+    // Real-time reservations
+    bool Reserve(Thread* p_pThread, unsigned p_Budget, unsigned p_Period);
+
+    // Priority inheritance
+    void Lend(Thread* p_pDonor, Thread* p_pOwner);
+
+    // Timers management
+    void StartTimer(Timer* p_pTimer, unsigned long long p_Deadline);
+    bool StopTimer(Timer* p_pTimer);
 
     // Basic synchronization primitives
-    void   Switch();
-    void   Sleep(void* p_pChannel, int p_Boost = 0, SpinLock* p_pSpinLock = 0);
-    size_t WakeUp(void* p_pChannel, SpinLock* p_pSpinLock = 0);
+    void    Switch();
+    bool    YieldTo(Thread* p_pThread);
+    bool    Sleep(void* p_pChannel, SpinLock* p_pSpinLock = 0, unsigned long long p_Deadline = INFINITE_DEADLINE);
+    void    SleepUntil(unsigned long long p_Deadline);
+    bool    WakeUpAndSleep(void* p_pWakeChannel, void* p_pSleepChannel, unsigned long long p_Deadline = INFINITE_DEADLINE);
+    size_t  WakeUp(void* p_pChannel, SpinLock* p_pSpinLock = 0);
+    Thread* WakeOne(void* p_pChannel, SpinLock* p_pSpinLock = 0, Thread** p_ppOwner = 0);
+    Thread* Requeue(void* p_pChannel, void* p_pTarget);
+
+    // Preemption control
+    void    DisablePreemption();
+    void    EnablePreemption();
+    bool    Preemptible() const;
 
     // Misceallenous
-    Thread* Current() const;
+    Thread*             Current() const;
+    bool                Running(const Thread* p_pThread) const;
+    unsigned long long  IdleCycles() const;
+    unsigned long long  Switches() const;
+    unsigned long long  Wakeups() const;
+    void                CopyLatencies(LatencyTracer& p_rCopy) const;
+
+private:
+
+    // Sleeping threads management
+    ThreadQueue& Channel(void* p_pChannel);
+    void         Suspend(void* p_pChannel, unsigned long long p_Deadline);
+    bool         Ready(Thread* p_pThread);
+    void         Timeout(Thread* p_pThread);
+    static void  TimeoutHandler(void* p_pThread);
+
+    // Terminated threads management
+    void         Reap();
+    static void  ReaperEntry(void* p_pScheduler);
+
+    // Idle thread management
+    void         Idle();
+    static void  IdleEntry(void* p_pScheduler);
+
+    // Clock management
+    void UpdateClock();
+
+    // Switching
+    void SwitchTo(Thread* p_pNext);
+    bool Reschedule();
+
+    // Ready queues management
+    void    EnqueueReady(Thread* p_pThread);
+    void    RemoveReady(Thread* p_pThread);
+    Thread* DequeueReady();
+    Thread* DequeueReady(Thread* p_pThread);
+    bool    Contended() const;
+    bool    Preempted() const;
+
+    // Virtual runtime management
+    void    Account();
+    void    Credit(Schedulable* p_pSchedulable, unsigned long long p_MinRuntime);
+    void    Promote(RunQueue& p_rQueue, Schedulable* p_pSchedulable, unsigned long long p_Runtime);
+    bool    Leads(const Schedulable* p_pFirst, const Schedulable* p_pSecond) const;
+    bool    Preempts(Thread* p_pThread) const;
+
+    // Processor time management
+    void         Spend(Schedulable::Modes p_Mode);
+    void         DumpTimes(Core::Debugger& p_rDebugger);
+    static void  TimesCommand(void* p_pScheduler, Core::Debugger& p_rDebugger);
+    static void  LatencyCommand(void* p_pScheduler, Core::Debugger& p_rDebugger);
+
+    // Real-time reservations management
+    unsigned     Utilization(Thread* p_pThread) const;
+    void         StartPeriod(Thread* p_pThread, unsigned long long p_Now);
+    void         Replenish(Thread* p_pThread);
+    static void  ReplenishHandler(void* p_pThread);
 };
 
 } // namespace Threading
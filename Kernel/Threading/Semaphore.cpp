@@ -0,0 +1,92 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/Semaphore.h"
+#include "Threading/Scheduler.h"
+#include "Threading/PreemptLock.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_Count - The number of units that are initially available.
+//******************************************************************************
+Semaphore::Semaphore(unsigned p_Count)
+:   m_Count(p_Count)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Semaphore::~Semaphore()
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Takes one unit from the semaphore, waiting for one to be posted if there's
+// none available.
+//
+// Parameters:
+//  p_Deadline - The tick at which we stop waiting.
+//
+// Returns:
+//  Whether a unit was taken before the deadline.
+//******************************************************************************
+bool Semaphore::Wait(unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    // Another thread may take the unit we were waked up for, so check again
+    while (m_Count == 0) {
+        if (!g_pScheduler->Sleep(this, &m_SpinLock, p_Deadline) && m_Count == 0) return false;
+    }
+
+    --m_Count;
+
+    return true;
+}
+
+//******************************************************************************
+// Takes one unit from the semaphore, if one is available.
+//
+// Returns:
+//  Whether a unit was taken.
+//******************************************************************************
+bool Semaphore::TryWait()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    if (m_Count == 0) return false;
+    --m_Count;
+
+    return true;
+}
+
+//******************************************************************************
+// Gives one unit back to the semaphore, waking up the thread that has been
+// waiting the longest for it.
+//******************************************************************************
+void Semaphore::Post()
+{
+    assert(this != 0);
+    PreemptLock prelock;
+    Locker<SpinLock> lock(m_SpinLock);
+
+    ++m_Count;
+    g_pScheduler->WakeOne(this, &m_SpinLock);
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,39 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_SEMAPHORE_H
+#define THREADING_SEMAPHORE_H
+
+#include "Threading/SpinLock.h"
+#include "Threading/Timer.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class encapsulates a counting semaphore. Waiting takes one unit from
+// the count, sleeping while it is zero, and posting gives one back.
+//******************************************************************************
+class Semaphore : boost::noncopyable {
+private:
+
+    unsigned    m_Count;    // The number of units that are available.
+    SpinLock    m_SpinLock; // The spin lock that protects the semaphore.
+
+public:
+
+    // Construction / destruction
+    explicit Semaphore(unsigned p_Count = 0);
+    ~Semaphore();
+
+    // Semaphore manipulation
+    bool    Wait(unsigned long long p_Deadline = INFINITE_DEADLINE);
+    bool    TryWait();
+    void    Post();
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_SEMAPHORE_H
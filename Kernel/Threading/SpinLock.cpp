@@ -5,18 +5,25 @@
 #include "Global.h"
 #include "Machine.h"
 #include "Threading/SpinLock.h"
+#include "Threading/Scheduler.h"
 
 namespace Nutshell {
 namespace Threading {
 
 //******************************************************************************
 // Constructor.
+//
+// Parameters:
+//  p_pName - The name of the class of the lock, for lock statistics.
 //******************************************************************************
-SpinLock::SpinLock()
-:   m_Owner(0),
-    m_Count(0)
+SpinLock::SpinLock(const char* p_pName)
+:   m_Next(0),
+    m_Serving(0)
 {
     assert(this != 0);
+
+    LOCKSTATCODE(m_pClass = LockClass::Find(p_pName));
+    LOCKSTATCODE(m_LockTime = 0);
 }
 
 //******************************************************************************
@@ -25,27 +32,38 @@ SpinLock::SpinLock()
 SpinLock::~SpinLock()
 {
     assert(this != 0);
-    assert(m_Owner == 0);
+    assert(!Locked());
 }
 
 //******************************************************************************
-// Locks the spin lock.
+// Locks the spin lock. The spin lock can't be locked again by its holder.
 //******************************************************************************
 void SpinLock::Lock()
 {
     assert(this != 0);
-    assert(!Machine::DisableInterrupts());
+    assert(Protected());
 
-    // Check if we already got the lock
-    int descriptor = Machine::GetCurrentTaskDescriptor();
-    if (m_Owner != descriptor) {
-        // Loop until we own the lock
-        while (Utilities::ThreadSafeCompareExchange(m_Owner, Machine::GetCurrentTaskDescriptor(), 0) != 0);
+    // Take a ticket and wait for it to be served, so that the lock goes to
+    // the processors in the order they asked for it.  Waiting only  reads
+    // the lock, which stays in the cache until it's released.
+    unsigned ticket = m_Next.FetchAdd(1);
+    LOCKSTATCODE(unsigned long long start = Machine::ReadTimestampCounter());
+    LOCKSTATCODE(unsigned long long spins = 0);
+    while (m_Serving.Load() != ticket) {
+        Utilities::SpinPause();
+        LOCKSTATCODE(++spins);
     }
 
-    // When we get here we have the lock
-    assert(m_Owner == descriptor);
-    ++m_Count;
+#ifdef _LOCKSTAT
+    // Account for the acquisition, and for the wait if there was one
+    m_LockTime = Machine::ReadTimestampCounter();
+    if (spins == 0) {
+        m_pClass->Acquired();
+    } else {
+        m_pClass->Contended(m_LockTime - start);
+        m_pClass->Spun(spins);
+    }
+#endif // _LOCKSTAT
 }
 
 //******************************************************************************
@@ -57,24 +75,18 @@ void SpinLock::Lock()
 bool SpinLock::TryLock()
 {
     assert(this != 0);
-    assert(!Machine::DisableInterrupts());
-
-    // Check if we already got the lock
-    int descriptor = Machine::GetCurrentTaskDescriptor();
-    if (m_Owner != descriptor) {
-        // Attempt to get the lock once
-        if (Utilities::ThreadSafeCompareExchange(m_Owner, Machine::GetCurrentTaskDescriptor(), 0) == 0) {
-            ++m_Count;
-            return true;
-        }
-    } else {
-        // Just increment our lock count
-        ++m_Count;
-        return true;
-    }
+    assert(Protected());
+
+    // Take a ticket only if it would be served right away
+    unsigned serving = m_Serving.Load();
+    if (m_Next.Load() != serving) return false;
+
+    if (m_Next.CompareExchange(serving + 1, serving) != serving) return false;
+
+    LOCKSTATCODE(m_LockTime = Machine::ReadTimestampCounter());
+    LOCKSTATCODE(m_pClass->Acquired());
 
-    // If we get here we don't have the lock
-    return false;
+    return true;
 }
 
 //******************************************************************************
@@ -83,23 +95,34 @@ bool SpinLock::TryLock()
 void SpinLock::Unlock()
 {
     assert(this != 0);
-    assert(!Machine::DisableInterrupts());
-    assert(m_Owner == Machine::GetCurrentTaskDescriptor());
+    assert(Protected());
+    assert(Locked());
 
-    // Release the lock if the lock count drops to zero
-    if (--m_Count == 0) {
-        m_Owner = 0;
-    }
+    LOCKSTATCODE(m_pClass->Released(Machine::ReadTimestampCounter() - m_LockTime));
+
+    // Serve the next ticket. Only the holder writes this, so  there's  no
+    // need for a locked instruction.
+    m_Serving.Store(m_Serving.Load() + 1);
 }
 
 //******************************************************************************
-// Returns the number of times the spinlock have been recursively locked.
+// Returns whether the spin lock is held.
 //******************************************************************************
-size_t SpinLock::Count() const
+bool SpinLock::Locked() const
 {
     assert(this != 0);
-    assert(m_Owner == Machine::GetCurrentTaskDescriptor());
-    return m_Count;
+
+    return m_Next.Load() != m_Serving.Load();
+}
+
+//******************************************************************************
+// Returns whether the current thread can't be switched out while it holds a
+// spin lock: either interrupts or preemption must be disabled.  Otherwise
+// it could wait for a thread that holds the lock but doesn't get to run.
+//******************************************************************************
+bool SpinLock::Protected()
+{
+    return !Machine::InterruptsEnabled() || g_pScheduler == 0 || !g_pScheduler->Preemptible();
 }
 
 } // namespace Threading
@@ -6,23 +6,32 @@
 #define THREADING_SPINLOCK_H
 
 #include "Threading/Guards.h"
+#include "Threading/LockClass.h"
+#include "Utilities/Atomic.h"
 
 namespace Nutshell {
 namespace Threading {
 
 //******************************************************************************
-// This class encapsulates a spin lock.
+// This class encapsulates a ticket spin lock. Processors get the lock in the
+// order they asked for it. It can't be locked recursively:  RecursiveSpinLock
+// is meant for that.
 //******************************************************************************
 class SpinLock : boost::noncopyable {
 private:
 
-    int     m_Owner;    // The task descriptor that owns the spin lock.
-    int     m_Count;    // The number of times we've been locked.
+    Utilities::Atomic<unsigned> m_Next;     // The ticket handed to the next processor that locks.
+    Utilities::Atomic<unsigned> m_Serving;  // The ticket of the processor that holds the lock.
+
+#ifdef _LOCKSTAT
+    LockClass*          m_pClass;       // The class whose statistics the lock updates.
+    unsigned long long  m_LockTime;     // The timestamp at which the lock was acquired.
+#endif // _LOCKSTAT
 
 public:
 
     // Construction / destruction
-    SpinLock();
+    explicit SpinLock(const char* p_pName = "SpinLock");
     ~SpinLock();
 
     // Spinlock management
@@ -31,7 +40,10 @@ public:
     void    Unlock();
 
     // Spinlock information
-    size_t  Count() const;
+    bool    Locked() const;
+
+    // Spinlock checks
+    static bool Protected();
 };
 
 typedef Locker<SpinLock> SpinLockLocker;
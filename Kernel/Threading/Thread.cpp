@@ -5,6 +5,9 @@
 #include "Global.h"
 #include "Machine.h"
 #include "Threading/Thread.h"
+#include "Threading/Scheduler.h"
+#include "Threading/Mutex.h"
+#include "Threading/PreemptLock.h"
 #include "Paging/Pager.h"
 
 namespace Nutshell {
@@ -13,6 +16,8 @@ namespace Threading {
 Thread::SpecificDestructorVector Thread::s_SpecificDestructors;
 Thread::SpecificIndexVector Thread::s_AvailableSpecifics;
 SpinLock Thread::s_SpecificsLock;
+Thread::MapableVector Thread::s_KernelStacks;
+SpinLock Thread::s_KernelStacksLock;
 
 //******************************************************************************
 // Constructor.
@@ -24,27 +29,59 @@ SpinLock Thread::s_SpecificsLock;
 //******************************************************************************
 Thread::Thread(ProcessSP p_spProcess, void (* p_pEntry)(void*), void* p_pArgument)
 :   m_wpProcess(p_spProcess),
+    m_pProcess(p_spProcess.get()),
     m_Task(),
-    m_spKernelStack(new Paging::Mapable(KERNEL_STACK_SIZE)),
+    m_spKernelStack(),
+    m_pEntry(p_pEntry),
+    m_pArgument(p_pArgument),
     m_State(STATE_READY),
     m_Base(PRIORITY_NORMAL),
-    m_Boost(0),
-    m_Effective(),
+    m_Effective(PRIORITY_NORMAL),
+    m_pBlockedOn(0),
+    m_pHeld(0),
     m_pChannel(0),
+    m_Timeout(),
+    m_TimedOut(false),
+    m_Interrupts(0),
+    m_WakeTime(0),
+    m_Preemption(0),
+    m_SwitchInTime(0),
+    m_Budget(0),
+    m_Period(0),
+    m_Remaining(0),
+    m_Throttled(false),
+    m_Replenish(),
+    m_pNext(0),
+    m_pPrevious(0),
+    m_pQueue(0),
     m_Specifics()
 {
     assert(this != 0);
     assert(p_spProcess != 0);
     assert(p_pEntry != 0);
 
-    // Lock the kernel stack into memory and map it within the process
-    g_pPager->LockMapable(m_spKernelStack);
+    // Reuse the kernel stack of a terminated thread if possible, since it is
+    // already locked into memory.
+    {
+        PreemptLock prelock;
+        SpinLockLocker lock(s_KernelStacksLock);
+        if (!s_KernelStacks.empty()) {
+            m_spKernelStack = s_KernelStacks.back();
+            s_KernelStacks.pop_back();
+        }
+    }
+
+    // Otherwise create a new one and lock it into memory
+    if (m_spKernelStack == 0) {
+        m_spKernelStack.reset(new Paging::Mapable(KERNEL_STACK_SIZE));
+        g_pPager->LockMapable(m_spKernelStack);
+    }
+
+    // Map the kernel stack within the process
     size_t stack = p_spProcess->Map(m_spKernelStack);
 
     // Allocate a task descriptor for the thread
-    // TODO: Check if it is valid!
-    // TODO: Make p_pArgument work !
-    m_Task = Machine::AllocateTaskDescriptor(p_spProcess->Directory(), stack + KERNEL_STACK_SIZE, p_pEntry);
+    m_Task = Machine::AllocateTaskDescriptor(p_spProcess->Directory(), stack + KERNEL_STACK_SIZE, &Start, this);
 }
 
 //******************************************************************************
@@ -56,6 +93,7 @@ Thread::~Thread()
 
     // Call all thread specific destructors
     {
+        PreemptLock prelock;
         SpinLockLocker lock(s_SpecificsLock);
         assert(m_Specifics.size() >= s_SpecificDestructors.size());
         for (int i = 0; i < s_SpecificDestructors.size(); ++i) {
@@ -66,10 +104,25 @@ Thread::~Thread()
         }
     }
 
-    // Unmap the kernel stack from the process
-    boost::make_shared(m_wpProcess)->Unmap(m_spKernelStack);
+    // Unmap the kernel stack from the process, unless it's already gone
+    ProcessSP spProcess = m_wpProcess.lock();
+    if (spProcess != 0) spProcess->Unmap(m_spKernelStack);
+
+    // Keep the kernel stack for another thread if there is room left in the
+    // cache, otherwise let it go.
+    bool cached = false;
+    {
+        PreemptLock prelock;
+        SpinLockLocker lock(s_KernelStacksLock);
+        if (s_KernelStacks.size() < KERNEL_STACK_CACHE) {
+            s_KernelStacks.push_back(m_spKernelStack);
+            cached = true;
+        }
+    }
+    if (!cached) g_pPager->UnlockMapable(m_spKernelStack);
 
-    // Release our task descriptor
+    // Release our task descriptor. The machine layer keeps the clock interrupt
+    // away while it does.
     Machine::ReleaseTaskDescriptor(m_Task);
 }
 
@@ -84,6 +137,30 @@ void Thread::Switch()
     }
 }
 
+//******************************************************************************
+// Returns the base priority of the thread.
+//******************************************************************************
+Thread::Priorities Thread::Priority() const
+{
+    assert(this != 0);
+
+    return m_Base;
+}
+
+//******************************************************************************
+// Changes the base priority of the thread. Its effective priority stays raised
+// as long as threads with a better priority wait for its mutexes.
+//
+// Parameters:
+//  p_Priority - The new base priority.
+//******************************************************************************
+void Thread::Priority(Priorities p_Priority)
+{
+    assert(this != 0);
+
+    Mutex::Rebase(this, p_Priority);
+}
+
 //******************************************************************************
 // Returns the process that owns the thread.
 //******************************************************************************
@@ -115,6 +192,7 @@ size_t Thread::Task()
 //******************************************************************************
 int Thread::AllocateSpecific(void (* p_pDestructor)(void*))
 {
+    PreemptLock prelock;
     SpinLockLocker lock(s_SpecificsLock);
 
     // Look for a released one
@@ -142,6 +220,7 @@ int Thread::AllocateSpecific(void (* p_pDestructor)(void*))
 void Thread::ReleaseSpecific(int p_Index)
 {
     assert(p_Index < s_SpecificDestructors.size());
+    PreemptLock prelock;
     SpinLockLocker lock(s_SpecificsLock);
     assert(!Utilities::SequenceContains(s_AvailableSpecifics, p_Index));
 
@@ -180,19 +259,106 @@ void Thread::Specific(int p_Index, void* p_pValue)
 }
 
 //******************************************************************************
-// Operator <.
+// Returns the weight of the thread. Ready threads of a process share the time
+// of the process in proportion of their weights; each priority step doubles
+// the share of a thread, and realtime threads get eight times the share of
+// high ones.
+//******************************************************************************
+unsigned Thread::Weight() const
+{
+    assert(this != 0);
+
+    // The weights of the priorities, from realtime to very low
+    static const unsigned s_Weights[] = {
+        NORMAL_WEIGHT * 16,
+        NORMAL_WEIGHT * 2,
+        NORMAL_WEIGHT,
+        NORMAL_WEIGHT / 2,
+        NORMAL_WEIGHT / 4
+    };
+
+    return s_Weights[PriorityClass()];
+}
+
+//******************************************************************************
+// Returns the weight at which the process of the thread is charged while the
+// thread runs. A thread that inherits a priority runs on behalf of the threads
+// waiting for its mutexes, which may belong to other processes: its process is
+// then charged at the weight of the donor, so that a process with a small
+// share can't hold up the waiters behind the other processes.
+//******************************************************************************
+unsigned Thread::Share() const
+{
+    assert(this != 0);
+
+    unsigned share = m_pProcess->Share();
+    if (m_Effective < m_Base) share = std::max(share, Weight());
+
+    return share;
+}
+
+//******************************************************************************
+// Returns the priority class of the thread, from 0 for realtime threads to 4
+// for very low priority ones. It follows the priority the thread inherits.
+//******************************************************************************
+size_t Thread::PriorityClass() const
+{
+    assert(this != 0);
+
+    return PriorityClass(m_Effective);
+}
+
+//******************************************************************************
+// Returns the class of a priority, from 0 for realtime to 4 for very low.
 //
 // Parameters:
-//  p_Thread - The thread to compare to.
+//  p_Priority - The priority whose class is requested.
+//******************************************************************************
+size_t Thread::PriorityClass(Priorities p_Priority)
+{
+    return p_Priority / (PRIORITY_LOW - PRIORITY_NORMAL);
+}
+
+//******************************************************************************
+// Returns the priority of a class, from realtime for 0 to very low for 4.
 //
-// Returns:  Whether our effective priority is the lowest (which means
-// that it is higher than that of /p_Thread/).
+// Parameters:
+//  p_Class - The class whose priority is requested.
 //******************************************************************************
-bool Thread::operator<(const Thread& p_Thread) const
+Thread::Priorities Thread::ClassPriority(size_t p_Class)
+{
+    assert(p_Class < PRIORITY_CLASSES);
+
+    return static_cast<Priorities>(p_Class * (PRIORITY_LOW - PRIORITY_NORMAL));
+}
+
+//******************************************************************************
+// Returns whether the thread has a processor time reservation, in which case
+// it is scheduled by deadline ahead of all other threads.
+//******************************************************************************
+bool Thread::RealTime() const
 {
     assert(this != 0);
 
-    return m_Effective > p_Thread.m_Effective;
+    return m_Period != 0;
+}
+
+//******************************************************************************
+// Entry point of all threads. Calls the real entry point of the thread, and
+// terminates the thread when it returns.
+//
+// Parameters:
+//  p_pThread - The thread being started.
+//******************************************************************************
+void Thread::Start(void* p_pThread)
+{
+    Thread* pThread = static_cast<Thread*>(p_pThread);
+
+    // Run the thread
+    pThread->m_pEntry(pThread->m_pArgument);
+
+    // The thread is done
+    g_pScheduler->Exit();
 }
 
 } // namespace Threading
@@ -6,26 +6,22 @@
 #define THREADING_THREAD_H
 
 #include "Threading/Process.h"
+#include "Threading/Schedulable.h"
 #include "Threading/SpinLock.h"
+#include "Threading/ThreadQueue.h"
+#include "Threading/Timer.h"
 #include "Paging/Pager.h"
 
 namespace Nutshell {
 namespace Threading {
 
+class Mutex;
+
 //******************************************************************************
 // This class encapsulates a thread.
 //******************************************************************************
-class Thread {
-private:
-
-    // The size of thread's kernel stack (in bytes)
-    static const size_t     KERNEL_STACK_SIZE   = 16 * 4096;
-
-    // The various states a thread can have.
-    enum States {
-        STATE_READY         = 0,
-        STATE_SLEEPING      = 1
-    };
+class Thread : public Schedulable {
+public:
 
     // The various priorities a thread can have.
     enum Priorities {
@@ -36,26 +32,69 @@ private:
         PRIORITY_REALTIME   = 0
     };
 
+private:
+
+    // The number of priority classes, one per priority
+    static const size_t     PRIORITY_CLASSES    = 5;
+
+    // The size of thread's kernel stack (in bytes)
+    static const size_t     KERNEL_STACK_SIZE   = 16 * 4096;
+
+    // The number of released kernel stacks kept locked for new threads
+    static const size_t     KERNEL_STACK_CACHE  = 16;
+
+    // The various states a thread can have.
+    enum States {
+        STATE_READY         = 0,
+        STATE_SLEEPING      = 1,
+        STATE_ZOMBIE        = 2
+    };
+
     typedef std::vector<void*> SpecificValueVector;
     typedef std::vector<void (*)(void*)> SpecificDestructorVector;
     typedef std::vector<int> SpecificIndexVector;
+    typedef std::vector<Paging::MapableSP> MapableVector;
 
     ProcessWP                       m_wpProcess;            // The process that owns the thread.
+    Process*                        m_pProcess;             // The process that owns the thread, for the scheduler.
     size_t                          m_Task;                 // The task descriptor of the thread.
     Paging::MapableSP               m_spKernelStack;        // The mapable for the kernel stack.
+    void                            (* m_pEntry)(void*);    // The entry point of the thread.
+    void*                           m_pArgument;            // The argument passed to the entry point.
 
     States                          m_State;                // The state of the thread.
     Priorities                      m_Base;                 // The base priority of the thread.
-    int                             m_Boost;                // The priority boost of the thread.
-    int                             m_Effective;            // The effective priority of the thread.
+    Priorities                      m_Effective;            // The base priority, raised by the threads waiting for its mutexes.
+    Mutex*                          m_pBlockedOn;           // The mutex the thread is waiting for, if any.
+    Mutex*                          m_pHeld;                // The first of the mutexes the thread owns.
     void*                           m_pChannel;             // The channel on which the thread is sleeping.
+    Timer                           m_Timeout;              // The timer that ends a timed sleep.
+    bool                            m_TimedOut;             // Whether the last sleep ended by timing out.
+    unsigned                        m_Interrupts;           // The number of interrupt handlers the thread is running.
+    unsigned long long              m_WakeTime;             // The timestamp at which the thread was woken up, 0 once it ran.
+    unsigned                        m_Preemption;           // The preemption disable count of the thread while it's switched out.
+    unsigned long long              m_SwitchInTime;         // The timestamp at which the thread last started running.
+
+    unsigned long long              m_Budget;               // The reserved processor time per period, in cycles.
+    unsigned                        m_Period;               // The period of the reservation, in clock ticks (0 if none).
+    unsigned long long              m_Remaining;            // The reserved processor time left in the period, in cycles.
+    bool                            m_Throttled;            // Whether the reserved time of the period is used up.
+    Timer                           m_Replenish;            // The timer that starts the next period once throttled.
+
+    Thread*                         m_pNext;                // The next thread in the queue holding the thread.
+    Thread*                         m_pPrevious;            // The previous thread in the queue holding the thread.
+    ThreadQueue*                    m_pQueue;               // The queue holding the thread, if any.
 
     SpecificValueVector             m_Specifics;            // Vector of thread specific values.
     static SpecificDestructorVector s_SpecificDestructors;  // Vector of destructors for specific indexes.
     static SpecificIndexVector      s_AvailableSpecifics;   // Vector of available specific indexes.
     static SpinLock                 s_SpecificsLock;        // Lock that protects the thread specific members.
+    static MapableVector            s_KernelStacks;         // Released kernel stacks, still locked in memory.
+    static SpinLock                 s_KernelStacksLock;     // Lock that protects the released kernel stacks.
 
+    friend class Mutex;
     friend class Scheduler;
+    friend class ThreadQueue;
 
 public:
 
@@ -69,6 +108,8 @@ public:
     // Thread information
     Process*    OwnerProcess() const;
     size_t      Task();
+    Priorities  Priority() const;
+    void        Priority(Priorities p_Priority);
 
     // Thread specific values
     static int  AllocateSpecific(void (* p_pDestructor)(void*) = 0);
@@ -76,8 +117,18 @@ public:
     void*       Specific(int p_Index) const;
     void        Specific(int p_Index, void* p_pValue);
 
-    // Operators
-    bool operator<(const Thread& p_Thread) const;
+private:
+
+    // Scheduling information
+    unsigned    Weight() const;
+    unsigned    Share() const;
+    size_t      PriorityClass() const;
+    static size_t       PriorityClass(Priorities p_Priority);
+    static Priorities   ClassPriority(size_t p_Class);
+    bool        RealTime() const;
+
+    // Thread entry point
+    static void Start(void* p_pThread);
 };
 
 typedef boost::shared_ptr<Thread> ThreadSP;
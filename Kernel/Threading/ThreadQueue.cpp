@@ -0,0 +1,183 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/ThreadQueue.h"
+#include "Threading/Thread.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+ThreadQueue::ThreadQueue()
+:   m_pFirst(0),
+    m_pLast(0),
+    m_Size(0)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+ThreadQueue::~ThreadQueue()
+{
+    assert(this != 0);
+    assert(m_pFirst == 0);
+}
+
+//******************************************************************************
+// Adds a thread at the end of the queue.
+//
+// Parameters:
+//  p_pThread - The thread to add to the queue.
+//******************************************************************************
+void ThreadQueue::PushBack(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pQueue == 0);
+
+    // Link the thread after the last one
+    p_pThread->m_pNext      = 0;
+    p_pThread->m_pPrevious  = m_pLast;
+    p_pThread->m_pQueue     = this;
+    if (m_pLast != 0) {
+        m_pLast->m_pNext = p_pThread;
+    } else {
+        m_pFirst = p_pThread;
+    }
+    m_pLast = p_pThread;
+
+    ++m_Size;
+}
+
+//******************************************************************************
+// Adds a thread at the beginning of the queue.
+//
+// Parameters:
+//  p_pThread - The thread to add to the queue.
+//******************************************************************************
+void ThreadQueue::PushFront(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pQueue == 0);
+
+    // Link the thread before the first one
+    p_pThread->m_pNext      = m_pFirst;
+    p_pThread->m_pPrevious  = 0;
+    p_pThread->m_pQueue     = this;
+    if (m_pFirst != 0) {
+        m_pFirst->m_pPrevious = p_pThread;
+    } else {
+        m_pLast = p_pThread;
+    }
+    m_pFirst = p_pThread;
+
+    ++m_Size;
+}
+
+//******************************************************************************
+// Removes the first thread of the queue.
+//
+// Returns:
+//  The thread that was removed, or 0 if the queue is empty.
+//******************************************************************************
+Thread* ThreadQueue::PopFront()
+{
+    assert(this != 0);
+
+    // Remove the first thread, if any
+    Thread* pThread = m_pFirst;
+    if (pThread != 0) Remove(pThread);
+
+    return pThread;
+}
+
+//******************************************************************************
+// Removes a thread from anywhere within the queue.
+//
+// Parameters:
+//  p_pThread - The thread to remove from the queue.
+//******************************************************************************
+void ThreadQueue::Remove(Thread* p_pThread)
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pQueue == this);
+    assert(m_Size > 0);
+
+    // Unlink the thread from its neighbours
+    if (p_pThread->m_pPrevious != 0) {
+        p_pThread->m_pPrevious->m_pNext = p_pThread->m_pNext;
+    } else {
+        m_pFirst = p_pThread->m_pNext;
+    }
+    if (p_pThread->m_pNext != 0) {
+        p_pThread->m_pNext->m_pPrevious = p_pThread->m_pPrevious;
+    } else {
+        m_pLast = p_pThread->m_pPrevious;
+    }
+
+    // The thread no longer belongs to any queue
+    p_pThread->m_pNext      = 0;
+    p_pThread->m_pPrevious  = 0;
+    p_pThread->m_pQueue     = 0;
+
+    --m_Size;
+}
+
+//******************************************************************************
+// Returns the first thread of the queue, or 0 if the queue is empty.
+//******************************************************************************
+Thread* ThreadQueue::Front() const
+{
+    assert(this != 0);
+
+    return m_pFirst;
+}
+
+//******************************************************************************
+// Returns the thread that follows another one within the queue.
+//
+// Parameters:
+//  p_pThread - The thread whose follower is requested.
+//
+// Returns:
+//  The next thread, or 0 if /p_pThread/ is the last one.
+//******************************************************************************
+Thread* ThreadQueue::Next(Thread* p_pThread) const
+{
+    assert(this != 0);
+    assert(p_pThread != 0);
+    assert(p_pThread->m_pQueue == this);
+
+    return p_pThread->m_pNext;
+}
+
+//******************************************************************************
+// Returns whether the queue is empty.
+//******************************************************************************
+bool ThreadQueue::Empty() const
+{
+    assert(this != 0);
+
+    return m_pFirst == 0;
+}
+
+//******************************************************************************
+// Returns the number of threads in the queue.
+//******************************************************************************
+size_t ThreadQueue::Size() const
+{
+    assert(this != 0);
+
+    return m_Size;
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,48 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_THREADQUEUE_H
+#define THREADING_THREADQUEUE_H
+
+namespace Nutshell {
+namespace Threading {
+
+class Thread;
+
+//******************************************************************************
+// This class encapsulates an intrusive FIFO queue of threads. The links  used
+// to chain the threads are stored within the threads themselves, so  queueing
+// and dequeueing never allocates memory. A thread may only be in one queue at
+// a time.
+//******************************************************************************
+class ThreadQueue : boost::noncopyable {
+private:
+
+    Thread*     m_pFirst;   // The first thread in the queue.
+    Thread*     m_pLast;    // The last thread in the queue.
+    size_t      m_Size;     // The number of threads in the queue.
+
+public:
+
+    // Construction / destruction
+    ThreadQueue();
+    ~ThreadQueue();
+
+    // Queue management
+    void    PushBack(Thread* p_pThread);
+    void    PushFront(Thread* p_pThread);
+    Thread* PopFront();
+    void    Remove(Thread* p_pThread);
+
+    // Queue information
+    Thread* Front() const;
+    Thread* Next(Thread* p_pThread) const;
+    bool    Empty() const;
+    size_t  Size() const;
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_THREADQUEUE_H
@@ -0,0 +1,86 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/Timer.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_pHandler - The function called when the timer expires.
+//  p_pContext - The argument passed to the handler.
+//******************************************************************************
+Timer::Timer(void (* p_pHandler)(void*), void* p_pContext)
+:   m_Deadline(INFINITE_DEADLINE),
+    m_pHandler(p_pHandler),
+    m_pContext(p_pContext),
+    m_pNext(0),
+    m_pPrevious(0),
+    m_Slot(-1)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+Timer::~Timer()
+{
+    assert(this != 0);
+    assert(!Armed());
+}
+
+//******************************************************************************
+// Changes the function called when the timer expires.
+//
+// Parameters:
+//  p_pHandler - The function called when the timer expires.
+//  p_pContext - The argument passed to the handler.
+//******************************************************************************
+void Timer::Handler(void (* p_pHandler)(void*), void* p_pContext)
+{
+    assert(this != 0);
+    assert(!Armed());
+
+    m_pHandler = p_pHandler;
+    m_pContext = p_pContext;
+}
+
+//******************************************************************************
+// Calls the handler of the timer.
+//******************************************************************************
+void Timer::Fire()
+{
+    assert(this != 0);
+    assert(m_pHandler != 0);
+
+    m_pHandler(m_pContext);
+}
+
+//******************************************************************************
+// Returns the tick at which the timer expires.
+//******************************************************************************
+unsigned long long Timer::Deadline() const
+{
+    assert(this != 0);
+
+    return m_Deadline;
+}
+
+//******************************************************************************
+// Returns whether the timer is waiting for its deadline.
+//******************************************************************************
+bool Timer::Armed() const
+{
+    assert(this != 0);
+
+    return m_Slot >= 0;
+}
+
+} // namespace Threading
+} // namespace Nutshell
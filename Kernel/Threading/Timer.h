@@ -0,0 +1,50 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_TIMER_H
+#define THREADING_TIMER_H
+
+namespace Nutshell {
+namespace Threading {
+
+// The deadline of a wait that never times out
+const unsigned long long INFINITE_DEADLINE = ~0ULL;
+
+//******************************************************************************
+// This class encapsulates a timer. Once started on the scheduler, a timer has
+// its handler called from the clock interrupt when its  deadline  is reached.
+// Deadlines are expressed in clock ticks (see /Machine::GetClockTicks/).
+//******************************************************************************
+class Timer : boost::noncopyable {
+private:
+
+    unsigned long long  m_Deadline;             // The tick at which the timer expires.
+    void                (* m_pHandler)(void*);  // The function called when the timer expires.
+    void*               m_pContext;             // The argument passed to the handler.
+
+    Timer*              m_pNext;                // The next timer in the wheel slot holding the timer.
+    Timer*              m_pPrevious;            // The previous timer in the wheel slot holding the timer.
+    int                 m_Slot;                 // The wheel slot holding the timer, or -1.
+
+    friend class TimerWheel;
+
+public:
+
+    // Construction / destruction
+    Timer(void (* p_pHandler)(void*) = 0, void* p_pContext = 0);
+    ~Timer();
+
+    // Timer management
+    void    Handler(void (* p_pHandler)(void*), void* p_pContext);
+    void    Fire();
+
+    // Timer information
+    unsigned long long  Deadline() const;
+    bool                Armed() const;
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_TIMER_H
@@ -0,0 +1,255 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#include "Global.h"
+#include "Threading/TimerWheel.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// Constructor.
+//******************************************************************************
+TimerWheel::TimerWheel()
+:   m_Now(0),
+    m_Size(0)
+{
+    assert(this != 0);
+
+    // All slots are empty to begin with
+    for (int level = 0; level < LEVELS; ++level) {
+        for (int slot = 0; slot < SLOTS; ++slot) {
+            m_Slots[level][slot] = 0;
+        }
+        m_Occupied[level] = 0;
+    }
+}
+
+//******************************************************************************
+// Destructor.
+//******************************************************************************
+TimerWheel::~TimerWheel()
+{
+    assert(this != 0);
+    assert(m_Size == 0);
+}
+
+//******************************************************************************
+// Adds a timer to the wheel.
+//
+// Parameters:
+//  p_pTimer    - The timer to add to the wheel.
+//  p_Deadline  - The tick at which the timer expires. If it is already past,
+//                the timer expires at the next processed tick.
+//******************************************************************************
+void TimerWheel::Insert(Timer* p_pTimer, unsigned long long p_Deadline)
+{
+    assert(this != 0);
+    assert(p_pTimer != 0);
+    assert(!p_pTimer->Armed());
+
+    // The slot of the current tick has already been processed
+    p_pTimer->m_Deadline = p_Deadline;
+    Place(p_pTimer, m_Now + 1);
+
+    ++m_Size;
+}
+
+//******************************************************************************
+// Removes a timer from the wheel before it expires.
+//
+// Parameters:
+//  p_pTimer - The timer to remove from the wheel.
+//******************************************************************************
+void TimerWheel::Remove(Timer* p_pTimer)
+{
+    assert(this != 0);
+    assert(p_pTimer != 0);
+    assert(p_pTimer->Armed());
+    assert(m_Size > 0);
+
+    int level   = p_pTimer->m_Slot / SLOTS;
+    int slot    = p_pTimer->m_Slot % SLOTS;
+
+    // Unlink the timer from its neighbours
+    if (p_pTimer->m_pPrevious != 0) {
+        p_pTimer->m_pPrevious->m_pNext = p_pTimer->m_pNext;
+    } else {
+        m_Slots[level][slot] = p_pTimer->m_pNext;
+        if (p_pTimer->m_pNext == 0) Utilities::BitModify(m_Occupied[level], slot, false);
+    }
+    if (p_pTimer->m_pNext != 0) {
+        p_pTimer->m_pNext->m_pPrevious = p_pTimer->m_pPrevious;
+    }
+
+    // The timer no longer belongs to the wheel
+    p_pTimer->m_pNext       = 0;
+    p_pTimer->m_pPrevious   = 0;
+    p_pTimer->m_Slot        = -1;
+
+    --m_Size;
+}
+
+//******************************************************************************
+// Advances the wheel up to a specific tick and removes an expired timer.
+//
+// Parameters:
+//  p_Now - The current tick.
+//
+// Returns:
+//  A timer that has expired, or 0 if no more timers have expired. This should
+//  be called repeatedly until it returns 0.
+//******************************************************************************
+Timer* TimerWheel::Expire(unsigned long long p_Now)
+{
+    assert(this != 0);
+
+    for (;;) {
+        // Check if a timer expires at the tick being processed
+        Timer* pTimer = m_Slots[0][m_Now & (SLOTS - 1)];
+        if (pTimer != 0) {
+            Remove(pTimer);
+            return pTimer;
+        }
+
+        // Check if we have caught up with time
+        if (m_Now >= p_Now) return 0;
+
+        // If there are no timers at all, there is nothing to cascade.
+        if (m_Size == 0) {
+            m_Now = p_Now;
+            return 0;
+        }
+
+        // Move to the next tick, skipping to the end of the lowest level if
+        // it has no timers.
+        if (m_Occupied[0] == 0) {
+            m_Now = std::min(p_Now, (m_Now | (SLOTS - 1)) + 1);
+        } else {
+            ++m_Now;
+        }
+
+        // When the lowest level wraps around, bring down the timers that are
+        // now close enough.
+        if ((m_Now & (SLOTS - 1)) == 0) Cascade(1);
+    }
+}
+
+//******************************************************************************
+// Returns the earliest tick at which /Expire/ may have something to do, or
+// INFINITE_DEADLINE if the wheel is empty. This may be earlier than the  real
+// deadline of the first timer when timers of the upper levels must cascade.
+//******************************************************************************
+unsigned long long TimerWheel::NextExpiry() const
+{
+    assert(this != 0);
+
+    // Check if there are timers at all
+    if (m_Size == 0) return INFINITE_DEADLINE;
+
+    // Timers in the upper levels are looked at when the lowest level wraps
+    unsigned long long next = INFINITE_DEADLINE;
+    for (int level = 1; level < LEVELS; ++level) {
+        if (m_Occupied[level] != 0) {
+            next = (m_Now | (SLOTS - 1)) + 1;
+            break;
+        }
+    }
+
+    // Look for the first occupied slot of the lowest level, starting at the
+    // one of the current tick.
+    if (m_Occupied[0] != 0) {
+        int position = m_Now & (SLOTS - 1);
+        unsigned rotated = m_Occupied[0] >> position;
+        if (position != 0) rotated |= m_Occupied[0] << (SLOTS - position);
+        next = std::min(next, m_Now + Utilities::BitScanLeft(rotated));
+    }
+
+    return next;
+}
+
+//******************************************************************************
+// Returns whether the wheel has no timers.
+//******************************************************************************
+bool TimerWheel::Empty() const
+{
+    assert(this != 0);
+
+    return m_Size == 0;
+}
+
+//******************************************************************************
+// Returns the number of timers in the wheel.
+//******************************************************************************
+size_t TimerWheel::Size() const
+{
+    assert(this != 0);
+
+    return m_Size;
+}
+
+//******************************************************************************
+// Links a timer in the slot matching its deadline.
+//
+// Parameters:
+//  p_pTimer    - The timer to link.
+//  p_Earliest  - The earliest tick at which the timer may expire.
+//******************************************************************************
+void TimerWheel::Place(Timer* p_pTimer, unsigned long long p_Earliest)
+{
+    assert(this != 0);
+    assert(p_pTimer != 0);
+
+    // Find the lowest level whose range covers the deadline
+    unsigned long long deadline = std::max(p_pTimer->m_Deadline, p_Earliest);
+    unsigned long long delta    = deadline - m_Now;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ULL << (LEVEL_BITS * (level + 1)))) ++level;
+
+    // Deadlines beyond the range of the wheel are parked at its far end, and
+    // placed again when they cascade.
+    if (delta >= (1ULL << (LEVEL_BITS * LEVELS))) {
+        deadline = m_Now + (1ULL << (LEVEL_BITS * LEVELS)) - 1;
+    }
+
+    // Link the timer at the beginning of the slot
+    int slot = (deadline >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    p_pTimer->m_pNext       = m_Slots[level][slot];
+    p_pTimer->m_pPrevious   = 0;
+    p_pTimer->m_Slot        = level * SLOTS + slot;
+    if (p_pTimer->m_pNext != 0) p_pTimer->m_pNext->m_pPrevious = p_pTimer;
+    m_Slots[level][slot] = p_pTimer;
+    Utilities::BitModify(m_Occupied[level], slot, true);
+}
+
+//******************************************************************************
+// Moves the timers of the current slot of a level down to the lower levels.
+//
+// Parameters:
+//  p_Level - The level whose current slot must be emptied.
+//******************************************************************************
+void TimerWheel::Cascade(int p_Level)
+{
+    assert(this != 0);
+    assert(p_Level > 0 && p_Level < LEVELS);
+
+    // Detach all timers of the current slot of the level
+    int slot = (m_Now >> (LEVEL_BITS * p_Level)) & (SLOTS - 1);
+    Timer* pTimer = m_Slots[p_Level][slot];
+    m_Slots[p_Level][slot] = 0;
+    Utilities::BitModify(m_Occupied[p_Level], slot, false);
+
+    // Place them again according to the time left
+    while (pTimer != 0) {
+        Timer* pNext = pTimer->m_pNext;
+        Place(pTimer, m_Now);
+        pTimer = pNext;
+    }
+
+    // When this level wraps around too, cascade the next one.
+    if (slot == 0 && p_Level + 1 < LEVELS) Cascade(p_Level + 1);
+}
+
+} // namespace Threading
+} // namespace Nutshell
@@ -0,0 +1,61 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef THREADING_TIMERWHEEL_H
+#define THREADING_TIMERWHEEL_H
+
+#include "Threading/Timer.h"
+
+namespace Nutshell {
+namespace Threading {
+
+//******************************************************************************
+// This class encapsulates a hierarchical timer wheel. Each level divides time
+// in slots  that  are  SLOTS  times  wider than those of the level below. A
+// timer is kept in the level matching how far its  deadline  is, and  moves
+// down (cascades) as time passes, so that starting and stopping a timer take
+// constant time.
+//******************************************************************************
+class TimerWheel : boost::noncopyable {
+private:
+
+    // The number of bits of a deadline indexing the slots of a level
+    static const int    LEVEL_BITS  = 5;
+
+    // The number of slots per level and the number of levels
+    static const int    SLOTS       = 1 << LEVEL_BITS;
+    static const int    LEVELS      = 5;
+
+    Timer*              m_Slots[LEVELS][SLOTS]; // The timers held in each slot.
+    unsigned            m_Occupied[LEVELS];     // Bit n is raised when slot n of the level isn't empty.
+    unsigned long long  m_Now;                  // The last tick that has been processed.
+    size_t              m_Size;                 // The number of timers in the wheel.
+
+public:
+
+    // Construction / destruction
+    TimerWheel();
+    ~TimerWheel();
+
+    // Wheel management
+    void    Insert(Timer* p_pTimer, unsigned long long p_Deadline);
+    void    Remove(Timer* p_pTimer);
+    Timer*  Expire(unsigned long long p_Now);
+
+    // Wheel information
+    unsigned long long  NextExpiry() const;
+    bool                Empty() const;
+    size_t              Size() const;
+
+private:
+
+    // Internal helpers
+    void    Place(Timer* p_pTimer, unsigned long long p_Earliest);
+    void    Cascade(int p_Level);
+};
+
+} // namespace Threading
+} // namespace Nutshell
+
+#endif // !THREADING_TIMERWHEEL_H
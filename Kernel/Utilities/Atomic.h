@@ -0,0 +1,349 @@
+//******************************************************************************
+// Copyright (C) Martin Laporte.
+//******************************************************************************
+
+#ifndef UTILITIES_ATOMIC_H
+#define UTILITIES_ATOMIC_H
+
+namespace Nutshell {
+namespace Utilities {
+
+//******************************************************************************
+// This class encapsulates a variable of 32 bits that is only accessed with
+// atomic operations. Every operation that modifies it is a full barrier, a
+// load is an acquire and a store is a release.
+//******************************************************************************
+template <typename TYPE>
+class Atomic : boost::noncopyable {
+private:
+
+    TYPE    m_Value;    // The value of the variable.
+
+public:
+
+    // Construction / destruction
+    explicit Atomic(TYPE p_Value = TYPE());
+
+    // Variable access
+    TYPE    Load() const;
+    void    Store(TYPE p_Value);
+
+    // Variable manipulation
+    TYPE    Exchange(TYPE p_Value);
+    TYPE    CompareExchange(TYPE p_NewValue, TYPE p_Compare);
+    TYPE    FetchAdd(TYPE p_Add);
+    TYPE    FetchSubstract(TYPE p_Sub);
+    TYPE    FetchOr(TYPE p_Mask);
+    TYPE    FetchAnd(TYPE p_Mask);
+    TYPE    operator++();
+    TYPE    operator--();
+};
+
+//******************************************************************************
+// This class encapsulates a variable of 64 bits that is only accessed with
+// atomic operations. The processor has no 64 bits loads or stores, so all
+// the operations compare and exchange the whole variable.
+//******************************************************************************
+template <>
+class Atomic<unsigned long long> : boost::noncopyable {
+private:
+
+    unsigned long long  m_Value;    // The value of the variable.
+
+public:
+
+    // Construction / destruction
+    explicit Atomic(unsigned long long p_Value = 0);
+
+    // Variable access
+    unsigned long long  Load() const;
+    void                Store(unsigned long long p_Value);
+
+    // Variable manipulation
+    unsigned long long  Exchange(unsigned long long p_Value);
+    unsigned long long  CompareExchange(unsigned long long p_NewValue, unsigned long long p_Compare);
+    unsigned long long  FetchAdd(unsigned long long p_Add);
+};
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_Value - The initial value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline Atomic<TYPE>::Atomic(TYPE p_Value)
+:   m_Value(p_Value)
+{
+    assert(this != 0);
+    assert(sizeof(TYPE) == sizeof(int));
+}
+
+//******************************************************************************
+// Returns the value of the variable. Accesses that follow can't be moved
+// before this one.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::Load() const
+{
+    assert(this != 0);
+
+    // Aligned reads are atomic, and the processor doesn't move later accesses
+    // before them, so the compiler is all we need to keep in line.
+    TYPE value = *static_cast<const volatile TYPE*>(&m_Value);
+    CompilerBarrier();
+
+    return value;
+}
+
+//******************************************************************************
+// Changes the value of the variable. Accesses that precede can't be moved
+// after this one.
+//
+// Parameters:
+//  p_Value - The new value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline void Atomic<TYPE>::Store(TYPE p_Value)
+{
+    assert(this != 0);
+
+    CompilerBarrier();
+    *static_cast<volatile TYPE*>(&m_Value) = p_Value;
+}
+
+//******************************************************************************
+// Exchanges the value of the variable with another one.
+//
+// Parameters:
+//  p_Value - The new value of the variable.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::Exchange(TYPE p_Value)
+{
+    assert(this != 0);
+
+    return ThreadSafeExchange(m_Value, p_Value);
+}
+
+//******************************************************************************
+// Exchanges the value of the variable with another one if its current value
+// is equal to another one.
+//
+// Parameters:
+//  p_NewValue  - The new value of the variable.
+//  p_Compare   - The value to compare the current one with.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::CompareExchange(TYPE p_NewValue, TYPE p_Compare)
+{
+    assert(this != 0);
+
+    return ThreadSafeCompareExchange(m_Value, p_NewValue, p_Compare);
+}
+
+//******************************************************************************
+// Adds a value to the variable.
+//
+// Parameters:
+//  p_Add - The value to add.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::FetchAdd(TYPE p_Add)
+{
+    assert(this != 0);
+
+    return ThreadSafeExchangeAdd(m_Value, p_Add);
+}
+
+//******************************************************************************
+// Substracts a value from the variable.
+//
+// Parameters:
+//  p_Sub - The value to substract.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::FetchSubstract(TYPE p_Sub)
+{
+    assert(this != 0);
+
+    return ThreadSafeExchangeAdd(m_Value, static_cast<TYPE>(0 - p_Sub));
+}
+
+//******************************************************************************
+// Raises bits of the variable.
+//
+// Parameters:
+//  p_Mask - The bits to raise.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::FetchOr(TYPE p_Mask)
+{
+    assert(this != 0);
+
+    return ThreadSafeOr(m_Value, p_Mask);
+}
+
+//******************************************************************************
+// Clears bits of the variable.
+//
+// Parameters:
+//  p_Mask - The bits to keep.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::FetchAnd(TYPE p_Mask)
+{
+    assert(this != 0);
+
+    return ThreadSafeAnd(m_Value, p_Mask);
+}
+
+//******************************************************************************
+// Increments the variable.
+//
+// Returns:
+//  The new value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::operator++()
+{
+    assert(this != 0);
+
+    return static_cast<TYPE>(FetchAdd(1) + 1);
+}
+
+//******************************************************************************
+// Decrements the variable.
+//
+// Returns:
+//  The new value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE Atomic<TYPE>::operator--()
+{
+    assert(this != 0);
+
+    return static_cast<TYPE>(FetchSubstract(1) - 1);
+}
+
+//******************************************************************************
+// Constructor.
+//
+// Parameters:
+//  p_Value - The initial value of the variable.
+//******************************************************************************
+inline Atomic<unsigned long long>::Atomic(unsigned long long p_Value)
+:   m_Value(p_Value)
+{
+    assert(this != 0);
+}
+
+//******************************************************************************
+// Returns the value of the variable.
+//******************************************************************************
+inline unsigned long long Atomic<unsigned long long>::Load() const
+{
+    assert(this != 0);
+
+    // Both halves must come from the same write. Comparing with a value and
+    // putting the same one back reads them at once, and never changes them.
+    return ThreadSafeCompareExchange64(const_cast<unsigned long long&>(m_Value), 0, 0);
+}
+
+//******************************************************************************
+// Changes the value of the variable.
+//
+// Parameters:
+//  p_Value - The new value of the variable.
+//******************************************************************************
+inline void Atomic<unsigned long long>::Store(unsigned long long p_Value)
+{
+    assert(this != 0);
+
+    Exchange(p_Value);
+}
+
+//******************************************************************************
+// Exchanges the value of the variable with another one.
+//
+// Parameters:
+//  p_Value - The new value of the variable.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+inline unsigned long long Atomic<unsigned long long>::Exchange(unsigned long long p_Value)
+{
+    assert(this != 0);
+
+    // A failed comparison gives the current value, so we're  usually  done
+    // after the second try.
+    unsigned long long old = m_Value;
+    for (;;) {
+        unsigned long long current = ThreadSafeCompareExchange64(m_Value, p_Value, old);
+        if (current == old) return old;
+        old = current;
+    }
+}
+
+//******************************************************************************
+// Exchanges the value of the variable with another one if its current value
+// is equal to another one.
+//
+// Parameters:
+//  p_NewValue  - The new value of the variable.
+//  p_Compare   - The value to compare the current one with.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+inline unsigned long long Atomic<unsigned long long>::CompareExchange(unsigned long long p_NewValue, unsigned long long p_Compare)
+{
+    assert(this != 0);
+
+    return ThreadSafeCompareExchange64(m_Value, p_NewValue, p_Compare);
+}
+
+//******************************************************************************
+// Adds a value to the variable.
+//
+// Parameters:
+//  p_Add - The value to add.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+inline unsigned long long Atomic<unsigned long long>::FetchAdd(unsigned long long p_Add)
+{
+    assert(this != 0);
+
+    unsigned long long old = m_Value;
+    for (;;) {
+        unsigned long long current = ThreadSafeCompareExchange64(m_Value, old + p_Add, old);
+        if (current == old) return old;
+        old = current;
+    }
+}
+
+} // namespace Utilities
+} // namespace Nutshell
+
+#endif // !UTILITIES_ATOMIC_H
@@ -4,6 +4,7 @@
 
 #include "Global.h"
 #include "Utilities/Blocks.h"
+#include <boost/next_prior.hpp>
 
 namespace Nutshell {
 namespace Utilities {
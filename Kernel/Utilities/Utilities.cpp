@@ -9,6 +9,9 @@
 
 #include <algorithm>
 
+// The simulator runs on the host, which provides the C and C++ runtime
+#ifndef _SIMULATOR_
+
 int dummy()
 {
 /*    asm(".global _pthread_setspecific ; _pthread_setspecific:");
@@ -296,6 +299,8 @@ extern "C" void* sbrk(ssize_t p_Increment)
     return reinterpret_cast<void*>(KERNEL_SPACE_BOUNDARY + size - p_Increment);
 }
 
+#endif // !_SIMULATOR_
+
 namespace Nutshell {
 namespace Utilities {
 
@@ -374,6 +379,8 @@ int BitScanRight(unsigned p_Value)
     asm("bsr %1, %0" : "=r" (position) : "g" (p_Value));
 
     return position;
+#elif defined(_SIMULATOR_)
+    return p_Value == 0 ? -1 : 31 - __builtin_clz(p_Value);
 #else
     #error "Not implemented!"
 #endif // _INTEL386_
@@ -400,6 +407,8 @@ int BitScanLeft(unsigned p_Value)
     asm("bsf %1, %0" : "=r" (position) : "g" (p_Value));
 
     return position;
+#elif defined(_SIMULATOR_)
+    return p_Value == 0 ? -1 : __builtin_ctz(p_Value);
 #else
     #error "Not implemented!"
 #endif // _INTEL386_
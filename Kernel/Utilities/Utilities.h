@@ -5,7 +5,13 @@
 #ifndef UTILITIES_UTILITIES_H
 #define UTILITIES_UTILITIES_H
 
-// Standard C/C++ and library support calls
+// Standard C/C++ and library support calls. The simulator gets them from the
+// host headers.
+#ifdef _SIMULATOR_
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#else
 extern "C" void     abort();
 extern "C" void*    memcpy(void* p_pDest, const void* p_pSource, size_t p_Count);
 extern "C" void*    memmove(void* p_pDest, const void* p_pSource, size_t p_Count);
@@ -14,6 +20,7 @@ extern "C" char*    strcpy(char* p_pDest, const char* p_pSource);
 extern "C" int      strcmp(const char* p_pFirst, const char* p_pSecond);
 extern "C" size_t   strlen(const char* p_pString);
 extern "C" void*    sbrk(ssize_t p_Increment);
+#endif // _SIMULATOR_
 
 namespace Nutshell {
 namespace Utilities {
@@ -44,13 +51,16 @@ int BitScanLeft(unsigned p_Value);
 template <typename TYPE>
 inline TYPE ThreadSafeExchange(TYPE& p_rValue, TYPE p_NewValue)
 {
-    assert(reinterpret_cast<unsigned>(&p_rValue) % sizeof(int) == 0);
+    assert(reinterpret_cast<size_t>(&p_rValue) % sizeof(int) == 0);
 
 #ifdef _INTEL386_
     // Use an assembler instruction to perform the operation
-    asm("lock xchgl %1, %0" : "=m" (p_rValue), "=r" (p_NewValue) : "1" (p_NewValue));
+    asm volatile("lock xchgl %1, %0" : "=m" (p_rValue), "=r" (p_NewValue) : "1" (p_NewValue) : "memory");
 
     return p_NewValue;
+#elif defined(_SIMULATOR_)
+    // The simulator runs on the host, so let the compiler pick the instruction
+    return __sync_lock_test_and_set(&p_rValue, p_NewValue);
 #else
     #error "Not implemented!"
 #endif // _INTEL_386_
@@ -71,14 +81,49 @@ inline TYPE ThreadSafeExchange(TYPE& p_rValue, TYPE p_NewValue)
 template<typename TYPE, typename COMPARE>
 inline COMPARE ThreadSafeCompareExchange(TYPE& p_rValue, TYPE p_NewValue, COMPARE p_Compare)
 {
-    assert(reinterpret_cast<unsigned>(&p_rValue) % sizeof(int) == 0);
-    assert(sizeof(TYPE) == sizeof(int));
+    assert(reinterpret_cast<size_t>(&p_rValue) % sizeof(int) == 0);
 
 #ifdef _INTEL386_
+    assert(sizeof(TYPE) == sizeof(int));
+
     // Use an assembler instruction to perform the operation
-    asm("lock cmpxchgl %2, %0" : "=m" (p_rValue), "=a" (p_Compare) : "r" (p_NewValue), "1" (p_Compare));
+    asm volatile("lock cmpxchgl %2, %0" : "=m" (p_rValue), "=a" (p_Compare) : "r" (p_NewValue), "1" (p_Compare) : "memory");
 
     return p_Compare;
+#elif defined(_SIMULATOR_)
+    return __sync_val_compare_and_swap(&p_rValue, static_cast<TYPE>(p_Compare), p_NewValue);
+#else
+    #error "Not implemented!"
+#endif // _INTEL_386_
+}
+
+//******************************************************************************
+// Exchanges the value of a 64 bits variable with another one if its current
+// value is equal to another one.
+//
+// Parameters:
+//  p_rValue    - The variable to exchange with.
+//  p_NewValue  - The value to put in the variable instead.
+//  p_Compare   - The value to compare the current one with.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+inline unsigned long long ThreadSafeCompareExchange64(unsigned long long& p_rValue, unsigned long long p_NewValue, unsigned long long p_Compare)
+{
+    assert(reinterpret_cast<size_t>(&p_rValue) % sizeof(int) == 0);
+
+#ifdef _INTEL386_
+    // Use an assembler instruction to perform the operation. It takes the new
+    // value in ecx:ebx, and compares with edx:eax.
+    asm volatile("lock cmpxchg8b %0"
+                 : "+m" (p_rValue), "+A" (p_Compare)
+                 : "b" (static_cast<unsigned>(p_NewValue)), "c" (static_cast<unsigned>(p_NewValue >> 32))
+                 : "memory");
+
+    return p_Compare;
+#elif defined(_SIMULATOR_)
+    return __sync_val_compare_and_swap(&p_rValue, p_Compare, p_NewValue);
 #else
     #error "Not implemented!"
 #endif // _INTEL_386_
@@ -97,12 +142,10 @@ inline COMPARE ThreadSafeCompareExchange(TYPE& p_rValue, TYPE p_NewValue, COMPAR
 template <typename TYPE>
 inline TYPE ThreadSafeAdd(TYPE& p_rValue, TYPE p_Add)
 {
-    // TODO: Maybe implement directly in assembly code.
     for (;;) {
         TYPE old = p_rValue;
-        TYPE expected = old + p_Add;
-        if (ThreadSafeCompareExchange(p_rValue, expected, old) == expected) {
-            return expected;
+        if (ThreadSafeCompareExchange(p_rValue, static_cast<TYPE>(old + p_Add), old) == old) {
+            return old;
         }
     }
 }
@@ -120,7 +163,129 @@ inline TYPE ThreadSafeAdd(TYPE& p_rValue, TYPE p_Add)
 template <typename TYPE>
 inline TYPE ThreadSafeSubstract(TYPE& p_rValue, TYPE p_Sub)
 {
-    ThreadSafeAdd(p_rValue, -p_Sub);
+    return ThreadSafeAdd(p_rValue, static_cast<TYPE>(0 - p_Sub));
+}
+
+//******************************************************************************
+// Combines the bits of a variable with a mask, with a bitwise or.
+//
+// Parameters:
+//  p_rValue - The variable to combine.
+//  p_Mask   - The bits to raise.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE ThreadSafeOr(TYPE& p_rValue, TYPE p_Mask)
+{
+    // A locked /or/ doesn't give the old value back, so we compare and exchange
+    for (;;) {
+        TYPE old = p_rValue;
+        if (ThreadSafeCompareExchange(p_rValue, static_cast<TYPE>(old | p_Mask), old) == old) {
+            return old;
+        }
+    }
+}
+
+//******************************************************************************
+// Combines the bits of a variable with a mask, with a bitwise and.
+//
+// Parameters:
+//  p_rValue - The variable to combine.
+//  p_Mask   - The bits to keep.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE ThreadSafeAnd(TYPE& p_rValue, TYPE p_Mask)
+{
+    // A locked /and/ doesn't give the old value back, so we compare and exchange
+    for (;;) {
+        TYPE old = p_rValue;
+        if (ThreadSafeCompareExchange(p_rValue, static_cast<TYPE>(old & p_Mask), old) == old) {
+            return old;
+        }
+    }
+}
+
+//******************************************************************************
+// Adds a value to a variable in a single instruction, which  can't  fail  and
+// be retried like a compare and exchange loop.
+//
+// Parameters:
+//  p_rValue - The variable to add to.
+//  p_Add    - The value to add.
+//
+// Returns:
+//  The old value of the variable.
+//******************************************************************************
+template <typename TYPE>
+inline TYPE ThreadSafeExchangeAdd(TYPE& p_rValue, TYPE p_Add)
+{
+    assert(reinterpret_cast<size_t>(&p_rValue) % sizeof(int) == 0);
+
+#ifdef _INTEL386_
+    assert(sizeof(TYPE) == sizeof(int));
+
+    // Use an assembler instruction to perform the operation
+    asm volatile("lock xaddl %1, %0" : "+m" (p_rValue), "+r" (p_Add) : : "memory");
+
+    return p_Add;
+#elif defined(_SIMULATOR_)
+    return __sync_fetch_and_add(&p_rValue, p_Add);
+#else
+    #error "Not implemented!"
+#endif // _INTEL_386_
+}
+
+//******************************************************************************
+// Keeps the compiler from moving memory accesses across this point, and from
+// keeping values read from memory in registers. The processor already keeps
+// them in order for other processors.
+//******************************************************************************
+inline void CompilerBarrier()
+{
+    asm volatile("" : : : "memory");
+}
+
+//******************************************************************************
+// Keeps both the compiler and the processor from moving memory accesses across
+// this point. The processor only reorders a read before an earlier write  to
+// another location, so this is only needed when that matters, like in
+// Dekker's algorithm.
+//******************************************************************************
+inline void MemoryBarrier()
+{
+#ifdef _INTEL386_
+    // Locked instructions serialize memory accesses, and unlike /mfence/ this
+    // one exists on every processor.
+    asm volatile("lock; addl $0, 0(%%esp)" : : : "memory", "cc");
+#elif defined(_SIMULATOR_)
+    __sync_synchronize();
+#else
+    #error "Not implemented!"
+#endif // _INTEL_386_
+}
+
+//******************************************************************************
+// Called in each iteration of a busy wait. It tells the processor that it is
+// spinning, which saves power and avoids a pipeline flush when the wait ends,
+// and lets the memory being watched be read again.
+//******************************************************************************
+inline void SpinPause()
+{
+#ifdef _INTEL386_
+    // This is the /pause/ instruction, which older processors execute as a
+    // plain /nop/.
+    asm volatile("rep ; nop" : : : "memory");
+#elif defined(_SIMULATOR_)
+    // The simulated processor never spins against another one
+    CompilerBarrier();
+#else
+    #error "Not implemented!"
+#endif // _INTEL_386_
 }
 
 //=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-